@@ -1,6 +1,12 @@
 #include "allocations_checker.h"
+#include "leaks.h"
+#include "sampling.h"
 
+#include <algorithm>
 #include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
 #include <new>
 #include <stdexcept>
 
@@ -13,31 +19,205 @@
 #endif
 #endif
 
-std::atomic<size_t> allocations_count{0}, deallocations_count{0};
+namespace {
+
+// Each thread updates its own cache line; readers merge all shards.
+// Threads beyond `kShards` share shards, so every update is still an atomic RMW,
+// but an uncontended one in the common case.
+constexpr size_t kShards = 64;
+
+struct alignas(64) Shard {
+    std::atomic<size_t> allocs{0};
+    std::atomic<size_t> deallocs{0};
+    std::atomic<size_t> alloc_bytes{0};
+    std::atomic<size_t> dealloc_bytes{0};
+    std::atomic<ptrdiff_t> live_bytes{0};
+    std::atomic<ptrdiff_t> peak_live_bytes{0};
+    std::atomic<size_t> size_classes[alloc_checker::kSizeClasses] = {};
+};
+
+Shard shards[kShards];
+std::atomic<size_t> next_shard{0};
+
+Shard& LocalShard() {
+    thread_local Shard& shard =
+        shards[next_shard.fetch_add(1, std::memory_order_relaxed) % kShards];
+    return shard;
+}
+
+void RecordAlloc(size_t size) {
+    Shard& shard = LocalShard();
+    shard.allocs.fetch_add(1, std::memory_order_relaxed);
+    shard.alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    shard.size_classes[alloc_checker::SizeClass(size)].fetch_add(1, std::memory_order_relaxed);
+
+    auto delta = static_cast<ptrdiff_t>(size);
+    ptrdiff_t live = shard.live_bytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+    ptrdiff_t peak = shard.peak_live_bytes.load(std::memory_order_relaxed);
+    while (live > peak &&
+           !shard.peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void RecordFree(size_t size) {
+    Shard& shard = LocalShard();
+    shard.deallocs.fetch_add(1, std::memory_order_relaxed);
+    shard.dealloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    shard.live_bytes.fetch_sub(static_cast<ptrdiff_t>(size), std::memory_order_relaxed);
+}
+
+template <typename F>
+size_t Sum(F field) {
+    size_t result = 0;
+    for (auto& shard : shards) {
+        result += field(shard).load(std::memory_order_relaxed);
+    }
+    return result;
+}
+
+}  // namespace
 
 namespace alloc_checker {
 
 size_t AllocCount() {
-    return allocations_count.load();
+    return Sum([](Shard& shard) -> auto& { return shard.allocs; });
 }
 
 size_t DeallocCount() {
-    return deallocations_count.load();
+    return Sum([](Shard& shard) -> auto& { return shard.deallocs; });
 }
 
 void ResetCounters() {
-    allocations_count.store(0);
-    deallocations_count.store(0);
+    for (auto& shard : shards) {
+        shard.allocs.store(0);
+        shard.deallocs.store(0);
+        shard.alloc_bytes.store(0);
+        shard.dealloc_bytes.store(0);
+        shard.live_bytes.store(0);
+        shard.peak_live_bytes.store(0);
+        for (auto& size_class : shard.size_classes) {
+            size_class.store(0);
+        }
+    }
+}
+
+size_t SizeClass(size_t size) {
+    if (size <= 1) {
+        return 0;
+    }
+    size_t size_class = std::bit_width(size - 1);
+    return size_class < kSizeClasses ? size_class : kSizeClasses - 1;
+}
+
+Stats Snapshot() {
+    Stats stats;
+    for (auto& shard : shards) {
+        stats.allocs += shard.allocs.load(std::memory_order_relaxed);
+        stats.deallocs += shard.deallocs.load(std::memory_order_relaxed);
+        stats.alloc_bytes += shard.alloc_bytes.load(std::memory_order_relaxed);
+        stats.dealloc_bytes += shard.dealloc_bytes.load(std::memory_order_relaxed);
+        stats.live_bytes += shard.live_bytes.load(std::memory_order_relaxed);
+        stats.peak_live_bytes += shard.peak_live_bytes.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < kSizeClasses; ++i) {
+            stats.size_classes[i] += shard.size_classes[i].load(std::memory_order_relaxed);
+        }
+    }
+    return stats;
+}
+
+Stats Diff(const Stats& before, const Stats& after) {
+    Stats diff;
+    diff.allocs = after.allocs - before.allocs;
+    diff.deallocs = after.deallocs - before.deallocs;
+    diff.alloc_bytes = after.alloc_bytes - before.alloc_bytes;
+    diff.dealloc_bytes = after.dealloc_bytes - before.dealloc_bytes;
+    diff.live_bytes = after.live_bytes - before.live_bytes;
+    diff.peak_live_bytes = std::max<ptrdiff_t>(after.peak_live_bytes - before.live_bytes, 0);
+    for (size_t i = 0; i < kSizeClasses; ++i) {
+        diff.size_classes[i] = after.size_classes[i] - before.size_classes[i];
+    }
+    return diff;
+}
+
+void ResetPeak() {
+    for (auto& shard : shards) {
+        shard.peak_live_bytes.store(shard.live_bytes.load(std::memory_order_relaxed),
+                                    std::memory_order_relaxed);
+    }
 }
 
 }  // namespace alloc_checker
 
-void MallocHook(const volatile void*, size_t) {
-    allocations_count.fetch_add(1);
+#ifdef HAS_SANITIZER
+namespace {
+
+size_t AllocatedSize(const volatile void* ptr) {
+    const void* p = const_cast<const void*>(ptr);
+    return __sanitizer_get_ownership(p) ? __sanitizer_get_allocated_size(p) : 0;
+}
+
+}  // namespace
+#else
+namespace {
+
+// Without sanitizer hooks the size of a block is not known at `free` time,
+// so every block is prefixed with a header holding the requested size.
+// The tag tells blocks recorded by the leak tracker from the rest, so that frees of the rest do
+// not touch the table. It is derived from the block's address, so that leftovers of a freed
+// block or of foreign memory are unlikely to pass for a live header.
+struct Header {
+    size_t size;
+    uintptr_t tag;
+};
+
+constexpr size_t kHeaderSize = alignof(std::max_align_t);
+static_assert(sizeof(Header) <= kHeaderSize);
+
+constexpr uintptr_t kUntrackedTag = 0xA110'CA7E'D0B1'0C4Bull;
+constexpr uintptr_t kTrackedTag = 0x7EAC'ED00'B10C'4B1Full;
+
+uintptr_t Tag(const volatile void* ptr, bool tracked) {
+    return reinterpret_cast<uintptr_t>(ptr) ^ (tracked ? kTrackedTag : kUntrackedTag);
 }
 
-void FreeHook(const volatile void*) {
-    deallocations_count.fetch_add(1);
+Header* GetHeader(const volatile void* ptr) {
+    auto* p = static_cast<char*>(const_cast<void*>(ptr));
+    return reinterpret_cast<Header*>(p - kHeaderSize);
+}
+
+size_t AllocatedSize(const volatile void* ptr) {
+    return ptr == nullptr ? 0 : GetHeader(ptr)->size;
+}
+
+}  // namespace
+#endif
+
+namespace {
+
+// Returns true if the block got recorded by the leak tracker.
+bool OnAlloc(const volatile void* ptr, size_t size, const void* caller) {
+    RecordAlloc(size);
+    uint64_t sample_id = 0;
+    if (alloc_checker::detail::sampling_enabled.load(std::memory_order_relaxed)) {
+        sample_id = alloc_checker::detail::SampleAllocation(size, caller);
+    }
+    if (alloc_checker::detail::leak_tracking_enabled.load(std::memory_order_relaxed)) {
+        return alloc_checker::detail::RecordAllocation(ptr, size, sample_id);
+    }
+    return false;
+}
+
+}  // namespace
+
+void MallocHook(const volatile void* ptr, size_t size) {
+    OnAlloc(ptr, size, nullptr);
+}
+
+void FreeHook(const volatile void* ptr) {
+    if (ptr != nullptr) {
+        alloc_checker::detail::ForgetAllocation(ptr);
+    }
+    RecordFree(AllocatedSize(ptr));
 }
 
 #ifdef HAS_SANITIZER
@@ -49,47 +229,72 @@ void FreeHook(const volatile void*) {
     return 0;
 }();
 #else
-void* operator new(size_t size) {
-    void* p = malloc(size);
-    MallocHook(p, size);
+namespace {
+
+void* Allocate(size_t size, const void* caller) {
+    auto* block = static_cast<char*>(malloc(size + kHeaderSize));
+    if (block == nullptr) {
+        return nullptr;
+    }
+    auto* header = reinterpret_cast<Header*>(block);
+    header->size = size;
+    void* p = block + kHeaderSize;
+    header->tag = Tag(p, OnAlloc(p, size, caller));
     return p;
 }
 
+// The header of a live block carries one of its two tags. Anything else is a double free, whose
+// header the allocator has reused, or a pointer `Allocate` never returned: it is reported and
+// not released. Telling those apart reads the 16 bytes before the pointer, which for a foreign
+// pointer may be anything; a tracked block must also be found in the table.
+void Deallocate(void* p) {
+    if (p != nullptr) {
+        Header* header = GetHeader(p);
+        bool valid = header->tag == Tag(p, false) ||
+                     (header->tag == Tag(p, true) && alloc_checker::detail::ForgetAllocation(p));
+        if (!valid) {
+            alloc_checker::detail::ReportInvalidFree(p);
+            return;
+        }
+        header->tag = 0;
+    }
+    RecordFree(AllocatedSize(p));
+    if (p != nullptr) {
+        free(static_cast<char*>(p) - kHeaderSize);
+    }
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+    return Allocate(size, __builtin_return_address(0));
+}
+
 void* operator new(size_t size, const std::nothrow_t&) noexcept {
-    void* p = malloc(size);
-    MallocHook(p, size);
-    return p;
+    return Allocate(size, __builtin_return_address(0));
 }
 
 void* operator new[] (size_t size) {
-    void* p = malloc(size);
-    MallocHook(p, size);
-    return p;
+    return Allocate(size, __builtin_return_address(0));
 }
 
 void* operator new[] (size_t size, const std::nothrow_t&) noexcept {
-    void* p = malloc(size);
-    MallocHook(p, size);
-    return p;
+    return Allocate(size, __builtin_return_address(0));
 }
 
 void operator delete(void* p) noexcept {
-    FreeHook(p);
-    free(p);
+    Deallocate(p);
 }
 
 void operator delete(void* p, size_t) noexcept {
-    FreeHook(p);
-    free(p);
+    Deallocate(p);
 }
 
 void operator delete[] (void* p) noexcept {
-    FreeHook(p);
-    free(p);
+    Deallocate(p);
 }
 
 void operator delete[] (void* p, size_t) noexcept {
-    FreeHook(p);
-    free(p);
+    Deallocate(p);
 }
 #endif
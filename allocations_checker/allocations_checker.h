@@ -1,15 +1,138 @@
 #pragma once
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
 
 namespace alloc_checker {
 
+// Allocation sizes are bucketed into power-of-two classes:
+// class 0 holds sizes up to 1 byte, class k holds sizes in (2^(k-1), 2^k],
+// the last class also takes everything larger.
+inline constexpr std::size_t kSizeClasses = 32;
+
+struct Stats {
+    std::size_t allocs = 0;
+    std::size_t deallocs = 0;
+    std::size_t alloc_bytes = 0;
+    std::size_t dealloc_bytes = 0;
+
+    // Bytes allocated and not freed yet.
+    std::ptrdiff_t live_bytes = 0;
+
+    // High-water mark of `live_bytes` since the last `ResetPeak()`.
+    // Counters are kept per thread, so this is the sum of per-thread peaks: exact while a single
+    // thread allocates, an upper bound otherwise.
+    std::ptrdiff_t peak_live_bytes = 0;
+
+    std::array<std::size_t, kSizeClasses> size_classes{};
+};
+
 std::size_t AllocCount();
 
 std::size_t DeallocCount();
 
 void ResetCounters();
 
+std::size_t SizeClass(std::size_t size);
+
+// Merges the per-thread counters. Does not allocate.
+Stats Snapshot();
+
+// Counters accumulated between two snapshots. `peak_live_bytes` of the result is how far
+// the peak rose above `before.live_bytes`.
+Stats Diff(const Stats& before, const Stats& after);
+
+// Starts a new high-water mark window at the current `live_bytes`.
+void ResetPeak();
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sampled call-site attribution
+
+inline constexpr std::size_t kMaxSampleFrames = 16;
+
+// A thread takes a sample when either trigger fires; zero disables a trigger.
+struct SamplingOptions {
+    std::size_t every_n_allocs = 0;
+    std::size_t every_n_bytes = 0;
+};
+
+struct Sample {
+    std::size_t size = 0;
+    std::size_t depth = 0;
+    std::array<void*, kMaxSampleFrames> frames{};
+};
+
+struct AllocationSite {
+    std::size_t samples = 0;
+    std::size_t bytes = 0;
+    std::size_t depth = 0;
+    std::array<void*, kMaxSampleFrames> frames{};
+};
+
+// Samples are written into a fixed ring buffer, older ones get overwritten.
+void StartSampling(const SamplingOptions& options);
+
+void StopSampling();
+
+void ClearSamples();
+
+// Returns false if the sample with this id has been overwritten or never existed.
+bool GetSample(std::uint64_t id, Sample* sample);
+
+// Samples still in the ring grouped by stack, most frequent first.
+std::vector<AllocationSite> TopAllocationSites(std::size_t limit);
+
+void DumpTopAllocationSites(std::ostream& out, std::size_t limit = 10);
+
+void PrintStack(std::ostream& out, const void* const* frames, std::size_t depth);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Leak and invalid free detection
+
+enum class InvalidFreeAction {
+    kReport,
+    kAbort,
+};
+
+struct LeakTrackingOptions {
+    InvalidFreeAction on_invalid_free = InvalidFreeAction::kReport;
+
+    // Print the blocks still alive to stderr when the process exits.
+    bool report_at_exit = false;
+};
+
+struct LiveAllocation {
+    const void* ptr = nullptr;
+    std::size_t size = 0;
+
+    // Id of the sample taken for this block, 0 if it was not sampled.
+    std::uint64_t sample_id = 0;
+};
+
+// Tracks every block allocated from now on in a table, which allocations made while tracking is
+// off never touch. Freeing a pointer that is not a live block is reported as an invalid free,
+// tracking or not, and the pointer is not released, so double frees do not reach the allocator.
+// Live blocks are told by a tag in their header, which covers blocks allocated before tracking
+// started; with sanitizers, which check frees themselves, nothing is reported.
+// Setting ALLOC_CHECKER_LEAKS=1 in the environment starts tracking at startup and reports at exit.
+void StartLeakTracking(const LeakTrackingOptions& options = {});
+
+// Blocks allocated while tracking no longer count as live.
+void StopLeakTracking();
+
+std::size_t LiveAllocationCount();
+
+std::vector<LiveAllocation> LiveAllocations();
+
+std::size_t InvalidFreeCount();
+
+// Prints tracked blocks that are still alive, with stacks of the sampled ones.
+// Returns the number of such blocks.
+std::size_t ReportLeaks(std::ostream& out);
+
 }  // namespace alloc_checker
 
 #define EXPECT_ZERO_ALLOCATIONS(X)                     \
@@ -32,3 +155,19 @@ void ResetCounters();
         X;                                                 \
         REQUIRE(alloc_checker::AllocCount() <= __xxx + 1); \
     } while (0)
+
+#define EXPECT_MAX_BYTES(X, n)                                              \
+    do {                                                                    \
+        alloc_checker::ResetPeak();                                         \
+        auto __xxx = alloc_checker::Snapshot();                             \
+        X;                                                                  \
+        auto __yyy = alloc_checker::Diff(__xxx, alloc_checker::Snapshot()); \
+        REQUIRE(__yyy.peak_live_bytes <= static_cast<std::ptrdiff_t>(n));   \
+    } while (0)
+
+#define EXPECT_NO_LEAKED_BYTES(X)                                                       \
+    do {                                                                                \
+        auto __xxx = alloc_checker::Snapshot();                                         \
+        X;                                                                              \
+        REQUIRE(alloc_checker::Diff(__xxx, alloc_checker::Snapshot()).live_bytes == 0); \
+    } while (0)
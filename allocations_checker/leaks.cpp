@@ -0,0 +1,346 @@
+#include "allocations_checker.h"
+#include "leaks.h"
+
+#include <iostream>
+#include <ostream>
+#include <thread>
+#include <utility>
+
+#include <execinfo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace alloc_checker::detail {
+
+std::atomic<bool> leak_tracking_enabled{false};
+
+}  // namespace alloc_checker::detail
+
+namespace {
+
+constexpr size_t kStripes = 64;
+constexpr size_t kInitialCapacity = 1024;
+
+constexpr uintptr_t kEmpty = 0;
+constexpr uintptr_t kDeleted = 1;
+
+struct Entry {
+    uintptr_t key;
+    size_t size;
+    uint64_t sample_id;
+
+    // The tracking session the block was allocated in.
+    uint64_t session;
+};
+
+uint64_t Hash(uintptr_t key) {
+    return (key >> 4) * 0x9E3779B97F4A7C15ull;
+}
+
+// One lock stripe: a spinlock and an open-addressing table with linear probing.
+// Storage comes straight from mmap so the table never re-enters the allocation hooks.
+class alignas(64) Stripe {
+public:
+    static constexpr int kSpins = 64;
+
+    // Spins for a while, then yields, so that a preempted holder gets to run.
+    void Lock() {
+        for (int spins = 0; locked_.exchange(true, std::memory_order_acquire);) {
+            while (locked_.load(std::memory_order_relaxed)) {
+                if (++spins < kSpins) {
+                    Pause();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    void Unlock() {
+        locked_.store(false, std::memory_order_release);
+    }
+
+    bool Insert(const Entry& entry) {
+        if ((used_ + 1) * 10 > capacity_ * 7 && !Rehash()) {
+            return false;
+        }
+        Entry* tombstone = nullptr;
+        for (size_t i = Hash(entry.key) >> 16;; ++i) {
+            Entry& slot = entries_[i & (capacity_ - 1)];
+            if (slot.key == entry.key) {
+                slot = entry;
+                return true;
+            }
+            if (slot.key == kDeleted && tombstone == nullptr) {
+                tombstone = &slot;
+            }
+            if (slot.key == kEmpty) {
+                if (tombstone == nullptr) {
+                    ++used_;
+                    tombstone = &slot;
+                }
+                *tombstone = entry;
+                ++size_;
+                return true;
+            }
+        }
+    }
+
+    bool Erase(uintptr_t key) {
+        if (capacity_ == 0) {
+            return false;
+        }
+        for (size_t i = Hash(key) >> 16;; ++i) {
+            Entry& slot = entries_[i & (capacity_ - 1)];
+            if (slot.key == key) {
+                slot.key = kDeleted;
+                --size_;
+                return true;
+            }
+            if (slot.key == kEmpty) {
+                return false;
+            }
+        }
+    }
+
+    template <typename F>
+    void ForEach(F f) const {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (entries_[i].key != kEmpty && entries_[i].key != kDeleted) {
+                f(entries_[i]);
+            }
+        }
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+private:
+    static void Pause() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+
+    bool Rehash() {
+        size_t capacity = capacity_ == 0 ? kInitialCapacity : capacity_;
+        if ((size_ + 1) * 10 > capacity * 7 / 2) {
+            capacity *= 2;
+        }
+        void* memory = mmap(nullptr, capacity * sizeof(Entry), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return false;
+        }
+
+        Entry* old_entries = std::exchange(entries_, static_cast<Entry*>(memory));
+        size_t old_capacity = std::exchange(capacity_, capacity);
+        size_ = used_ = 0;
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old_entries[i].key != kEmpty && old_entries[i].key != kDeleted) {
+                Insert(old_entries[i]);
+            }
+        }
+        if (old_entries != nullptr) {
+            munmap(old_entries, old_capacity * sizeof(Entry));
+        }
+        return true;
+    }
+
+    std::atomic<bool> locked_{false};
+    Entry* entries_ = nullptr;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+    size_t used_ = 0;
+};
+
+Stripe stripes[kStripes];
+
+Stripe& StripeFor(uintptr_t key) {
+    return stripes[Hash(key) >> 58];
+}
+
+std::atomic<uint64_t> session{0};
+
+// Set once anything is recorded: until then frees need not look at the table.
+std::atomic<bool> any_recorded{false};
+std::atomic<size_t> invalid_frees{0};
+std::atomic<bool> abort_on_invalid_free{false};
+
+// Set while the tracker itself allocates: its blocks are not leaks of the code under test.
+thread_local bool in_tracker = false;
+
+class TrackerScope {
+public:
+    TrackerScope() : previous_(std::exchange(in_tracker, true)) {
+    }
+
+    TrackerScope(const TrackerScope&) = delete;
+    TrackerScope& operator=(const TrackerScope&) = delete;
+
+    ~TrackerScope() {
+        in_tracker = previous_;
+    }
+
+private:
+    bool previous_;
+};
+
+// Allocated in the current session, which is still open.
+bool IsLeak(const Entry& entry) {
+    return entry.session == session.load(std::memory_order_relaxed) &&
+           alloc_checker::detail::leak_tracking_enabled.load(std::memory_order_relaxed);
+}
+
+void ReportAtExit() {
+    alloc_checker::ReportLeaks(std::cerr);
+}
+
+[[maybe_unused]] const bool kStartFromEnvironment = [] {
+    const char* value = getenv("ALLOC_CHECKER_LEAKS");
+    if (value != nullptr && *value != '\0' && *value != '0') {
+        alloc_checker::StartLeakTracking({.report_at_exit = true});
+    }
+    return true;
+}();
+
+}  // namespace
+
+namespace alloc_checker::detail {
+
+uint64_t LeakTrackingSession() {
+    return session.load(std::memory_order_relaxed);
+}
+
+bool RecordAllocation(const volatile void* ptr, size_t size, uint64_t sample_id) {
+    if (in_tracker) {
+        return false;
+    }
+    if (!any_recorded.load(std::memory_order_relaxed)) {
+        any_recorded.store(true, std::memory_order_relaxed);
+    }
+    auto key = reinterpret_cast<uintptr_t>(ptr);
+    Stripe& stripe = StripeFor(key);
+    stripe.Lock();
+    bool recorded = stripe.Insert({key, size, sample_id, session.load(std::memory_order_relaxed)});
+    stripe.Unlock();
+    return recorded;
+}
+
+bool ForgetAllocation(const volatile void* ptr) {
+    if (!any_recorded.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    auto key = reinterpret_cast<uintptr_t>(ptr);
+    Stripe& stripe = StripeFor(key);
+    stripe.Lock();
+    bool found = stripe.Erase(key);
+    stripe.Unlock();
+    return found;
+}
+
+void ReportInvalidFree(const volatile void* ptr) {
+    invalid_frees.fetch_add(1, std::memory_order_relaxed);
+
+    // Must not allocate: the heap may be in a bad shape already.
+    char message[128];
+    int length = snprintf(message, sizeof(message),
+                          "alloc_checker: free of unknown or already freed pointer %p\n",
+                          const_cast<const void*>(ptr));
+    [[maybe_unused]] auto written = write(STDERR_FILENO, message, length);
+    void* stack[kMaxSampleFrames];
+    backtrace_symbols_fd(stack, backtrace(stack, kMaxSampleFrames), STDERR_FILENO);
+
+    if (abort_on_invalid_free.load(std::memory_order_relaxed)) {
+        abort();
+    }
+}
+
+}  // namespace alloc_checker::detail
+
+namespace alloc_checker {
+
+void StartLeakTracking(const LeakTrackingOptions& options) {
+    abort_on_invalid_free.store(options.on_invalid_free == InvalidFreeAction::kAbort,
+                                std::memory_order_relaxed);
+    if (options.report_at_exit) {
+        static const bool kRegistered = [] {
+            TrackerScope scope;
+            return atexit(ReportAtExit) == 0;
+        }();
+        (void)kRegistered;
+    }
+    session.fetch_add(1, std::memory_order_relaxed);
+    detail::leak_tracking_enabled.store(true, std::memory_order_release);
+}
+
+void StopLeakTracking() {
+    detail::leak_tracking_enabled.store(false, std::memory_order_release);
+}
+
+size_t LiveAllocationCount() {
+    size_t count = 0;
+    for (auto& stripe : stripes) {
+        stripe.Lock();
+        stripe.ForEach([&count](const Entry& entry) { count += IsLeak(entry); });
+        stripe.Unlock();
+    }
+    return count;
+}
+
+std::vector<LiveAllocation> LiveAllocations() {
+    TrackerScope scope;
+
+    std::vector<LiveAllocation> result;
+    for (auto& stripe : stripes) {
+        // Growing the vector under the lock would re-enter the hooks: if the stripe outgrew the
+        // room reserved for it meanwhile, it is read again with more room.
+        size_t first = result.size();
+        for (size_t room = 16;; room *= 2) {
+            result.reserve(first + stripe.Size() + room);
+            stripe.Lock();
+            bool fits = first + stripe.Size() <= result.capacity();
+            if (fits) {
+                stripe.ForEach([&](const Entry& entry) {
+                    if (IsLeak(entry)) {
+                        result.push_back({reinterpret_cast<const void*>(entry.key), entry.size,
+                                          entry.sample_id});
+                    }
+                });
+            }
+            stripe.Unlock();
+            if (fits) {
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+size_t InvalidFreeCount() {
+    return invalid_frees.load(std::memory_order_relaxed);
+}
+
+size_t ReportLeaks(std::ostream& out) {
+    auto leaks = LiveAllocations();
+
+    TrackerScope scope;
+    size_t bytes = 0;
+    for (const auto& leak : leaks) {
+        bytes += leak.size;
+    }
+    out << "alloc_checker: " << leaks.size() << " live allocations, " << bytes << " bytes\n";
+    for (const auto& leak : leaks) {
+        out << "  " << leak.size << " bytes at " << leak.ptr << '\n';
+        Sample sample;
+        if (GetSample(leak.sample_id, &sample)) {
+            PrintStack(out, sample.frames.data(), sample.depth);
+        }
+    }
+    return leaks.size();
+}
+
+}  // namespace alloc_checker
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace alloc_checker::detail {
+
+extern std::atomic<bool> leak_tracking_enabled;
+
+// Tracking sessions are numbered from 1, every `StartLeakTracking` opens a new one.
+std::uint64_t LeakTrackingSession();
+
+// Called for blocks allocated while tracking. Blocks of the tracker itself are not recorded.
+// Returns false if the block was not recorded, also when the table could not grow.
+bool RecordAllocation(const volatile void* ptr, std::size_t size, std::uint64_t sample_id);
+
+// Returns false if the pointer is not a recorded block.
+bool ForgetAllocation(const volatile void* ptr);
+
+void ReportInvalidFree(const volatile void* ptr);
+
+}  // namespace alloc_checker::detail
@@ -0,0 +1,267 @@
+#include "allocations_checker.h"
+#include "sampling.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <ostream>
+#include <utility>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <stdlib.h>
+
+namespace alloc_checker::detail {
+
+std::atomic<bool> sampling_enabled{false};
+
+}  // namespace alloc_checker::detail
+
+namespace {
+
+using alloc_checker::kMaxSampleFrames;
+
+constexpr size_t kRingSize = 4096;
+
+// Room for the checker's own frames on top of the captured stack.
+constexpr size_t kExtraFrames = 8;
+
+constexpr uint64_t kWriting = ~uint64_t{0};
+
+// Written like a seqlock: `id` is set to `kWriting` while the payload is being replaced.
+// The payload is made of relaxed atomics so concurrent readers are not data races.
+// Ids that are `kRingSize` apart share a slot, so writers take it with a CAS on `id`.
+struct Slot {
+    std::atomic<uint64_t> id{0};
+    std::atomic<size_t> size{0};
+    std::atomic<size_t> depth{0};
+    std::atomic<void*> frames[kMaxSampleFrames] = {};
+};
+
+Slot ring[kRingSize];
+std::atomic<uint64_t> next_id{1};
+
+std::atomic<size_t> every_n_allocs{0};
+std::atomic<size_t> every_n_bytes{0};
+
+// Bumped by `StartSampling` so that threads pick up the new triggers.
+std::atomic<uint64_t> generation{0};
+
+struct ThreadState {
+    uint64_t generation = 0;
+    size_t allocs_left = 0;
+    ptrdiff_t bytes_left = 0;
+
+    // Set while the sampler itself may allocate (the first `backtrace` call, reports).
+    bool in_sampler = false;
+};
+
+thread_local ThreadState thread_state;
+
+class SamplerScope {
+public:
+    SamplerScope() : previous_(std::exchange(thread_state.in_sampler, true)) {
+    }
+
+    SamplerScope(const SamplerScope&) = delete;
+    SamplerScope& operator=(const SamplerScope&) = delete;
+
+    ~SamplerScope() {
+        thread_state.in_sampler = previous_;
+    }
+
+private:
+    bool previous_;
+};
+
+bool ShouldSample(ThreadState& state, size_t size) {
+    uint64_t current = generation.load(std::memory_order_acquire);
+    if (state.generation != current) {
+        state.generation = current;
+        state.allocs_left = every_n_allocs.load(std::memory_order_relaxed);
+        state.bytes_left = every_n_bytes.load(std::memory_order_relaxed);
+    }
+
+    bool sample = false;
+    if (state.allocs_left != 0 && --state.allocs_left == 0) {
+        state.allocs_left = every_n_allocs.load(std::memory_order_relaxed);
+        sample = true;
+    }
+    if (auto period = static_cast<ptrdiff_t>(every_n_bytes.load(std::memory_order_relaxed))) {
+        state.bytes_left -= static_cast<ptrdiff_t>(size);
+        if (state.bytes_left <= 0) {
+            state.bytes_left = period - (-state.bytes_left) % period;
+            sample = true;
+        }
+    }
+    return sample;
+}
+
+bool ReadSlot(const Slot& slot, uint64_t id, alloc_checker::Sample* sample) {
+    if (slot.id.load(std::memory_order_acquire) != id) {
+        return false;
+    }
+    sample->size = slot.size.load(std::memory_order_relaxed);
+    sample->depth = std::min(slot.depth.load(std::memory_order_relaxed), kMaxSampleFrames);
+    for (size_t i = 0; i < kMaxSampleFrames; ++i) {
+        sample->frames[i] = slot.frames[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.id.load(std::memory_order_relaxed) == id;
+}
+
+}  // namespace
+
+namespace alloc_checker::detail {
+
+uint64_t SampleAllocation(size_t size, const void* caller) {
+    ThreadState& state = thread_state;
+    if (state.in_sampler || !ShouldSample(state, size)) {
+        return 0;
+    }
+
+    void* stack[kMaxSampleFrames + kExtraFrames];
+    int captured;
+    {
+        SamplerScope scope;
+        captured = backtrace(stack, std::size(stack));
+    }
+
+    // Frame 0 is this function. If the caller of `operator new` is known, start right at it.
+    int first = std::min(captured, 1);
+    for (int i = 0; caller != nullptr && i < captured; ++i) {
+        if (stack[i] == caller) {
+            first = i;
+            break;
+        }
+    }
+    size_t depth = std::min<size_t>(captured - first, kMaxSampleFrames);
+
+    uint64_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = ring[id % kRingSize];
+    // The sample is dropped rather than waited for when another writer holds the slot or a newer
+    // sample is already there.
+    uint64_t previous = slot.id.load(std::memory_order_relaxed);
+    do {
+        if (previous == kWriting || previous > id) {
+            return 0;
+        }
+    } while (!slot.id.compare_exchange_weak(previous, kWriting, std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.size.store(size, std::memory_order_relaxed);
+    slot.depth.store(depth, std::memory_order_relaxed);
+    for (size_t i = 0; i < kMaxSampleFrames; ++i) {
+        slot.frames[i].store(i < depth ? stack[first + i] : nullptr, std::memory_order_relaxed);
+    }
+    slot.id.store(id, std::memory_order_release);
+    return id;
+}
+
+}  // namespace alloc_checker::detail
+
+namespace alloc_checker {
+
+void StartSampling(const SamplingOptions& options) {
+    {
+        // The first `backtrace` call loads the unwinder, which allocates.
+        SamplerScope scope;
+        void* frame;
+        backtrace(&frame, 1);
+    }
+    every_n_allocs.store(options.every_n_allocs, std::memory_order_relaxed);
+    every_n_bytes.store(options.every_n_bytes, std::memory_order_relaxed);
+    generation.fetch_add(1, std::memory_order_release);
+    detail::sampling_enabled.store(options.every_n_allocs != 0 || options.every_n_bytes != 0,
+                                   std::memory_order_relaxed);
+}
+
+void StopSampling() {
+    detail::sampling_enabled.store(false, std::memory_order_relaxed);
+}
+
+void ClearSamples() {
+    for (auto& slot : ring) {
+        // A slot being written is left to its writer.
+        uint64_t id = slot.id.load(std::memory_order_relaxed);
+        while (id != kWriting && !slot.id.compare_exchange_weak(id, 0, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+bool GetSample(uint64_t id, Sample* sample) {
+    if (id == 0 || id == kWriting) {
+        return false;
+    }
+    return ReadSlot(ring[id % kRingSize], id, sample);
+}
+
+std::vector<AllocationSite> TopAllocationSites(size_t limit) {
+    SamplerScope scope;
+
+    std::map<std::pair<size_t, std::array<void*, kMaxSampleFrames>>, AllocationSite> sites;
+    for (const auto& slot : ring) {
+        uint64_t id = slot.id.load(std::memory_order_relaxed);
+        Sample sample;
+        if (id == 0 || id == kWriting || !ReadSlot(slot, id, &sample)) {
+            continue;
+        }
+        auto& site = sites[{sample.depth, sample.frames}];
+        site.depth = sample.depth;
+        site.frames = sample.frames;
+        ++site.samples;
+        site.bytes += sample.size;
+    }
+
+    std::vector<AllocationSite> result;
+    result.reserve(sites.size());
+    for (auto& [key, site] : sites) {
+        result.push_back(site);
+    }
+    std::sort(result.begin(), result.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.samples != rhs.samples ? lhs.samples > rhs.samples : lhs.bytes > rhs.bytes;
+    });
+    if (result.size() > limit) {
+        result.resize(limit);
+    }
+    return result;
+}
+
+void PrintStack(std::ostream& out, const void* const* frames, size_t depth) {
+    SamplerScope scope;
+
+    for (size_t i = 0; i < depth; ++i) {
+        out << "    #" << i << ' ' << frames[i];
+        Dl_info info;
+        if (dladdr(frames[i], &info) == 0) {
+            out << '\n';
+            continue;
+        }
+        if (info.dli_sname != nullptr) {
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            out << " in " << (status == 0 ? demangled : info.dli_sname);
+            free(demangled);
+        }
+        if (info.dli_fname != nullptr) {
+            // Module offsets can be fed to `addr2line -e <module>`.
+            auto offset = static_cast<const char*>(frames[i]) - static_cast<char*>(info.dli_fbase);
+            out << " (" << info.dli_fname << "+0x" << std::hex << offset << std::dec << ')';
+        }
+        out << '\n';
+    }
+}
+
+void DumpTopAllocationSites(std::ostream& out, size_t limit) {
+    auto sites = TopAllocationSites(limit);
+
+    SamplerScope scope;
+    out << "Top allocation sites:\n";
+    for (size_t i = 0; i < sites.size(); ++i) {
+        out << '#' << i + 1 << ": " << sites[i].samples << " samples, " << sites[i].bytes
+            << " bytes\n";
+        PrintStack(out, sites[i].frames.data(), sites[i].depth);
+    }
+}
+
+}  // namespace alloc_checker
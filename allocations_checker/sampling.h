@@ -0,0 +1,16 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace alloc_checker::detail {
+
+extern std::atomic<bool> sampling_enabled;
+
+// Called for every allocation while sampling is enabled. `caller` is the return address of
+// `operator new` if known, frames above it are dropped from the stack.
+// Returns the id of the taken sample or 0 if the allocation was not sampled.
+std::uint64_t SampleAllocation(std::size_t size, const void* caller);
+
+}  // namespace alloc_checker::detail
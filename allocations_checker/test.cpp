@@ -0,0 +1,298 @@
+#include "allocations_checker.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Stores to it keep the compiler from eliding a `new`/`delete` pair: the checker is meant for
+// optimized builds, where unused blocks are otherwise never allocated.
+thread_local void* volatile sink = nullptr;
+
+template <typename T>
+T* Keep(T* ptr) {
+    sink = ptr;
+    return ptr;
+}
+
+}  // namespace
+
+TEST_CASE("Counts and bytes") {
+    auto before = alloc_checker::Snapshot();
+    auto* p = Keep(new char[100]);
+    auto* q = Keep(new int(42));
+    delete[] p;
+    auto diff = alloc_checker::Diff(before, alloc_checker::Snapshot());
+
+    REQUIRE(diff.allocs == 2);
+    REQUIRE(diff.deallocs == 1);
+    REQUIRE(diff.alloc_bytes == 100 + sizeof(int));
+    REQUIRE(diff.dealloc_bytes == 100);
+    REQUIRE(diff.live_bytes == static_cast<std::ptrdiff_t>(sizeof(int)));
+    REQUIRE(diff.size_classes[alloc_checker::SizeClass(100)] == 1);
+    REQUIRE(diff.size_classes[alloc_checker::SizeClass(sizeof(int))] == 1);
+
+    delete q;
+}
+
+TEST_CASE("Size classes") {
+    REQUIRE(alloc_checker::SizeClass(0) == 0);
+    REQUIRE(alloc_checker::SizeClass(1) == 0);
+    REQUIRE(alloc_checker::SizeClass(2) == 1);
+    REQUIRE(alloc_checker::SizeClass(3) == 2);
+    REQUIRE(alloc_checker::SizeClass(4) == 2);
+    REQUIRE(alloc_checker::SizeClass(5) == 3);
+    REQUIRE(alloc_checker::SizeClass(size_t{1} << 40) == alloc_checker::kSizeClasses - 1);
+}
+
+TEST_CASE("High-water mark") {
+    EXPECT_MAX_BYTES(
+        {
+            std::vector<char*> blocks;
+            blocks.reserve(4);
+            for (int i = 0; i < 4; ++i) {
+                blocks.push_back(new char[256]);
+            }
+            for (auto* block : blocks) {
+                delete[] block;
+            }
+            blocks.push_back(new char[512]);
+            delete[] blocks.back();
+        },
+        4 * 256 + 4 * sizeof(char*));
+
+    alloc_checker::ResetPeak();
+    auto before = alloc_checker::Snapshot();
+    { std::vector<int> v(1000); }
+    auto diff = alloc_checker::Diff(before, alloc_checker::Snapshot());
+    REQUIRE(diff.peak_live_bytes == static_cast<std::ptrdiff_t>(1000 * sizeof(int)));
+    REQUIRE(diff.live_bytes == 0);
+
+    EXPECT_NO_LEAKED_BYTES(std::vector<int>(10));
+}
+
+TEST_CASE("Counters are merged across threads") {
+    constexpr int kThreads = 8;
+    constexpr int kIterations = 1000;
+
+    auto before = alloc_checker::Snapshot();
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(kThreads);
+        for (int i = 0; i < kThreads; ++i) {
+            threads.emplace_back([] {
+                for (int j = 0; j < kIterations; ++j) {
+                    delete Keep(new long(j));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+    auto diff = alloc_checker::Diff(before, alloc_checker::Snapshot());
+
+    REQUIRE(diff.allocs >= kThreads * kIterations);
+    REQUIRE(diff.deallocs >= kThreads * kIterations);
+    REQUIRE(diff.size_classes[alloc_checker::SizeClass(sizeof(long))] >= kThreads * kIterations);
+    REQUIRE(diff.live_bytes == 0);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+void* sampled_caller = nullptr;
+
+// Not a tail call, so that the frame calling `operator new[]` is this function.
+[[gnu::noinline]] char* AllocateSampled(std::size_t size) {
+    sampled_caller = __builtin_return_address(0);
+    return Keep(new char[size]);
+}
+
+// A call site of its own and a size of its own for every thread.
+template <int Thread>
+[[gnu::noinline]] char* AllocateFromThread() {
+    return Keep(new char[10 + Thread]);
+}
+
+// Where exactly the caller lands in the stack depends on inlining and on the unwinder.
+bool HasFrame(const std::array<void*, alloc_checker::kMaxSampleFrames>& frames, std::size_t depth,
+              const void* frame) {
+    return std::find(frames.begin(), frames.begin() + depth, frame) != frames.begin() + depth;
+}
+
+}  // namespace
+
+TEST_CASE("Sampling") {
+    alloc_checker::ClearSamples();
+
+    SECTION("Every allocation") {
+        alloc_checker::StartSampling({.every_n_allocs = 1});
+        for (int i = 0; i < 10; ++i) {
+            delete[] AllocateSampled(77);
+        }
+        alloc_checker::StopSampling();
+
+        auto sites = alloc_checker::TopAllocationSites(1);
+        REQUIRE(sites.size() == 1);
+        REQUIRE(sites[0].samples == 10);
+        REQUIRE(sites[0].bytes == 770);
+        REQUIRE(HasFrame(sites[0].frames, sites[0].depth, sampled_caller));
+    }
+
+    SECTION("Every Nth allocation") {
+        alloc_checker::StartSampling({.every_n_allocs = 100});
+        for (int i = 0; i < 1000; ++i) {
+            delete[] AllocateSampled(8);
+        }
+        alloc_checker::StopSampling();
+
+        auto sites = alloc_checker::TopAllocationSites(1);
+        REQUIRE(sites.size() == 1);
+        REQUIRE(sites[0].samples == 10);
+    }
+
+    SECTION("Every K bytes") {
+        alloc_checker::StartSampling({.every_n_bytes = 1000});
+        for (int i = 0; i < 100; ++i) {
+            delete[] AllocateSampled(100);
+        }
+        alloc_checker::StopSampling();
+
+        auto sites = alloc_checker::TopAllocationSites(1);
+        REQUIRE(sites.size() == 1);
+        REQUIRE(sites[0].samples == 10);
+    }
+
+    SECTION("Threads wrapping the ring") {
+        constexpr int kAllocations = 3000;
+        auto run = [](auto allocate) {
+            for (int i = 0; i < kAllocations; ++i) {
+                delete[] allocate();
+            }
+        };
+        alloc_checker::StartSampling({.every_n_allocs = 1});
+        {
+            std::vector<std::thread> threads;
+            threads.emplace_back(run, AllocateFromThread<0>);
+            threads.emplace_back(run, AllocateFromThread<1>);
+            threads.emplace_back(run, AllocateFromThread<2>);
+            threads.emplace_back(run, AllocateFromThread<3>);
+            for (auto& thread : threads) {
+                thread.join();
+            }
+        }
+        alloc_checker::StopSampling();
+
+        // A sample torn between two writers would mix a stack and a size of different threads.
+        auto sites = alloc_checker::TopAllocationSites(100);
+        REQUIRE(sites.size() >= 4);
+        int mixed = 0;
+        for (const auto& site : sites) {
+            mixed += site.bytes % site.samples != 0;
+        }
+        REQUIRE(mixed == 0);
+    }
+
+    SECTION("Disabled") {
+        delete[] AllocateSampled(8);
+        REQUIRE(alloc_checker::TopAllocationSites(10).empty());
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+bool IsLive(const void* ptr) {
+    for (const auto& allocation : alloc_checker::LiveAllocations()) {
+        if (allocation.ptr == ptr) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+TEST_CASE("Leak tracking") {
+    auto* before = new int(1);
+    alloc_checker::StartLeakTracking();
+
+    SECTION("Live blocks") {
+        auto* p = new char[123];
+        REQUIRE(IsLive(p));
+        REQUIRE(!IsLive(before));
+
+        auto leaks = alloc_checker::LiveAllocations();
+        for (const auto& leak : leaks) {
+            if (leak.ptr == p) {
+                REQUIRE(leak.size == 123);
+            }
+        }
+
+        delete[] p;
+        REQUIRE(!IsLive(p));
+    }
+
+    SECTION("Blocks from before tracking are freed normally") {
+        auto invalid = alloc_checker::InvalidFreeCount();
+        delete before;
+        before = nullptr;
+        REQUIRE(alloc_checker::InvalidFreeCount() == invalid);
+    }
+
+    SECTION("Sampled sites are attached") {
+        alloc_checker::StartSampling({.every_n_allocs = 1});
+        auto* p = AllocateSampled(10);
+        alloc_checker::StopSampling();
+
+        bool found = false;
+        for (const auto& leak : alloc_checker::LiveAllocations()) {
+            alloc_checker::Sample sample;
+            if (leak.ptr == p && alloc_checker::GetSample(leak.sample_id, &sample)) {
+                found = true;
+                REQUIRE(sample.size == 10);
+                REQUIRE(HasFrame(sample.frames, sample.depth, sampled_caller));
+            }
+        }
+        REQUIRE(found);
+        delete[] p;
+    }
+
+    SECTION("Invalid free") {
+        alignas(std::max_align_t) char buffer[64] = {};
+        auto invalid = alloc_checker::InvalidFreeCount();
+        operator delete(buffer + 32);
+        REQUIRE(alloc_checker::InvalidFreeCount() == invalid + 1);
+    }
+
+// Both read the header of memory that is not a live block, which sanitizers report themselves.
+#if !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+    SECTION("Invalid free after something that looks like a header") {
+        // A size and a word that is not a live tag for this address.
+        alignas(std::max_align_t) uint64_t buffer[8] = {16, 0x5AFE'B10C'0000'0000ull};
+        auto invalid = alloc_checker::InvalidFreeCount();
+        operator delete(buffer + 2);
+        REQUIRE(alloc_checker::InvalidFreeCount() == invalid + 1);
+    }
+
+    SECTION("Double free") {
+        auto* p = new long(42);
+        auto invalid = alloc_checker::InvalidFreeCount();
+        operator delete(p);
+        operator delete(p);
+        REQUIRE(alloc_checker::InvalidFreeCount() == invalid + 1);
+    }
+#endif
+
+    alloc_checker::StopLeakTracking();
+    delete before;
+}
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "../weak/shared.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#ifdef SMART_PTRS_ARENA_DEBUG
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <typeinfo>
+#endif
+
+// Bump-pointer allocator for request-scoped data: allocating is a pointer increment, nothing is
+// freed until `Reset`, which drops everything at once. Allocating is not thread-safe.
+//
+// With `-DSMART_PTRS_ARENA_DEBUG` the arena also checks that no handle created by
+// `MakeArenaShared` outlives it: `Reset` and the destructor report the blocks still referenced
+// and abort.
+class Arena {
+public:
+    static constexpr size_t kFirstChunk = 4096;
+    static constexpr size_t kMaxChunk = size_t{1} << 20;
+
+    Arena() = default;
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        Reset();
+        FreeChunks(nullptr);
+    }
+
+    void* Allocate(size_t size, size_t alignment) {
+        auto begin = (reinterpret_cast<uintptr_t>(next_) + alignment - 1) & ~(alignment - 1);
+        if (next_ == nullptr || begin + size > reinterpret_cast<uintptr_t>(end_)) {
+            AddChunk(size + alignment);
+            begin = (reinterpret_cast<uintptr_t>(next_) + alignment - 1) & ~(alignment - 1);
+        }
+        next_ = reinterpret_cast<char*>(begin + size);
+        return reinterpret_cast<void*>(begin);
+    }
+
+    // Frees everything allocated so far but the last chunk, which is reused. Objects created
+    // with `MakeArenaShared` must have been released by then.
+    void Reset() {
+#ifdef SMART_PTRS_ARENA_DEBUG
+        CheckEscapes();
+#endif
+        if (chunks_ == nullptr) {
+            return;
+        }
+        FreeChunks(chunks_);
+        next_ = chunks_->Data();
+        allocated_ = 0;
+    }
+
+    // Bytes handed out since the last `Reset`, padding included.
+    size_t BytesAllocated() const {
+        return allocated_ + (chunks_ == nullptr ? 0 : next_ - chunks_->Data());
+    }
+
+#ifdef SMART_PTRS_ARENA_DEBUG
+    // Blocks of the arena still referenced by a `SharedPtr` or a `WeakPtr`.
+    size_t Escaped() const {
+        size_t escaped = 0;
+        for (const Tracked* tracked = tracked_; tracked != nullptr; tracked = tracked->next) {
+            escaped += !tracked->released.load(std::memory_order_acquire);
+        }
+        return escaped;
+    }
+
+    // Set by the block when its last reference goes away.
+    struct Tracked {
+        const std::type_info* type;
+        std::atomic<bool> released = false;
+        Tracked* next = nullptr;
+    };
+
+    Tracked* Track(const std::type_info& type) {
+        auto* tracked = new (Allocate(sizeof(Tracked), alignof(Tracked))) Tracked{&type};
+        tracked->next = tracked_;
+        tracked_ = tracked;
+        return tracked;
+    }
+#endif
+
+private:
+    struct Chunk {
+        Chunk* next;
+        size_t size;
+
+        char* Data() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+    };
+
+    void AddChunk(size_t min_size) {
+        if (chunks_ != nullptr) {
+            allocated_ += next_ - chunks_->Data();
+        }
+        chunk_size_ = std::min(chunk_size_ * 2, kMaxChunk);
+        size_t size = std::max(chunk_size_, min_size);
+        auto* chunk = static_cast<Chunk*>(::operator new(sizeof(Chunk) + size));
+        chunk->next = chunks_;
+        chunk->size = size;
+        chunks_ = chunk;
+        next_ = chunk->Data();
+        end_ = next_ + size;
+    }
+
+    // Frees the chunks after `keep`, or all of them.
+    void FreeChunks(Chunk* keep) {
+        Chunk* chunk = keep == nullptr ? chunks_ : keep->next;
+        while (chunk != nullptr) {
+            ::operator delete(std::exchange(chunk, chunk->next));
+        }
+        if (keep != nullptr) {
+            keep->next = nullptr;
+        } else {
+            chunks_ = nullptr;
+        }
+    }
+
+#ifdef SMART_PTRS_ARENA_DEBUG
+    void CheckEscapes() {
+        if (size_t escaped = Escaped()) {
+            std::fprintf(stderr, "Arena: %zu block(s) outlive the arena:\n", escaped);
+            for (const Tracked* tracked = tracked_; tracked != nullptr; tracked = tracked->next) {
+                if (!tracked->released.load(std::memory_order_acquire)) {
+                    std::fprintf(stderr, "    %s\n", tracked->type->name());
+                }
+            }
+            std::abort();
+        }
+        tracked_ = nullptr;
+    }
+
+    Tracked* tracked_ = nullptr;
+#endif
+
+    // Newest first.
+    Chunk* chunks_ = nullptr;
+    char* next_ = nullptr;
+    char* end_ = nullptr;
+    size_t chunk_size_ = kFirstChunk / 2;
+
+    // In chunks before the current one.
+    size_t allocated_ = 0;
+};
+
+// Counts like any other block, so the object is destroyed with its last strong reference, but
+// its memory and the block's stay in the arena until `Reset`. For trivially destructible types
+// that leaves only the lifetime hook, if enabled.
+template <typename T>
+class ArenaControlBlock : public ControlBlockObject<T> {
+public:
+    template <typename... Args>
+    explicit ArenaControlBlock([[maybe_unused]] Arena* arena, Args&&... args)
+        : ControlBlockObject<T>(std::forward<Args>(args)...) {
+#ifdef SMART_PTRS_ARENA_DEBUG
+        tracked_ = arena->Track(typeid(T));
+#endif
+    }
+
+#ifdef SMART_PTRS_ARENA_DEBUG
+    ~ArenaControlBlock() override {
+        tracked_->released.store(true, std::memory_order_release);
+    }
+#endif
+
+    // The block is destroyed by `delete this` when its last reference goes away; the memory
+    // belongs to the arena.
+    static void operator delete(void*) {
+    }
+
+private:
+#ifdef SMART_PTRS_ARENA_DEBUG
+    Arena::Tracked* tracked_;
+#endif
+};
+
+// Like `MakeShared<T>(args...)`, but the object and its block are allocated in `arena`.
+// Handles must not outlive the arena or its next `Reset`.
+template <typename T, typename... Args>
+SharedPtr<T> MakeArenaShared(Arena& arena, Args&&... args) {
+    void* memory = arena.Allocate(sizeof(ArenaControlBlock<T>), alignof(ArenaControlBlock<T>));
+    auto* block = new (memory) ArenaControlBlock<T>(&arena, std::forward<Args>(args)...);
+    return AdoptShared(block->GetObject(), block);
+}
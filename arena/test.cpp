@@ -0,0 +1,124 @@
+#include "arena.h"
+
+#include "../weak/weak.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Tracked {
+    static int alive;
+
+    explicit Tracked(std::string name) : name(std::move(name)) {
+        ++alive;
+    }
+
+    ~Tracked() {
+        --alive;
+    }
+
+    std::string name;
+    SharedPtr<Tracked> next;
+};
+
+int Tracked::alive = 0;
+
+struct Point {
+    int x = 0;
+    int y = 0;
+};
+
+}  // namespace
+
+TEST_CASE("Allocation") {
+    Arena arena;
+    REQUIRE(arena.BytesAllocated() == 0);
+    auto* a = static_cast<char*>(arena.Allocate(1, 1));
+    auto* b = arena.Allocate(8, 8);
+    REQUIRE(reinterpret_cast<uintptr_t>(b) % 8 == 0);
+    REQUIRE(static_cast<char*>(b) - a <= 8);
+
+    // Larger than a chunk.
+    auto* big = static_cast<char*>(arena.Allocate(Arena::kMaxChunk * 2, 64));
+    REQUIRE(reinterpret_cast<uintptr_t>(big) % 64 == 0);
+    big[Arena::kMaxChunk * 2 - 1] = 1;
+    REQUIRE(arena.BytesAllocated() >= Arena::kMaxChunk * 2 + 9);
+
+    arena.Reset();
+    REQUIRE(arena.BytesAllocated() == 0);
+    REQUIRE(arena.Allocate(16, 16) != nullptr);
+}
+
+TEST_CASE("Objects die with their last reference") {
+    Arena arena;
+    {
+        auto first = MakeArenaShared<Tracked>(arena, "first");
+        first->next = MakeArenaShared<Tracked>(arena, "second");
+        auto copy = first->next;
+        REQUIRE(Tracked::alive == 2);
+        REQUIRE(copy.UseCount() == 2);
+
+        WeakPtr<Tracked> weak(first);
+        first.Reset();
+        REQUIRE(Tracked::alive == 1);
+        REQUIRE(weak.Expired());
+        REQUIRE(copy->name == "second");
+#ifdef SMART_PTRS_ARENA_DEBUG
+        REQUIRE(arena.Escaped() == 2);
+#endif
+    }
+    REQUIRE(Tracked::alive == 0);
+#ifdef SMART_PTRS_ARENA_DEBUG
+    REQUIRE(arena.Escaped() == 0);
+#endif
+    size_t used = arena.BytesAllocated();
+    REQUIRE(used >= 2 * sizeof(ArenaControlBlock<Tracked>));
+
+    arena.Reset();
+    for (int i = 0; i < 10000; ++i) {
+        MakeArenaShared<Point>(arena, i, i);
+    }
+    REQUIRE(arena.BytesAllocated() >= 10000 * sizeof(ArenaControlBlock<Point>));
+}
+
+TEST_CASE("Handles shared between threads") {
+    constexpr int kThreads = 4;
+
+    Arena arena;
+    auto shared = MakeArenaShared<Tracked>(arena, "shared");
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([copy = shared] {
+            for (int i = 0; i < 1000; ++i) {
+                auto local = copy;
+            }
+        });
+    }
+    shared.Reset();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(Tracked::alive == 0);
+}
+
+#ifdef SMART_PTRS_ARENA_DEBUG
+TEST_CASE("Escaped handles") {
+    Arena arena;
+    auto point = MakeArenaShared<Point>(arena);
+    WeakPtr<Point> weak(point);
+    REQUIRE(arena.Escaped() == 1);
+    point.Reset();
+    // The weak reference still points into the arena.
+    REQUIRE(arena.Escaped() == 1);
+    weak.Reset();
+    REQUIRE(arena.Escaped() == 0);
+}
+#endif
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Minimal benchmark harness: calibrates iteration counts, prints a table, writes JSON and
+// compares against a stored baseline.
+//
+// Flags:
+//   --filter <substring>   run only benchmarks whose name contains the substring
+//   --min-time <ms>        minimal duration of a measured run (default 100)
+//   --json <path>          write results as JSON
+//   --baseline <path>      compare with results written earlier by --json
+//   --threshold <fraction> allowed slowdown against the baseline (default 0.1)
+//
+// Benchmarks may attach counters to their results, such as cache misses per operation; they are
+// written to JSON and compared with the baseline like the time, higher being worse.
+namespace bench {
+
+template <typename T>
+inline void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template <typename T>
+inline void DoNotOptimize(T& value) {
+    asm volatile("" : "+r,m"(value) : : "memory");
+}
+
+inline void ClobberMemory() {
+    asm volatile("" : : : "memory");
+}
+
+struct Result {
+    std::string name;
+    double ns_per_op = 0;
+    std::size_t iterations = 0;
+    std::map<std::string, double> counters;
+};
+
+inline std::string ToJson(const std::vector<Result>& results) {
+    std::ostringstream out;
+    out << "{\n  \"benchmarks\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        out << "    {\"name\": \"" << results[i].name << "\", \"ns_per_op\": "
+            << results[i].ns_per_op << ", \"iterations\": " << results[i].iterations;
+        for (const auto& [counter, value] : results[i].counters) {
+            out << ", \"" << counter << "\": " << value;
+        }
+        out << "}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+// Understands the output of `ToJson` only. Maps names of benchmarks to their `ns_per_op` and
+// counters.
+inline std::map<std::string, std::map<std::string, double>> ParseJson(const std::string& json) {
+    std::map<std::string, std::map<std::string, double>> result;
+    const std::string name_key = "\"name\": \"";
+    for (auto pos = json.find(name_key); pos != std::string::npos;
+         pos = json.find(name_key, pos)) {
+        pos += name_key.size();
+        auto name_end = json.find('"', pos);
+        auto record_end = json.find('}', pos);
+        if (name_end == std::string::npos || record_end == std::string::npos) {
+            break;
+        }
+        auto& values = result[json.substr(pos, name_end - pos)];
+        // `, "key": value` pairs up to the end of the record.
+        for (auto key = json.find('"', name_end + 1); key < record_end;
+             key = json.find('"', key)) {
+            auto key_end = json.find('"', key + 1);
+            std::string name = json.substr(key + 1, key_end - key - 1);
+            if (name != "iterations") {
+                values[name] = std::strtod(json.c_str() + key_end + 3, nullptr);
+            }
+            key = key_end + 1;
+        }
+        pos = record_end;
+    }
+    return result;
+}
+
+class Runner {
+public:
+    Runner(int argc, char** argv) {
+        for (int i = 1; i + 1 < argc; i += 2) {
+            std::string flag = argv[i];
+            std::string value = argv[i + 1];
+            if (flag == "--filter") {
+                filter_ = value;
+            } else if (flag == "--min-time") {
+                min_time_ = std::chrono::milliseconds(std::stol(value));
+            } else if (flag == "--json") {
+                json_path_ = value;
+            } else if (flag == "--baseline") {
+                baseline_path_ = value;
+            } else if (flag == "--threshold") {
+                threshold_ = std::stod(value);
+            } else {
+                std::cerr << "Unknown flag " << flag << '\n';
+                std::exit(2);
+            }
+        }
+    }
+
+    // `body(n)` performs `n` operations, all of them are timed.
+    void Run(const std::string& name, const std::function<void(std::size_t)>& body) {
+        Run(name, [](std::size_t) {}, body);
+    }
+
+    // `setup(n)` prepares state for `body(n)` and is not timed.
+    void Run(const std::string& name, const std::function<void(std::size_t)>& setup,
+             const std::function<void(std::size_t)>& body) {
+        RunTimed(name, [&setup, &body](std::size_t n) { return Measure(setup, body, n); });
+    }
+
+    // `body(n)` performs `n` operations and returns the nanoseconds they took, for bodies that
+    // have to keep their own setup and teardown out of the time.
+    void RunTimed(const std::string& name, const std::function<double(std::size_t)>& body) {
+        if (name.find(filter_) == std::string::npos) {
+            return;
+        }
+
+        std::size_t iterations = 1;
+        double elapsed = body(iterations);
+        while (elapsed < min_time_.count() && iterations < (std::size_t{1} << 40)) {
+            double target = min_time_.count() * 1.2;
+            double scale = elapsed > 0 ? target / elapsed : 100;
+            iterations = static_cast<std::size_t>(
+                iterations * std::clamp(scale, 2.0, 100.0));
+            elapsed = body(iterations);
+        }
+
+        double best = elapsed;
+        for (int repeat = 0; repeat < 2; ++repeat) {
+            best = std::min(best, body(iterations));
+        }
+
+        Result result{name, best / iterations, iterations, {}};
+        std::printf("%-60s %12.2f ns/op %14zu iterations\n", result.name.c_str(),
+                    result.ns_per_op, result.iterations);
+        std::fflush(stdout);
+        results_.push_back(result);
+    }
+
+    // Attaches `value` to the result of `benchmark`, if it ran.
+    void AddCounter(const std::string& benchmark, const std::string& counter, double value) {
+        for (auto& result : results_) {
+            if (result.name == benchmark) {
+                result.counters[counter] = value;
+                std::printf("%-60s %12.2f %s\n", benchmark.c_str(), value, counter.c_str());
+                std::fflush(stdout);
+            }
+        }
+    }
+
+    const std::vector<Result>& Results() const {
+        return results_;
+    }
+
+    // Writes the JSON report and compares with the baseline.
+    // Returns the process exit code: non-zero if some benchmark regressed.
+    int Finish() const {
+        if (!json_path_.empty()) {
+            std::ofstream(json_path_) << ToJson(results_);
+        }
+        if (baseline_path_.empty()) {
+            return 0;
+        }
+
+        std::ifstream in(baseline_path_);
+        if (!in) {
+            std::cerr << "Cannot read baseline " << baseline_path_ << '\n';
+            return 2;
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        auto baseline = ParseJson(buffer.str());
+
+        int regressions = 0;
+        for (const auto& result : results_) {
+            auto it = baseline.find(result.name);
+            if (it == baseline.end()) {
+                continue;
+            }
+            std::map<std::string, double> values = result.counters;
+            values["ns_per_op"] = result.ns_per_op;
+            for (const auto& [metric, value] : values) {
+                auto old = it->second.find(metric);
+                if (old == it->second.end() || old->second <= 0) {
+                    continue;
+                }
+                double ratio = value / old->second;
+                if (ratio > 1 + threshold_) {
+                    std::printf("REGRESSION %-49s %12.2f %s, baseline %.2f (%+.1f%%)\n",
+                                result.name.c_str(), value, metric.c_str(), old->second,
+                                (ratio - 1) * 100);
+                    ++regressions;
+                }
+            }
+        }
+        std::printf("%d regression(s) over %.0f%% threshold\n", regressions, threshold_ * 100);
+        return regressions == 0 ? 0 : 1;
+    }
+
+private:
+    // Returns nanoseconds spent in `body`.
+    static double Measure(const std::function<void(std::size_t)>& setup,
+                          const std::function<void(std::size_t)>& body, std::size_t iterations) {
+        setup(iterations);
+        auto start = std::chrono::steady_clock::now();
+        body(iterations);
+        auto finish = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(finish - start).count();
+    }
+
+    std::string filter_;
+    std::chrono::duration<double, std::nano> min_time_ = std::chrono::milliseconds(100);
+    std::string json_path_;
+    std::string baseline_path_;
+    double threshold_ = 0.1;
+    std::vector<Result> results_;
+};
+
+}  // namespace bench
@@ -0,0 +1,69 @@
+#include "bench.h"
+
+#include "../arena/arena.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// A request building a batch of objects and dropping it: `MakeArenaShared` plus `Arena::Reset`
+// against `MakeShared` and `std::make_shared`, for a trivially destructible and a
+// non-trivially destructible type. Time is per object.
+namespace {
+
+constexpr size_t kBatch = 1000;
+
+struct Point {
+    double x = 0;
+    double y = 0;
+};
+
+struct Named {
+    std::string name = "request";
+    int value = 0;
+};
+
+template <typename Make>
+auto BatchLoop(Make make) {
+    return [make](size_t n) {
+        std::vector<decltype(make())> batch;
+        batch.reserve(kBatch);
+        for (size_t i = 0; i < n; ++i) {
+            batch.push_back(make());
+            if (batch.size() == kBatch) {
+                batch.clear();
+            }
+        }
+    };
+}
+
+template <typename T>
+void BenchType(bench::Runner& runner, const std::string& type) {
+    runner.Run("arena/" + type + "/MakeShared", BatchLoop([] { return MakeShared<T>(); }));
+    runner.Run("arena/" + type + "/std::make_shared",
+               BatchLoop([] { return std::make_shared<T>(); }));
+
+    Arena arena;
+    runner.Run("arena/" + type + "/MakeArenaShared", [&arena](size_t n) {
+        std::vector<SharedPtr<T>> batch;
+        batch.reserve(kBatch);
+        for (size_t i = 0; i < n; ++i) {
+            batch.push_back(MakeArenaShared<T>(arena));
+            if (batch.size() == kBatch) {
+                batch.clear();
+                arena.Reset();
+            }
+        }
+        batch.clear();
+        arena.Reset();
+    });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::Runner runner(argc, argv);
+    BenchType<Point>(runner, "Point");
+    BenchType<Named>(runner, "Named");
+    return runner.Finish();
+}
@@ -0,0 +1,135 @@
+#include "bench.h"
+#include "bench_threads.h"
+
+#include "../intrusive/intrusive.h"
+#include "../weak/shared.h"
+#include "../weak/weak.h"
+
+#include <memory>
+#include <vector>
+
+// Reference count traffic under contention: every thread copies and drops handles in a loop,
+// either to one object shared by all threads or to an object of its own.
+namespace {
+
+struct Node : AtomicRefCounted<Node> {
+    int value = 0;
+};
+
+// Copy plus destruction of a handle to `source`.
+template <typename Ptr>
+auto CopyLoop(const Ptr& source) {
+    return [&source](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            Ptr copy(source);
+            bench::DoNotOptimize(copy);
+        }
+    };
+}
+
+template <typename Weak>
+auto LockLoop(const Weak& source) {
+    return [&source](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            auto locked = source.Lock();
+            bench::DoNotOptimize(locked);
+        }
+    };
+}
+
+template <typename Weak>
+auto StdLockLoop(const Weak& source) {
+    return [&source](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            auto locked = source.lock();
+            bench::DoNotOptimize(locked);
+        }
+    };
+}
+
+// Both variants of one benchmark: all threads on one object, each thread on its own object.
+// `make_handles(count)` returns handles to `count` objects, `loop(handle)` the worker using one.
+template <typename MakeHandles, typename Loop>
+void BenchSharedAndLocal(bench::Runner& runner, const std::string& name,
+                         const std::vector<size_t>& thread_counts, MakeHandles make_handles,
+                         Loop loop) {
+    for (size_t threads : thread_counts) {
+        auto handles = make_handles(1);
+        bench::BenchThreads(runner, "contention/shared/" + name, threads,
+                            [&](size_t) { return loop(handles[0]); });
+    }
+    for (size_t threads : thread_counts) {
+        auto handles = make_handles(threads);
+        bench::BenchThreads(runner, "contention/local/" + name, threads,
+                            [&](size_t t) { return loop(handles[t]); });
+    }
+}
+
+// `count` handles, each to an object of its own. The objects are allocated back to back, before
+// the threads start.
+template <typename Make>
+auto Handles(size_t count, Make make) {
+    std::vector<decltype(make())> handles;
+    for (size_t t = 0; t < count; ++t) {
+        handles.push_back(make());
+    }
+    return handles;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::Runner runner(argc, argv);
+    auto thread_counts = bench::ThreadCounts();
+
+    BenchSharedAndLocal(
+        runner, "copy/SharedPtr", thread_counts,
+        [](size_t count) { return Handles(count, [] { return MakeShared<int>(0); }); },
+        [](const SharedPtr<int>& handle) { return CopyLoop(handle); });
+
+    // Handles are created on the main thread, so the workers never take the owner fast path.
+    BenchSharedAndLocal(
+        runner, "copy/BiasedSharedPtr", thread_counts,
+        [](size_t count) { return Handles(count, [] { return MakeBiasedShared<int>(0); }); },
+        [](const SharedPtr<int>& handle) { return CopyLoop(handle); });
+
+    // Every thread copies an object it created itself.
+    for (size_t threads : thread_counts) {
+        bench::BenchThreads(runner, "contention/owner/copy/BiasedSharedPtr", threads, [](size_t) {
+            return [handle = MakeBiasedShared<int>(0)](size_t n) { CopyLoop(handle)(n); };
+        });
+    }
+
+    BenchSharedAndLocal(
+        runner, "copy/std::shared_ptr", thread_counts,
+        [](size_t count) { return Handles(count, [] { return std::make_shared<int>(0); }); },
+        [](const std::shared_ptr<int>& handle) { return CopyLoop(handle); });
+
+    // Weak handles keep their strong owners alive for the duration of the benchmark.
+    std::vector<SharedPtr<int>> owners;
+    BenchSharedAndLocal(
+        runner, "lock/WeakPtr", thread_counts,
+        [&](size_t count) {
+            owners = Handles(count, [] { return MakeShared<int>(0); });
+            std::vector<WeakPtr<int>> weak(owners.begin(), owners.end());
+            return weak;
+        },
+        [](const WeakPtr<int>& handle) { return LockLoop(handle); });
+
+    std::vector<std::shared_ptr<int>> std_owners;
+    BenchSharedAndLocal(
+        runner, "lock/std::weak_ptr", thread_counts,
+        [&](size_t count) {
+            std_owners = Handles(count, [] { return std::make_shared<int>(0); });
+            std::vector<std::weak_ptr<int>> weak(std_owners.begin(), std_owners.end());
+            return weak;
+        },
+        [](const std::weak_ptr<int>& handle) { return StdLockLoop(handle); });
+
+    BenchSharedAndLocal(
+        runner, "copy/IntrusivePtr", thread_counts,
+        [](size_t count) { return Handles(count, [] { return MakeIntrusive<Node>(); }); },
+        [](const IntrusivePtr<Node>& handle) { return CopyLoop(handle); });
+
+    return runner.Finish();
+}
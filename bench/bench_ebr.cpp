@@ -0,0 +1,66 @@
+#include "bench.h"
+#include "bench_threads.h"
+
+#include "../ebr/ebr.h"
+
+#include <atomic>
+#include <mutex>
+
+// Read side of a published object: an EBR guard plus a raw load against the reference count
+// traffic of copying the owning `SharedPtr`. The mutex variant is what readers need to copy
+// a handle that a writer may replace concurrently.
+namespace {
+
+struct Config {
+    int version = 0;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::Runner runner(argc, argv);
+
+    EbrDomain domain;
+    SharedPtr<Config> owner = MakeShared<Config>();
+    std::atomic<Config*> published = owner.Get();
+    std::mutex mutex;
+
+    for (size_t threads : bench::ThreadCounts()) {
+        bench::BenchThreads(runner, "ebr/read/Guard", threads, [&](size_t) {
+            return [&](size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    EbrDomain::Guard guard(domain);
+                    bench::DoNotOptimize(published.load(std::memory_order_acquire)->version);
+                }
+            };
+        });
+    }
+
+    for (size_t threads : bench::ThreadCounts()) {
+        bench::BenchThreads(runner, "ebr/read/SharedPtr copy", threads, [&](size_t) {
+            return [&](size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    SharedPtr<Config> copy(owner);
+                    bench::DoNotOptimize(copy->version);
+                }
+            };
+        });
+    }
+
+    for (size_t threads : bench::ThreadCounts()) {
+        bench::BenchThreads(runner, "ebr/read/SharedPtr copy under mutex", threads, [&](size_t) {
+            return [&](size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    SharedPtr<Config> copy;
+                    {
+                        std::lock_guard lock(mutex);
+                        copy = owner;
+                    }
+                    bench::DoNotOptimize(copy->version);
+                }
+            };
+        });
+    }
+
+    return runner.Finish();
+}
@@ -0,0 +1,117 @@
+#include "bench.h"
+#include "bench_memory.h"
+#include "bench_threads.h"
+
+#include "../interner/interner.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Interner on a synthetic corpus: many repeated strings, too long for the small string buffer,
+// drawn from a small vocabulary.
+//
+// Memory is live bytes held by the corpus stored as strings and as handles, the latter including
+// the table.
+namespace {
+
+constexpr size_t kCorpus = 1'000'000;
+constexpr size_t kVocabulary = 10'000;
+
+std::string Word(size_t i) {
+    return "identifier_with_a_long_common_prefix_" + std::to_string(i * 7919 % kVocabulary);
+}
+
+template <typename MakeCorpus>
+void ReportMemory(const char* name, MakeCorpus make_corpus) {
+    size_t before = bench::LiveBytes();
+    auto corpus = make_corpus();
+    std::printf("%-60s %12.2f MiB\n", name,
+                static_cast<double>(bench::LiveBytes() - before) / (1024 * 1024));
+}
+
+void BenchMemory() {
+    ReportMemory("memory/1M words/std::string", [] {
+        std::vector<std::string> corpus;
+        for (size_t i = 0; i < kCorpus; ++i) {
+            corpus.push_back(Word(i));
+        }
+        return corpus;
+    });
+    ReportMemory("memory/1M words/Interner", [] {
+        struct Corpus {
+            Interner<std::string> interner;
+            std::vector<Interner<std::string>::Handle> words;
+        };
+        auto corpus = std::make_unique<Corpus>();
+        for (size_t i = 0; i < kCorpus; ++i) {
+            corpus->words.push_back(corpus->interner.Intern(Word(i)));
+        }
+        return corpus;
+    });
+}
+
+void BenchIntern(bench::Runner& runner) {
+    std::vector<std::string> words;
+    for (size_t i = 0; i < kVocabulary; ++i) {
+        words.push_back(Word(i));
+    }
+
+    // The vocabulary stays interned, so an operation is a lookup plus a reference.
+    Interner<std::string> interner;
+    std::vector<Interner<std::string>::Handle> pinned;
+    for (const auto& word : words) {
+        pinned.push_back(interner.Intern(word));
+    }
+    for (size_t threads : bench::ThreadCounts()) {
+        bench::BenchThreads(runner, "interner/hit", threads, [&](size_t thread) {
+            return [&, thread](size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    auto handle = interner.Intern(words[(i + thread * 997) % kVocabulary]);
+                    bench::DoNotOptimize(handle);
+                }
+            };
+        });
+    }
+
+    // Every value dies with its handle: insertion plus erasure from the `Deleter`.
+    Interner<std::string> empty;
+    for (size_t threads : bench::ThreadCounts()) {
+        bench::BenchThreads(runner, "interner/insert and erase", threads, [&](size_t thread) {
+            return [&, thread](size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    auto handle = empty.Intern(words[(i + thread * 997) % kVocabulary]);
+                    bench::DoNotOptimize(handle);
+                }
+            };
+        });
+    }
+
+    runner.Run("interner/compare/Handle", [&](size_t n) {
+        size_t equal = 0;
+        for (size_t i = 0; i < n; ++i) {
+            equal += pinned[i % kVocabulary] == pinned[(i + 1) % kVocabulary];
+        }
+        bench::DoNotOptimize(equal);
+    });
+
+    runner.Run("interner/compare/std::string", [&](size_t n) {
+        size_t equal = 0;
+        for (size_t i = 0; i < n; ++i) {
+            equal += words[i % kVocabulary] == words[(i + 1) % kVocabulary];
+        }
+        bench::DoNotOptimize(equal);
+    });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::Runner runner(argc, argv);
+
+    BenchMemory();
+    BenchIntern(runner);
+
+    return runner.Finish();
+}
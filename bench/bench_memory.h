@@ -0,0 +1,40 @@
+#pragma once
+
+#include <malloc.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Live heap bytes, counted by replacing the global `operator new` and `operator delete`.
+// The replacements are definitions: include this header in exactly one file of a benchmark.
+namespace bench {
+
+inline std::atomic<size_t> live_bytes = 0;
+
+inline size_t LiveBytes() {
+    return live_bytes.load(std::memory_order_relaxed);
+}
+
+}  // namespace bench
+
+void* operator new(size_t size) {
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    bench::live_bytes.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed);
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (ptr != nullptr) {
+        bench::live_bytes.fetch_sub(malloc_usable_size(ptr), std::memory_order_relaxed);
+        std::free(ptr);
+    }
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    operator delete(ptr);
+}
@@ -0,0 +1,301 @@
+#include "bench.h"
+
+#include "../offset/offset.h"
+#include "../unique/unique.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Startup of a prebuilt index, a balanced search tree of `kNodes` keys in a file in the page
+// cache, loaded three ways:
+//
+//   offset       the file is a region of `OffsetUniquePtr` nodes: map it and use it;
+//   fixup        the file holds raw pointers saved as offsets from its start: map it privately
+//                and add the base to every pointer, which touches every page;
+//   deserialize  the file is a preorder stream of keys: read it and rebuild the tree on the
+//                heap.
+//
+// One operation is one startup, up to the first lookup. Lookups in the loaded trees are timed
+// separately, per lookup.
+namespace {
+
+constexpr int64_t kNodes = int64_t{1} << 18;
+constexpr size_t kLookups = 1000;
+
+// Aligned like the nodes of the other two, which never straddle cache lines: in the region they
+// follow an 8-byte root.
+struct alignas(32) OffsetNode {
+    OffsetNode(int64_t key, int64_t value) : key(key), value(value) {
+    }
+
+    int64_t key;
+    int64_t value;
+    OffsetUniquePtr<OffsetNode> left;
+    OffsetUniquePtr<OffsetNode> right;
+};
+
+struct RawNode {
+    int64_t key;
+    int64_t value;
+    RawNode* left;
+    RawNode* right;
+};
+
+struct HeapNode {
+    int64_t key;
+    int64_t value;
+    UniquePtr<HeapNode> left;
+    UniquePtr<HeapNode> right;
+};
+
+OffsetUniquePtr<OffsetNode> BuildOffset(OffsetRegion& region, int64_t begin, int64_t end) {
+    if (begin == end) {
+        return nullptr;
+    }
+    int64_t middle = begin + (end - begin) / 2;
+    auto node = MakeOffsetUnique<OffsetNode>(region, middle, middle * 2);
+    node->left = BuildOffset(region, begin, middle);
+    node->right = BuildOffset(region, middle + 1, end);
+    return node;
+}
+
+// Pointers are saved as offsets from the start of `nodes`, null as zero: the root comes first.
+size_t BuildRaw(std::vector<RawNode>& nodes, int64_t begin, int64_t end) {
+    if (begin == end) {
+        return 0;
+    }
+    int64_t middle = begin + (end - begin) / 2;
+    size_t index = nodes.size();
+    nodes.push_back({middle, middle * 2, nullptr, nullptr});
+    size_t left = BuildRaw(nodes, begin, middle);
+    size_t right = BuildRaw(nodes, middle + 1, end);
+    nodes[index].left = reinterpret_cast<RawNode*>(left * sizeof(RawNode));
+    nodes[index].right = reinterpret_cast<RawNode*>(right * sizeof(RawNode));
+    return index;
+}
+
+// Preorder: key, value, then a byte telling which children follow.
+void Serialize(std::string& out, int64_t begin, int64_t end) {
+    int64_t middle = begin + (end - begin) / 2;
+    int64_t record[2] = {middle, middle * 2};
+    out.append(reinterpret_cast<const char*>(record), sizeof(record));
+    out.push_back(static_cast<char>((begin < middle) | (middle + 1 < end) << 1));
+    if (begin < middle) {
+        Serialize(out, begin, middle);
+    }
+    if (middle + 1 < end) {
+        Serialize(out, middle + 1, end);
+    }
+}
+
+UniquePtr<HeapNode> Deserialize(const char*& in) {
+    auto node = UniquePtr<HeapNode>(new HeapNode);
+    std::memcpy(&node->key, in, sizeof(int64_t));
+    std::memcpy(&node->value, in + sizeof(int64_t), sizeof(int64_t));
+    char children = in[2 * sizeof(int64_t)];
+    in += 2 * sizeof(int64_t) + 1;
+    if (children & 1) {
+        node->left = Deserialize(in);
+    }
+    if (children & 2) {
+        node->right = Deserialize(in);
+    }
+    return node;
+}
+
+std::string WriteFile(const char* data, size_t size) {
+    char path[] = "/tmp/bench_offset_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, data, size) != static_cast<ssize_t>(size)) {
+        std::perror("bench_offset");
+        std::exit(1);
+    }
+    close(fd);
+    return path;
+}
+
+size_t FileSize(int fd) {
+    struct stat stat;
+    fstat(fd, &stat);
+    return static_cast<size_t>(stat.st_size);
+}
+
+// Choosing the child pointer before decoding it lets the compiler pick it without a branch, as
+// it does for raw pointers; decoding both and choosing after does not.
+template <typename Node>
+int64_t Find(const Node* node, int64_t key) {
+    while (node != nullptr && node->key != key) {
+        node = (key < node->key ? node->left : node->right).Get();
+    }
+    return node == nullptr ? -1 : node->value;
+}
+
+int64_t FindRaw(const RawNode* node, int64_t key) {
+    while (node != nullptr && node->key != key) {
+        node = key < node->key ? node->left : node->right;
+    }
+    return node == nullptr ? -1 : node->value;
+}
+
+struct Mapping {
+    void* data;
+    size_t size;
+};
+
+class Files {
+public:
+    Files() {
+        OffsetRegion region(kNodes * sizeof(OffsetNode) + OffsetRegion::kAlignment);
+        auto* root = region.New<OffsetUniquePtr<OffsetNode>>();
+        *root = BuildOffset(region, 0, kNodes);
+        offset = WriteFile(region.Data(), region.Size());
+
+        std::vector<RawNode> nodes;
+        nodes.reserve(kNodes);
+        BuildRaw(nodes, 0, kNodes);
+        size_t raw_size = nodes.size() * sizeof(RawNode);
+        raw = WriteFile(reinterpret_cast<const char*>(nodes.data()), raw_size);
+
+        std::string stream;
+        Serialize(stream, 0, kNodes);
+        serialized = WriteFile(stream.data(), stream.size());
+
+        std::printf("%lld nodes: offset file %zu KiB, raw file %zu KiB, stream %zu KiB\n",
+                    static_cast<long long>(kNodes), region.Size() >> 10,
+                    raw_size >> 10, stream.size() >> 10);
+    }
+
+    ~Files() {
+        unlink(offset.c_str());
+        unlink(raw.c_str());
+        unlink(serialized.c_str());
+    }
+
+    std::string offset;
+    std::string raw;
+    std::string serialized;
+};
+
+Mapping Map(const std::string& path, int prot) {
+    int fd = open(path.c_str(), O_RDONLY);
+    size_t size = FileSize(fd);
+    void* data = mmap(nullptr, size, prot, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::perror("mmap");
+        std::exit(1);
+    }
+    return {data, size};
+}
+
+void Unmap(std::vector<Mapping>& mappings) {
+    for (const Mapping& mapping : mappings) {
+        munmap(mapping.data, mapping.size);
+    }
+    mappings.clear();
+}
+
+const OffsetNode* LoadOffset(std::vector<Mapping>& mappings, const std::string& path) {
+    mappings.push_back(Map(path, PROT_READ));
+    return OffsetRoot<OffsetUniquePtr<OffsetNode>>(
+               static_cast<const void*>(mappings.back().data))
+        ->Get();
+}
+
+const RawNode* LoadRaw(std::vector<Mapping>& mappings, const std::string& path) {
+    mappings.push_back(Map(path, PROT_READ | PROT_WRITE));
+    auto* nodes = static_cast<RawNode*>(mappings.back().data);
+    size_t count = mappings.back().size / sizeof(RawNode);
+    auto base = reinterpret_cast<uintptr_t>(nodes);
+    for (size_t i = 0; i < count; ++i) {
+        for (RawNode** child : {&nodes[i].left, &nodes[i].right}) {
+            auto offset = reinterpret_cast<uintptr_t>(*child);
+            *child = offset == 0 ? nullptr : reinterpret_cast<RawNode*>(base + offset);
+        }
+    }
+    return nodes;
+}
+
+UniquePtr<HeapNode> LoadHeap(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    std::string buffer(FileSize(fd), '\0');
+    if (read(fd, buffer.data(), buffer.size()) != static_cast<ssize_t>(buffer.size())) {
+        std::perror("read");
+        std::exit(1);
+    }
+    close(fd);
+    const char* in = buffer.data();
+    return Deserialize(in);
+}
+
+std::vector<int64_t> Keys() {
+    std::vector<int64_t> keys(kLookups);
+    uint64_t state = 42;
+    for (int64_t& key : keys) {
+        state = state * 6364136223846793005 + 1442695040888963407;
+        key = static_cast<int64_t>((state >> 33) % kNodes);
+    }
+    return keys;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::Runner runner(argc, argv);
+    Files files;
+
+    // Mappings and trees of the previous run are dropped in the untimed setup.
+    std::vector<Mapping> mappings;
+    std::vector<UniquePtr<HeapNode>> trees;
+    auto drop = [&mappings, &trees](size_t) {
+        Unmap(mappings);
+        trees.clear();
+    };
+
+    runner.Run("offset/startup/offset", drop, [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            bench::DoNotOptimize(Find(LoadOffset(mappings, files.offset), 7));
+        }
+    });
+    runner.Run("offset/startup/fixup", drop, [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            bench::DoNotOptimize(FindRaw(LoadRaw(mappings, files.raw), 7));
+        }
+    });
+    runner.Run("offset/startup/deserialize", drop, [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            trees.push_back(LoadHeap(files.serialized));
+            bench::DoNotOptimize(Find(trees.back().Get(), 7));
+        }
+    });
+    drop(0);
+
+    auto keys = Keys();
+    auto lookups = [&keys](auto find) {
+        return [&keys, find](size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                bench::DoNotOptimize(find(keys[i % kLookups]));
+            }
+        };
+    };
+    const OffsetNode* offset_root = LoadOffset(mappings, files.offset);
+    runner.Run("offset/lookup/offset",
+               lookups([offset_root](int64_t key) { return Find(offset_root, key); }));
+    const RawNode* raw_root = LoadRaw(mappings, files.raw);
+    runner.Run("offset/lookup/fixup",
+               lookups([raw_root](int64_t key) { return FindRaw(raw_root, key); }));
+    auto heap_root = LoadHeap(files.serialized);
+    runner.Run("offset/lookup/deserialize",
+               lookups([&heap_root](int64_t key) { return Find(heap_root.Get(), key); }));
+    Unmap(mappings);
+    return runner.Finish();
+}
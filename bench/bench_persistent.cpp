@@ -0,0 +1,232 @@
+#include "bench.h"
+#include "bench_memory.h"
+
+#include "../persistent/persistent_map.h"
+#include "../persistent/persistent_vector.h"
+
+#include <cstdio>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// PersistentVector and PersistentMap against taking a snapshot by copying a std::vector or a
+// std::unordered_map.
+//
+// Memory is live bytes held by a number of versions that differ from each other by one element.
+namespace {
+
+constexpr size_t kSize = 100'000;
+constexpr size_t kVersions = 100;
+
+PersistentVector<int> MakePersistent(size_t size) {
+    auto transient = PersistentVector<int>().AsTransient();
+    for (size_t i = 0; i < size; ++i) {
+        transient.PushBack(static_cast<int>(i));
+    }
+    return transient.Persistent();
+}
+
+PersistentMap<int, int> MakeMap(size_t size) {
+    PersistentMap<int, int> map;
+    for (size_t i = 0; i < size; ++i) {
+        map = map.Set(static_cast<int>(i), static_cast<int>(i));
+    }
+    return map;
+}
+
+std::unordered_map<int, int> MakeUnorderedMap(size_t size) {
+    std::unordered_map<int, int> map;
+    for (size_t i = 0; i < size; ++i) {
+        map.emplace(static_cast<int>(i), static_cast<int>(i));
+    }
+    return map;
+}
+
+template <typename MakeVersions>
+void ReportMemory(const char* name, MakeVersions make_versions) {
+    size_t before = bench::LiveBytes();
+    auto versions = make_versions();
+    std::printf("%-60s %12.2f MiB\n", name,
+                static_cast<double>(bench::LiveBytes() - before) / (1024 * 1024));
+}
+
+void BenchMemory() {
+    ReportMemory("memory/100 versions/PersistentVector", [] {
+        std::vector<PersistentVector<int>> versions{MakePersistent(kSize)};
+        for (size_t i = 1; i < kVersions; ++i) {
+            versions.push_back(versions.back().Set(i * 997 % kSize, -1));
+        }
+        return versions;
+    });
+    ReportMemory("memory/100 versions/std::vector", [] {
+        std::vector<std::vector<int>> versions(1);
+        for (size_t i = 0; i < kSize; ++i) {
+            versions[0].push_back(static_cast<int>(i));
+        }
+        for (size_t i = 1; i < kVersions; ++i) {
+            versions.push_back(versions.back());
+            versions.back()[i * 997 % kSize] = -1;
+        }
+        return versions;
+    });
+    ReportMemory("memory/100 versions/PersistentMap", [] {
+        std::vector<PersistentMap<int, int>> versions{MakeMap(kSize)};
+        for (size_t i = 1; i < kVersions; ++i) {
+            versions.push_back(versions.back().Set(static_cast<int>(i * 997 % kSize), -1));
+        }
+        return versions;
+    });
+    ReportMemory("memory/100 versions/std::unordered_map", [] {
+        std::vector<std::unordered_map<int, int>> versions{MakeUnorderedMap(kSize)};
+        for (size_t i = 1; i < kVersions; ++i) {
+            versions.push_back(versions.back());
+            versions.back()[static_cast<int>(i * 997 % kSize)] = -1;
+        }
+        return versions;
+    });
+}
+
+void BenchSet(bench::Runner& runner) {
+    auto persistent = MakePersistent(kSize);
+    runner.Run("persistent/set/PersistentVector", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            persistent = persistent.Set(i * 997 % kSize, static_cast<int>(i));
+        }
+    });
+
+    auto transient = persistent.AsTransient();
+    runner.Run("persistent/set/Transient", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            transient.Set(i * 997 % kSize, static_cast<int>(i));
+        }
+    });
+
+    std::vector<int> vector(kSize);
+    runner.Run("persistent/set/std::vector copy", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            std::vector<int> copy = vector;
+            copy[i * 997 % kSize] = static_cast<int>(i);
+            vector.swap(copy);
+        }
+    });
+}
+
+void BenchPushBack(bench::Runner& runner) {
+    runner.Run("persistent/push_back/PersistentVector", [](size_t n) {
+        PersistentVector<int> vector;
+        for (size_t i = 0; i < n; ++i) {
+            vector = vector.PushBack(static_cast<int>(i));
+        }
+        bench::DoNotOptimize(vector);
+    });
+
+    runner.Run("persistent/push_back/Transient", [](size_t n) {
+        auto transient = PersistentVector<int>().AsTransient();
+        for (size_t i = 0; i < n; ++i) {
+            transient.PushBack(static_cast<int>(i));
+        }
+        bench::DoNotOptimize(transient);
+    });
+
+    runner.Run("persistent/push_back/std::vector", [](size_t n) {
+        std::vector<int> vector;
+        for (size_t i = 0; i < n; ++i) {
+            vector.push_back(static_cast<int>(i));
+        }
+        bench::DoNotOptimize(vector);
+    });
+}
+
+void BenchGet(bench::Runner& runner) {
+    auto persistent = MakePersistent(kSize);
+    runner.Run("persistent/get/PersistentVector", [&](size_t n) {
+        int sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += persistent[i * 997 % kSize];
+        }
+        bench::DoNotOptimize(sum);
+    });
+
+    std::vector<int> vector(kSize);
+    runner.Run("persistent/get/std::vector", [&](size_t n) {
+        int sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += vector[i * 997 % kSize];
+        }
+        bench::DoNotOptimize(sum);
+    });
+}
+
+void BenchMap(bench::Runner& runner) {
+    auto map = MakeMap(kSize);
+    runner.Run("persistent/map/find/PersistentMap", [&](size_t n) {
+        int sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += *map.Find(static_cast<int>(i * 997 % kSize));
+        }
+        bench::DoNotOptimize(sum);
+    });
+
+    auto unordered = MakeUnorderedMap(kSize);
+    runner.Run("persistent/map/find/std::unordered_map", [&](size_t n) {
+        int sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            sum += unordered.find(static_cast<int>(i * 997 % kSize))->second;
+        }
+        bench::DoNotOptimize(sum);
+    });
+
+    runner.Run("persistent/map/set/PersistentMap", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            map = map.Set(static_cast<int>(i * 997 % kSize), static_cast<int>(i));
+        }
+    });
+
+    // In place, no snapshot kept: the lower bound for an update.
+    runner.Run("persistent/map/set/std::unordered_map", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            unordered[static_cast<int>(i * 997 % kSize)] = static_cast<int>(i);
+        }
+    });
+
+    runner.Run("persistent/map/set/std::unordered_map copy", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            auto copy = unordered;
+            copy[static_cast<int>(i * 997 % kSize)] = static_cast<int>(i);
+            unordered.swap(copy);
+        }
+    });
+
+    std::vector<std::pair<int, int>> items;
+    for (size_t i = 0; i < kSize; ++i) {
+        items.emplace_back(static_cast<int>(i), static_cast<int>(i));
+    }
+    // One operation is one inserted element.
+    std::vector<size_t> thread_counts{1};
+    if (std::thread::hardware_concurrency() > 1) {
+        thread_counts.push_back(std::thread::hardware_concurrency());
+    }
+    for (size_t threads : thread_counts) {
+        runner.Run("persistent/map/build/" + std::to_string(threads) + " threads", [&](size_t n) {
+            for (size_t done = 0; done < n; done += kSize) {
+                auto built = PersistentMap<int, int>::Build(items, threads);
+                bench::DoNotOptimize(built);
+            }
+        });
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::Runner runner(argc, argv);
+
+    BenchMemory();
+    BenchSet(runner);
+    BenchPushBack(runner);
+    BenchGet(runner);
+    BenchMap(runner);
+
+    return runner.Finish();
+}
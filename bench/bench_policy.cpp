@@ -0,0 +1,86 @@
+#include "bench.h"
+
+#include "../shared/shared.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// What each `SharedPolicy` costs: first the size of the block `MakeBasicShared` allocates for a
+// small object, then creating a batch of pointers, copying and dropping them. Time is per
+// pointer.
+namespace {
+
+constexpr size_t kBatch = 1000;
+
+struct Point {
+    Point() = default;
+
+    Point(double x, double y) : x(x), y(y) {
+    }
+
+    double x = 0;
+    double y = 0;
+};
+
+using Local = SharedPolicy<false, true>;
+using Strong = SharedPolicy<true, false>;
+using LocalStrong = SharedPolicy<false, false>;
+using StrongNoDeleter = SharedPolicy<true, false, std::allocator<std::byte>, DeleterStorage::kNone>;
+using LocalStrongNoDeleter =
+    SharedPolicy<false, false, std::allocator<std::byte>, DeleterStorage::kNone>;
+
+template <typename Policy>
+void Report(const char* name) {
+    std::printf("%-24s block %3zu bytes (int: %3zu), handle %2zu bytes\n", name,
+                BasicSharedBlockSize<Point, Policy>(), BasicSharedBlockSize<int, Policy>(),
+                sizeof(BasicSharedPtr<Point, Policy>));
+}
+
+template <typename Policy>
+void Bench(bench::Runner& runner, const std::string& name) {
+    runner.Run("policy/" + name + "/make", [](size_t n) {
+        std::vector<BasicSharedPtr<Point, Policy>> batch;
+        batch.reserve(kBatch);
+        for (size_t i = 0; i < n; ++i) {
+            batch.push_back(MakeBasicShared<Point, Policy>(1.0, 2.0));
+            if (batch.size() == kBatch) {
+                batch.clear();
+            }
+        }
+    });
+
+    auto object = MakeBasicShared<Point, Policy>(1.0, 2.0);
+    runner.Run("policy/" + name + "/copy", [&object](size_t n) {
+        std::vector<BasicSharedPtr<Point, Policy>> batch;
+        batch.reserve(kBatch);
+        for (size_t i = 0; i < n; ++i) {
+            batch.push_back(object);
+            if (batch.size() == kBatch) {
+                batch.clear();
+            }
+        }
+    });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::Runner runner(argc, argv);
+
+    Report<DefaultSharedPolicy>("default (SharedPtr)");
+    Report<Local>("non-atomic");
+    Report<Strong>("no weak");
+    Report<LocalStrong>("non-atomic, no weak");
+    Report<StrongNoDeleter>("no weak, no deleter");
+    Report<LocalStrongNoDeleter>("non-atomic, no weak/del.");
+
+    Bench<DefaultSharedPolicy>(runner, "default");
+    Bench<Local>(runner, "non-atomic");
+    Bench<Strong>(runner, "no-weak");
+    Bench<LocalStrong>(runner, "non-atomic-no-weak");
+    Bench<StrongNoDeleter>(runner, "no-weak-no-deleter");
+    Bench<LocalStrongNoDeleter>(runner, "non-atomic-no-weak-no-deleter");
+    return runner.Finish();
+}
@@ -0,0 +1,63 @@
+#include "bench.h"
+#include "bench_threads.h"
+
+#include "../weak/shared.h"
+
+#include <vector>
+
+// Creation and destruction of control blocks, the only operations the live block registry adds
+// work to. Built twice: `bench_registry` with `SMART_PTRS_REGISTRY`, `bench_registry_off`
+// without it, with the same benchmark names, so that one is compared against the other with
+// `--json` and `--baseline`.
+namespace {
+
+auto MakeLoop() {
+    return [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            auto ptr = MakeShared<int>(0);
+            bench::DoNotOptimize(ptr);
+        }
+    };
+}
+
+auto AdoptLoop() {
+    return [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            SharedPtr<int> ptr(new int(0));
+            bench::DoNotOptimize(ptr);
+        }
+    };
+}
+
+// Blocks outliving the loop: registering does not reuse the slot it has just freed.
+auto BatchLoop() {
+    return [](size_t n) {
+        std::vector<SharedPtr<int>> batch;
+        batch.reserve(256);
+        for (size_t i = 0; i < n; ++i) {
+            batch.push_back(MakeShared<int>(0));
+            if (batch.size() == 256) {
+                batch.clear();
+            }
+        }
+    };
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::Runner runner(argc, argv);
+
+    runner.Run("registry/MakeShared", MakeLoop());
+    runner.Run("registry/SharedPtr(new)", AdoptLoop());
+    runner.Run("registry/MakeShared/batch", BatchLoop());
+
+    for (size_t threads : bench::ThreadCounts()) {
+        bench::BenchThreads(runner, "registry/threads/MakeShared", threads,
+                            [](size_t) { return MakeLoop(); });
+        bench::BenchThreads(runner, "registry/threads/MakeShared/batch", threads,
+                            [](size_t) { return BatchLoop(); });
+    }
+
+    return runner.Finish();
+}
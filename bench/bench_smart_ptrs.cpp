@@ -0,0 +1,308 @@
+#include "bench.h"
+
+#include "../intrusive/intrusive.h"
+#include "../unique/unique.h"
+#include "../weak/shared.h"
+#include "../weak/weak.h"
+
+#include <memory>
+#include <vector>
+
+// Also built with `allocations_checker` linked in, with sampling off (`SMART_PTRS_CHECKER`) and at
+// 1/1000 (`SMART_PTRS_SAMPLING` as well), so that its price is one comparison of the two.
+#ifdef SMART_PTRS_CHECKER
+#include "allocations_checker.h"
+#endif
+
+namespace {
+
+struct Base {
+    virtual ~Base() = default;
+
+    int value = 0;
+};
+
+struct Derived : Base {};
+
+struct Node : SimpleRefCounted<Node> {
+    int value = 0;
+};
+
+struct AtomicNode : AtomicRefCounted<AtomicNode> {
+    int value = 0;
+};
+
+struct IntrusiveBase : SimpleRefCounted<IntrusiveBase> {
+    virtual ~IntrusiveBase() = default;
+};
+
+struct IntrusiveDerived : IntrusiveBase {};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Copy construction plus destruction of the copy, the pointee is shared by all copies.
+template <typename Ptr>
+void BenchCopy(bench::Runner& runner, const std::string& name, const Ptr& source) {
+    runner.Run(name, [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            Ptr copy(source);
+            bench::DoNotOptimize(copy);
+        }
+    });
+}
+
+template <typename Ptr>
+void BenchMove(bench::Runner& runner, const std::string& name, Ptr source) {
+    runner.Run(name, [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            Ptr moved(std::move(source));
+            bench::DoNotOptimize(moved);
+            source = std::move(moved);
+        }
+    });
+}
+
+// Destruction of `n` handles produced by `make`.
+template <typename Ptr, typename Make>
+void BenchDestroy(bench::Runner& runner, const std::string& name, Make make) {
+    std::vector<Ptr> handles;
+    runner.Run(
+        name,
+        [&](size_t n) {
+            handles.clear();
+            handles.reserve(n);
+            for (size_t i = 0; i < n; ++i) {
+                handles.push_back(make());
+            }
+        },
+        [&](size_t) {
+            handles.clear();
+            bench::ClobberMemory();
+        });
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void BenchUnique(bench::Runner& runner) {
+    runner.Run("unique/construct/UniquePtr", [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            UniquePtr<int> p(new int(i));
+            bench::DoNotOptimize(p);
+        }
+    });
+    runner.Run("unique/construct/std::unique_ptr", [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            std::unique_ptr<int> p(new int(i));
+            bench::DoNotOptimize(p);
+        }
+    });
+
+    BenchMove(runner, "unique/move/UniquePtr", UniquePtr<int>(new int(42)));
+    BenchMove(runner, "unique/move/std::unique_ptr", std::unique_ptr<int>(new int(42)));
+
+    BenchDestroy<UniquePtr<int>>(runner, "unique/destroy/UniquePtr",
+                                 [] { return UniquePtr<int>(new int(42)); });
+    BenchDestroy<std::unique_ptr<int>>(runner, "unique/destroy/std::unique_ptr",
+                                       [] { return std::unique_ptr<int>(new int(42)); });
+
+    runner.Run("unique/convert/UniquePtr", [](size_t n) {
+        UniquePtr<Derived> derived(new Derived);
+        for (size_t i = 0; i < n; ++i) {
+            UniquePtr<Base> base(std::move(derived));
+            bench::DoNotOptimize(base);
+            derived.Reset(static_cast<Derived*>(base.Release()));
+        }
+    });
+    runner.Run("unique/convert/std::unique_ptr", [](size_t n) {
+        std::unique_ptr<Derived> derived(new Derived);
+        for (size_t i = 0; i < n; ++i) {
+            std::unique_ptr<Base> base(std::move(derived));
+            bench::DoNotOptimize(base);
+            derived.reset(static_cast<Derived*>(base.release()));
+        }
+    });
+}
+
+void BenchShared(bench::Runner& runner) {
+    runner.Run("shared/construct/SharedPtr", [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            SharedPtr<int> p(new int(i));
+            bench::DoNotOptimize(p);
+        }
+    });
+    runner.Run("shared/construct/std::shared_ptr", [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            std::shared_ptr<int> p(new int(i));
+            bench::DoNotOptimize(p);
+        }
+    });
+
+    runner.Run("shared/make/SharedPtr", [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            auto p = MakeShared<int>(i);
+            bench::DoNotOptimize(p);
+        }
+    });
+    runner.Run("shared/make/std::shared_ptr", [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            auto p = std::make_shared<int>(i);
+            bench::DoNotOptimize(p);
+        }
+    });
+
+    BenchCopy(runner, "shared/copy/SharedPtr", MakeShared<int>(42));
+    BenchCopy(runner, "shared/copy/std::shared_ptr", std::make_shared<int>(42));
+    BenchCopy(runner, "shared/copy/BiasedSharedPtr", MakeBiasedShared<int>(42));
+
+    BenchMove(runner, "shared/move/SharedPtr", MakeShared<int>(42));
+    BenchMove(runner, "shared/move/std::shared_ptr", std::make_shared<int>(42));
+
+    auto shared = MakeShared<int>(42);
+    auto std_shared = std::make_shared<int>(42);
+    BenchDestroy<SharedPtr<int>>(runner, "shared/destroy/SharedPtr", [&] { return shared; });
+    BenchDestroy<std::shared_ptr<int>>(runner, "shared/destroy/std::shared_ptr",
+                                       [&] { return std_shared; });
+
+    std::vector<SharedPtr<int>> handles;
+    runner.Run(
+        "shared/destroy/SharedPtr deferred",
+        [&](size_t n) { handles.assign(n, shared); },
+        [&](size_t) {
+            DeferredReleaseScope scope;
+            handles.clear();
+            bench::ClobberMemory();
+        });
+
+    auto derived = MakeShared<Derived>();
+    runner.Run("shared/convert/SharedPtr", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            SharedPtr<Base> base(derived);
+            bench::DoNotOptimize(base);
+        }
+    });
+    auto std_derived = std::make_shared<Derived>();
+    runner.Run("shared/convert/std::shared_ptr", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            std::shared_ptr<Base> base(std_derived);
+            bench::DoNotOptimize(base);
+        }
+    });
+}
+
+void BenchWeak(bench::Runner& runner) {
+    auto shared = MakeShared<int>(42);
+    auto std_shared = std::make_shared<int>(42);
+
+    runner.Run("weak/construct/WeakPtr", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            WeakPtr<int> weak(shared);
+            bench::DoNotOptimize(weak);
+        }
+    });
+    runner.Run("weak/construct/std::weak_ptr", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            std::weak_ptr<int> weak(std_shared);
+            bench::DoNotOptimize(weak);
+        }
+    });
+
+    BenchCopy(runner, "weak/copy/WeakPtr", WeakPtr<int>(shared));
+    BenchCopy(runner, "weak/copy/std::weak_ptr", std::weak_ptr<int>(std_shared));
+
+    BenchMove(runner, "weak/move/WeakPtr", WeakPtr<int>(shared));
+    BenchMove(runner, "weak/move/std::weak_ptr", std::weak_ptr<int>(std_shared));
+
+    BenchDestroy<WeakPtr<int>>(runner, "weak/destroy/WeakPtr",
+                               [&] { return WeakPtr<int>(shared); });
+    BenchDestroy<std::weak_ptr<int>>(runner, "weak/destroy/std::weak_ptr",
+                                     [&] { return std::weak_ptr<int>(std_shared); });
+
+    WeakPtr<int> weak(shared);
+    runner.Run("weak/lock/WeakPtr", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            auto locked = weak.Lock();
+            bench::DoNotOptimize(locked);
+        }
+    });
+    std::weak_ptr<int> std_weak(std_shared);
+    runner.Run("weak/lock/std::weak_ptr", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            auto locked = std_weak.lock();
+            bench::DoNotOptimize(locked);
+        }
+    });
+}
+
+// `IntrusivePtr` has no std counterpart, compare it with `std::shared_ptr` from `make_shared`.
+void BenchIntrusive(bench::Runner& runner) {
+    runner.Run("intrusive/make/IntrusivePtr", [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            auto p = MakeIntrusive<Node>();
+            bench::DoNotOptimize(p);
+        }
+    });
+
+    BenchCopy(runner, "intrusive/copy/IntrusivePtr", MakeIntrusive<Node>());
+    BenchMove(runner, "intrusive/move/IntrusivePtr", MakeIntrusive<Node>());
+
+    auto node = MakeIntrusive<Node>();
+    BenchDestroy<IntrusivePtr<Node>>(runner, "intrusive/destroy/IntrusivePtr",
+                                     [&] { return node; });
+
+    auto derived = MakeIntrusive<IntrusiveDerived>();
+    runner.Run("intrusive/convert/IntrusivePtr", [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            IntrusivePtr<IntrusiveBase> base(derived);
+            bench::DoNotOptimize(base);
+        }
+    });
+}
+
+// `StrongOnlySharedPtr` aims at the footprint of `IntrusivePtr` with an atomic counter, compare it
+// with that.
+void BenchStrongOnly(bench::Runner& runner) {
+    runner.Run("strong-only/make/StrongOnlySharedPtr", [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            auto p = MakeStrongOnlyShared<int>(i);
+            bench::DoNotOptimize(p);
+        }
+    });
+    runner.Run("strong-only/make/IntrusivePtr", [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            auto p = MakeIntrusive<AtomicNode>();
+            bench::DoNotOptimize(p);
+        }
+    });
+
+    BenchCopy(runner, "strong-only/copy/StrongOnlySharedPtr", MakeStrongOnlyShared<int>(42));
+    BenchCopy(runner, "strong-only/copy/IntrusivePtr", MakeIntrusive<AtomicNode>());
+
+    auto strong = MakeStrongOnlyShared<int>(42);
+    auto node = MakeIntrusive<AtomicNode>();
+    BenchDestroy<StrongOnlySharedPtr<int>>(runner, "strong-only/destroy/StrongOnlySharedPtr",
+                                           [&] { return strong; });
+    BenchDestroy<IntrusivePtr<AtomicNode>>(runner, "strong-only/destroy/IntrusivePtr",
+                                           [&] { return node; });
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bench::Runner runner(argc, argv);
+
+#ifdef SMART_PTRS_CHECKER
+    // Referenced in both builds, so that the replaced `operator new` is linked into both.
+    alloc_checker::ResetCounters();
+#endif
+#ifdef SMART_PTRS_SAMPLING
+    alloc_checker::StartSampling({.every_n_allocs = 1000});
+#endif
+
+    BenchUnique(runner);
+    BenchShared(runner);
+    BenchWeak(runner);
+    BenchIntrusive(runner);
+    BenchStrongOnly(runner);
+
+    return runner.Finish();
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "bench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Multithreaded benchmarks: every thread performs the same number of operations, ns/op is the
+// time one thread spends per operation, so perfect scaling keeps it flat.
+// Where perf events are available, cache misses per operation approximate how often shared
+// cache lines move between cores.
+namespace bench {
+
+// Counts cache misses of the calling thread. Inert if perf events are not permitted.
+class MissCounter {
+public:
+    MissCounter() {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    MissCounter(const MissCounter&) = delete;
+    MissCounter& operator=(const MissCounter&) = delete;
+
+    ~MissCounter() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    bool Available() const {
+        return fd_ >= 0;
+    }
+
+    void Start() {
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    uint64_t Stop() {
+        uint64_t value = 0;
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd_, &value, sizeof(value)) != sizeof(value)) {
+                value = 0;
+            }
+        }
+        return value;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+inline void PinToCore(size_t core) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+struct Totals {
+    std::atomic<uint64_t> ops = 0;
+    std::atomic<uint64_t> misses = 0;
+    std::atomic<bool> perf_available = false;
+};
+
+// Runs `make_worker(thread)` on each of `threads` pinned threads and lets every returned worker
+// perform `n` operations. Returns nanoseconds from the start, given to all threads at once, until
+// the last worker is done: spawning, pinning, making workers and joining are not timed.
+template <typename MakeWorker>
+double RunThreads(size_t threads, size_t n, Totals* totals, MakeWorker make_worker) {
+    using Clock = std::chrono::steady_clock;
+    std::atomic<size_t> ready = 0;
+    std::atomic<bool> go = false;
+    std::vector<Clock::time_point> finish(threads);
+    std::vector<std::thread> pool;
+    pool.reserve(threads);
+    for (size_t t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            PinToCore(t);
+            auto worker = make_worker(t);
+            MissCounter counter;
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) {
+            }
+            counter.Start();
+            worker(n);
+            finish[t] = Clock::now();
+            uint64_t misses = counter.Stop();
+            totals->ops.fetch_add(n, std::memory_order_relaxed);
+            totals->misses.fetch_add(misses, std::memory_order_relaxed);
+            if (counter.Available()) {
+                totals->perf_available.store(true, std::memory_order_relaxed);
+            }
+        });
+    }
+    while (ready.load() != threads) {
+    }
+    auto start = Clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    auto last = *std::max_element(finish.begin(), finish.end());
+    return std::chrono::duration<double, std::nano>(last - start).count();
+}
+
+template <typename MakeWorker>
+void BenchThreads(Runner& runner, const std::string& name, size_t threads, MakeWorker make_worker) {
+    std::string full_name = name + "/threads:" + std::to_string(threads);
+    Totals totals;
+    runner.RunTimed(full_name,
+                    [&](size_t n) { return RunThreads(threads, n, &totals, make_worker); });
+    if (totals.perf_available.load() && totals.ops.load() != 0) {
+        runner.AddCounter(full_name, "misses_per_op",
+                          static_cast<double>(totals.misses.load()) / totals.ops.load());
+    }
+}
+
+inline std::vector<size_t> ThreadCounts() {
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<size_t> counts;
+    for (size_t threads = 1; threads < cores; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(cores);
+    return counts;
+}
+
+}  // namespace bench
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "../weak/shared.h"
+#include "../weak/weak.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// Canonical objects by key: `Lock(key, make)` returns the live value for `key` or creates one
+// with `make(key)`. The cache holds only weak references; the entry is erased by the value's
+// control block when the last strong reference goes away, so dead entries never pile up.
+//
+// Concurrent `Lock`s of a missing key call `make` once, the others wait for its result. `make`
+// runs without the cache lock held, but must not `Lock` the same key. Values may outlive the
+// cache.
+template <typename K, typename V, typename Hash = std::hash<K>>
+class WeakValueCache {
+public:
+    struct Stats {
+        size_t hits = 0;
+
+        // Lookups that created the value.
+        size_t misses = 0;
+
+        // Misses that found an entry whose value had just died, before its control block erased
+        // it.
+        size_t expired = 0;
+
+        // Entries erased because their value died.
+        size_t evictions = 0;
+    };
+
+    WeakValueCache() : state_(MakeShared<State>()) {
+    }
+
+    WeakValueCache(const WeakValueCache&) = delete;
+    WeakValueCache& operator=(const WeakValueCache&) = delete;
+
+    template <typename Make>
+    SharedPtr<V> Lock(const K& key, Make make) {
+        std::unique_lock lock(state_->mutex);
+        while (true) {
+            auto it = state_->entries.find(key);
+            if (it == state_->entries.end()) {
+                break;
+            }
+            if (it->second.block == nullptr) {
+                state_->created.wait(lock);
+                continue;
+            }
+            if (auto value = it->second.value.Lock()) {
+                ++state_->stats.hits;
+                return value;
+            }
+            ++state_->stats.expired;
+            break;
+        }
+        ++state_->stats.misses;
+        // Marks the value as being created.
+        state_->entries[key] = Entry{};
+        lock.unlock();
+
+        Block* block;
+        try {
+            block = new Block(state_, key, make(key));
+        } catch (...) {
+            lock.lock();
+            state_->entries.erase(key);
+            state_->created.notify_all();
+            throw;
+        }
+        auto value = AdoptShared(block->GetObject(), block);
+
+        lock.lock();
+        state_->entries[key] = Entry{WeakPtr<V>(value), block};
+        state_->created.notify_all();
+        return value;
+    }
+
+    // Live entries, including values being created.
+    size_t Size() const {
+        std::lock_guard lock(state_->mutex);
+        return state_->entries.size();
+    }
+
+    Stats GetStats() const {
+        std::lock_guard lock(state_->mutex);
+        return state_->stats;
+    }
+
+private:
+    struct Entry {
+        WeakPtr<V> value;
+
+        // Null while the value is being created.
+        const ControlBlock* block = nullptr;
+    };
+
+    struct State {
+        std::mutex mutex;
+        std::condition_variable created;
+        std::unordered_map<K, Entry, Hash> entries;
+        Stats stats;
+
+        // The key may have been taken over by a newer value already.
+        void Evict(const K& key, const ControlBlock* block) {
+            std::lock_guard lock(mutex);
+            auto it = entries.find(key);
+            if (it != entries.end() && it->second.block == block) {
+                entries.erase(it);
+                ++stats.evictions;
+            }
+        }
+    };
+
+    // Erases its entry when the value dies. Keeps the cache state alive until then, so the
+    // values may outlive the cache.
+    class Block : public ControlBlockObject<V> {
+    public:
+        template <typename... Args>
+        Block(SharedPtr<State> state, const K& key, Args&&... args)
+            : ControlBlockObject<V>(std::forward<Args>(args)...),
+              state_(std::move(state)),
+              key_(key) {
+        }
+
+    protected:
+        // Runs on the zero transition of the strong count. The state reference is dropped here
+        // rather than with the block, which lives on while the cache holds a weak reference.
+        void DestroyObject() override {
+            SharedPtr<State> state = std::move(state_);
+            state->Evict(key_, this);
+            ControlBlockObject<V>::DestroyObject();
+        }
+
+    private:
+        SharedPtr<State> state_;
+        K key_;
+    };
+
+    SharedPtr<State> state_;
+};
@@ -0,0 +1,153 @@
+#include "cache.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Texture {
+    static std::atomic<int> alive;
+
+    explicit Texture(std::string name) : name(std::move(name)) {
+        alive.fetch_add(1);
+    }
+
+    Texture(Texture&& other) : name(std::move(other.name)) {
+        alive.fetch_add(1);
+    }
+
+    ~Texture() {
+        alive.fetch_sub(1);
+    }
+
+    std::string name;
+};
+
+std::atomic<int> Texture::alive = 0;
+
+auto Load(std::atomic<int>* loads = nullptr) {
+    return [loads](const std::string& name) {
+        if (loads != nullptr) {
+            loads->fetch_add(1);
+        }
+        return Texture(name);
+    };
+}
+
+}  // namespace
+
+TEST_CASE("WeakValueCache") {
+    WeakValueCache<std::string, Texture> cache;
+
+    SECTION("Hit while alive") {
+        auto a = cache.Lock("grass", Load());
+        auto b = cache.Lock("grass", Load());
+        REQUIRE(a == b);
+        REQUIRE(a->name == "grass");
+        REQUIRE(cache.Size() == 1);
+
+        auto stats = cache.GetStats();
+        REQUIRE(stats.hits == 1);
+        REQUIRE(stats.misses == 1);
+    }
+
+    SECTION("Evicted when the last reference dies") {
+        auto a = cache.Lock("grass", Load());
+        WeakPtr<Texture> weak(a);
+        auto copy = a;
+        a.Reset();
+        REQUIRE(cache.Size() == 1);
+        copy.Reset();
+        REQUIRE(cache.Size() == 0);
+        REQUIRE(Texture::alive == 0);
+        REQUIRE(cache.GetStats().evictions == 1);
+
+        // A weak reference does not bring the entry back.
+        REQUIRE(weak.Expired());
+        cache.Lock("grass", Load());
+        REQUIRE(cache.GetStats().misses == 2);
+        REQUIRE(cache.Size() == 0);
+    }
+
+    SECTION("Make throws") {
+        auto fail = [](const std::string&) -> Texture { throw std::runtime_error("no such file"); };
+        REQUIRE_THROWS_AS(cache.Lock("grass", fail), std::runtime_error);
+        REQUIRE(cache.Size() == 0);
+        REQUIRE(cache.Lock("grass", Load())->name == "grass");
+    }
+}
+
+TEST_CASE("Values outlive the cache") {
+    SharedPtr<Texture> value;
+    {
+        WeakValueCache<int, Texture> cache;
+        value = cache.Lock(1, [](int) { return Texture("one"); });
+    }
+    REQUIRE(value->name == "one");
+    value.Reset();
+    REQUIRE(Texture::alive == 0);
+}
+
+// Run under TSan: cmake -DCMAKE_BUILD_TYPE=TSAN
+TEST_CASE("WeakValueCache concurrent misses") {
+    constexpr int kThreads = 4;
+    WeakValueCache<std::string, Texture> cache;
+    std::atomic<int> loads = 0;
+
+    SECTION("Created once") {
+        auto slow = [&](const std::string& name) {
+            loads.fetch_add(1);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            return Texture(name);
+        };
+        std::vector<SharedPtr<Texture>> results(kThreads);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t) {
+            threads.emplace_back([&, t] { results[t] = cache.Lock("grass", slow); });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(loads == 1);
+        for (const auto& result : results) {
+            REQUIRE(result == results[0]);
+        }
+        REQUIRE(cache.GetStats().hits == kThreads - 1);
+    }
+
+    SECTION("Churn") {
+        constexpr int kRounds = 2000;
+        std::atomic<int> wrong = 0;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < kThreads; ++t) {
+            threads.emplace_back([&, t] {
+                for (int i = 0; i < kRounds; ++i) {
+                    std::string key = std::to_string((i + t) % 8);
+                    auto value = cache.Lock(key, Load(&loads));
+                    if (value->name != key) {
+                        wrong.fetch_add(1);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        REQUIRE(wrong == 0);
+        REQUIRE(cache.Size() == 0);
+        REQUIRE(Texture::alive == 0);
+
+        auto stats = cache.GetStats();
+        REQUIRE(stats.hits + stats.misses == kThreads * kRounds);
+        REQUIRE(stats.misses == static_cast<size_t>(loads.load()));
+        REQUIRE(stats.expired <= stats.misses);
+    }
+}
@@ -0,0 +1,73 @@
+function(add_bench BENCH_NAME)
+    add_executable(${BENCH_NAME} ${ARGN})
+    target_include_directories(${BENCH_NAME} PRIVATE ${CMAKE_SOURCE_DIR}/bench)
+    target_compile_options(${BENCH_NAME} PRIVATE -O2)
+endfunction()
+
+# ------------------------------------------------------------------------------
+# Smart pointers vs std
+
+add_bench(bench_smart_ptrs bench/bench_smart_ptrs.cpp)
+target_compile_options(bench_smart_ptrs PRIVATE -Wno-self-move)
+
+add_bench(bench_smart_ptrs_checker bench/bench_smart_ptrs.cpp)
+target_compile_options(bench_smart_ptrs_checker PRIVATE -Wno-self-move)
+target_compile_definitions(bench_smart_ptrs_checker PRIVATE SMART_PTRS_CHECKER)
+target_link_libraries(bench_smart_ptrs_checker PRIVATE allocations_checker)
+
+add_bench(bench_smart_ptrs_sampling bench/bench_smart_ptrs.cpp)
+target_compile_options(bench_smart_ptrs_sampling PRIVATE -Wno-self-move)
+target_compile_definitions(bench_smart_ptrs_sampling PRIVATE SMART_PTRS_CHECKER SMART_PTRS_SAMPLING)
+target_link_libraries(bench_smart_ptrs_sampling PRIVATE allocations_checker)
+
+# ------------------------------------------------------------------------------
+# Reference count contention
+
+find_package(Threads REQUIRED)
+add_bench(bench_contention bench/bench_contention.cpp)
+target_link_libraries(bench_contention PRIVATE Threads::Threads)
+
+# ------------------------------------------------------------------------------
+# Epoch-based reclamation
+
+add_bench(bench_ebr bench/bench_ebr.cpp)
+target_link_libraries(bench_ebr PRIVATE Threads::Threads)
+
+# ------------------------------------------------------------------------------
+# Persistent collections
+
+add_bench(bench_persistent bench/bench_persistent.cpp)
+target_compile_options(bench_persistent PRIVATE -Wno-mismatched-new-delete)
+target_link_libraries(bench_persistent PRIVATE Threads::Threads)
+
+# ------------------------------------------------------------------------------
+# Interner
+
+add_bench(bench_interner bench/bench_interner.cpp)
+target_compile_options(bench_interner PRIVATE -Wno-mismatched-new-delete)
+target_link_libraries(bench_interner PRIVATE Threads::Threads)
+
+# ------------------------------------------------------------------------------
+# Live block registry
+
+add_bench(bench_registry bench/bench_registry.cpp)
+target_compile_definitions(bench_registry PRIVATE SMART_PTRS_REGISTRY)
+target_link_libraries(bench_registry PRIVATE Threads::Threads)
+
+add_bench(bench_registry_off bench/bench_registry.cpp)
+target_link_libraries(bench_registry_off PRIVATE Threads::Threads)
+
+# ------------------------------------------------------------------------------
+# Arena
+
+add_bench(bench_arena bench/bench_arena.cpp)
+
+# ------------------------------------------------------------------------------
+# Offset pointers
+
+add_bench(bench_offset bench/bench_offset.cpp)
+
+# ------------------------------------------------------------------------------
+# Policy-based SharedPtr
+
+add_bench(bench_policy bench/bench_policy.cpp)
@@ -1,3 +1,9 @@
+# ------------------------------------------------------------------------------
+# Allocations checker
+
+add_catch(test_allocations_checker allocations_checker/test.cpp)
+target_compile_options(test_allocations_checker PRIVATE -Wno-free-nonheap-object -Wno-use-after-free)
+
 # ------------------------------------------------------------------------------
 # UniquePtr
 
@@ -8,12 +14,15 @@ target_compile_options(test_unique PRIVATE -Wno-self-move)
 # SharedPtr + WeakPtr
 
 add_catch(test_shared
-        shared/test.cpp)
+        shared/test.cpp
+        shared/test_policy.cpp)
 
 add_catch(test_weak
         weak/test.cpp
         weak/test_shared.cpp
-        weak/test_odr.cpp)
+        weak/test_odr.cpp
+        weak/test_atomic.cpp
+        weak/test_biased.cpp)
 
 add_catch(test_shared_from_this
         shared-from-this/test.cpp
@@ -24,8 +33,89 @@ target_compile_options(test_shared PRIVATE -Wno-self-assign-overloaded)
 target_compile_options(test_weak PRIVATE -Wno-self-assign-overloaded)
 target_compile_options(test_shared_from_this PRIVATE -Wno-self-assign-overloaded)
 
+# ------------------------------------------------------------------------------
+# Copy-on-write
+
+add_catch(test_cow cow/test.cpp)
+
+# ------------------------------------------------------------------------------
+# Weak value cache
+
+add_catch(test_cache cache/test.cpp)
+
+# ------------------------------------------------------------------------------
+# Cycle collector
+
+add_catch(test_cycles cycles/test.cpp)
+
+# ------------------------------------------------------------------------------
+# Background reclaimer
+
+add_catch(test_reclaimer reclaimer/test.cpp)
+
+# ------------------------------------------------------------------------------
+# Epoch-based reclamation
+
+add_catch(test_ebr ebr/test.cpp)
+
+# ------------------------------------------------------------------------------
+# Hazard pointers
+
+add_catch(test_hazard hazard/test.cpp)
+
 # ------------------------------------------------------------------------------
 # IntrusivePtr
 
 add_catch(test_intrusive intrusive/test.cpp)
 target_compile_options(test_intrusive PRIVATE -Wno-self-assign-overloaded -Wno-self-move)
+
+# ------------------------------------------------------------------------------
+# Persistent collections
+
+add_catch(test_persistent
+        persistent/test.cpp
+        persistent/test_map.cpp)
+
+# ------------------------------------------------------------------------------
+# Interner
+
+add_catch(test_interner interner/test.cpp)
+
+# ------------------------------------------------------------------------------
+# Lifecycle tracing
+
+add_catch(test_trace trace/test.cpp)
+target_compile_definitions(test_trace PRIVATE SMART_PTRS_TRACE)
+
+# ------------------------------------------------------------------------------
+# Live block registry
+
+add_catch(test_registry registry/test.cpp)
+target_compile_definitions(test_registry PRIVATE SMART_PTRS_REGISTRY)
+
+# ------------------------------------------------------------------------------
+# Lifetime histograms
+
+add_catch(test_lifetime lifetime/test.cpp)
+target_compile_definitions(test_lifetime PRIVATE SMART_PTRS_LIFETIME)
+
+# ------------------------------------------------------------------------------
+# Arena
+
+add_catch(test_arena arena/test.cpp)
+target_compile_definitions(test_arena PRIVATE SMART_PTRS_ARENA_DEBUG)
+
+# ------------------------------------------------------------------------------
+# Interprocess SharedPtr
+
+add_catch(test_interprocess interprocess/test.cpp)
+
+# ------------------------------------------------------------------------------
+# Offset pointers
+
+add_catch(test_offset offset/test.cpp)
+
+# ------------------------------------------------------------------------------
+# Graph serialization
+
+add_catch(test_serialize serialize/test.cpp)
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "../weak/shared.h"
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// Copy-on-write value: copies share one `T`, and `Mutate()` clones it only if it is shared.
+//
+// Checking `UseCount() == 1` is enough even with other threads around: the reference never
+// leaves the `Cow`, so the count can only grow through a copy of this very `Cow`, and a copy
+// racing with `Mutate()` is a data race on the `Cow` itself. The count is read with acquire,
+// so whatever the other owners did with the value happens before it is mutated in place. A
+// count that is too high (for example, releases pending in a `DeferredReleaseScope`) only
+// costs an extra clone.
+//
+// A moved-from `Cow` may only be assigned to or destroyed.
+template <typename T>
+class Cow {
+    // Such a `T` could hand out references to itself behind the count's back.
+    static_assert(!std::is_convertible_v<T*, EnableSharedFromThisBase*>);
+
+public:
+    Cow() : value_(MakeShared<T>()) {
+    }
+
+    explicit Cow(T value) : value_(MakeShared<T>(std::move(value))) {
+    }
+
+    template <typename... Args>
+    explicit Cow(std::in_place_t, Args&&... args)
+        : value_(MakeShared<T>(std::forward<Args>(args)...)) {
+    }
+
+    const T& Get() const {
+        return *value_;
+    }
+
+    const T& operator*() const {
+        return *value_;
+    }
+
+    const T* operator->() const {
+        return value_.Get();
+    }
+
+    // Do not keep the reference across a copy of the `Cow`, writes through it would show in the
+    // copy.
+    T& Mutate() {
+        if (!IsUnique()) {
+            value_ = MakeShared<T>(std::as_const(*value_));
+        }
+        return *value_;
+    }
+
+    bool IsUnique() const {
+        return value_.UseCount() == 1;
+    }
+
+    size_t UseCount() const {
+        return value_.UseCount();
+    }
+
+private:
+    SharedPtr<T> value_;
+};
@@ -0,0 +1,121 @@
+#include "cow.h"
+
+#include "allocations_checker.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+using Map = std::map<std::string, int>;
+
+TEST_CASE("Cow") {
+    Cow<Map> a(Map{{"one", 1}, {"two", 2}});
+
+    SECTION("Copies share") {
+        Cow<Map> b = a;
+        REQUIRE(&*a == &*b);
+        REQUIRE(a.UseCount() == 2);
+        REQUIRE(!a.IsUnique());
+    }
+
+    SECTION("Mutation of a shared value clones") {
+        Cow<Map> b = a;
+        b.Mutate()["three"] = 3;
+        REQUIRE(a->size() == 2);
+        REQUIRE(b->size() == 3);
+        REQUIRE(a.IsUnique());
+        REQUIRE(b.IsUnique());
+    }
+
+    SECTION("Unique value is mutated in place") {
+        const Map* before = &a.Get();
+        a.Mutate()["one"] = 10;
+        REQUIRE(&a.Get() == before);
+        REQUIRE(a->at("one") == 10);
+    }
+
+    SECTION("Clone after the other copy is gone") {
+        const Map* before = &a.Get();
+        {
+            Cow<Map> b = a;
+        }
+        a.Mutate().erase("one");
+        REQUIRE(&a.Get() == before);
+    }
+
+    SECTION("Assignment") {
+        Cow<Map> b;
+        REQUIRE(b->empty());
+        b = a;
+        REQUIRE(&*a == &*b);
+        b = Cow<Map>(std::in_place, Map{{"x", 0}});
+        REQUIRE(a.IsUnique());
+        REQUIRE(b->count("x") == 1);
+    }
+}
+
+TEST_CASE("Cow allocations") {
+    Cow<std::vector<int>> a(std::in_place, 100, 0);
+
+    SECTION("Unique owner mutates without allocating") {
+        EXPECT_ZERO_ALLOCATIONS(a.Mutate()[0] = 1);
+        EXPECT_ZERO_ALLOCATIONS({
+            for (int i = 0; i < 100; ++i) {
+                a.Mutate()[i] = i;
+            }
+        });
+    }
+
+    SECTION("Copies do not allocate") {
+        EXPECT_ZERO_ALLOCATIONS({
+            Cow<std::vector<int>> b = a;
+            Cow<std::vector<int>> c = std::move(b);
+        });
+    }
+
+    SECTION("Shared value is cloned once") {
+        Cow<std::vector<int>> b = a;
+        // The control block with the vector, then the vector's buffer.
+        auto before = alloc_checker::AllocCount();
+        b.Mutate()[0] = 1;
+        REQUIRE(alloc_checker::AllocCount() == before + 2);
+        EXPECT_ZERO_ALLOCATIONS(b.Mutate()[1] = 1);
+        REQUIRE(a.Get()[0] == 0);
+    }
+}
+
+// Run under TSan: cmake -DCMAKE_BUILD_TYPE=TSAN
+TEST_CASE("Cow across threads") {
+    constexpr int kThreads = 4;
+    constexpr int kRounds = 1000;
+
+    Cow<std::vector<int>> shared(std::in_place, 16, 0);
+    std::atomic<int> wrong = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&wrong, copy = shared, t]() mutable {
+            for (int i = 0; i < kRounds; ++i) {
+                Cow<std::vector<int>> next = copy;
+                next.Mutate()[t] = i;
+                copy = std::move(next);
+            }
+            if (copy.Get()[t] != kRounds - 1) {
+                wrong.fetch_add(1);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(shared.IsUnique());
+    for (int value : shared.Get()) {
+        REQUIRE(value == 0);
+    }
+}
@@ -0,0 +1,410 @@
+#pragma once
+
+#include "../weak/shared.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Visits the `SharedPtr` fields of an object. Objects created with `MakeCollected` report them
+// from `void Trace(Tracer& tracer) const`, calling `tracer(field)` for each one; weak references
+// are not reported.
+class Tracer {
+public:
+    template <typename Visit>
+    explicit Tracer(Visit& visit)
+        : context_(&visit), visit_([](void* context, ControlBlock* block) {
+              (*static_cast<Visit*>(context))(block);
+          }) {
+    }
+
+    template <typename U>
+    void operator()(const SharedPtr<U>& ptr) {
+        if (ptr.GetControl() != nullptr) {
+            visit_(context_, ptr.GetControl());
+        }
+    }
+
+private:
+    void* context_;
+    void (*visit_)(void*, ControlBlock*);
+};
+
+class CycleCollector;
+
+// Collector bookkeeping of a block created with `MakeCollected`. Everything but `buffered_` is
+// only touched by the collector under its lock.
+class CollectedNode {
+public:
+    explicit CollectedNode(CycleCollector* collector, ControlBlock* control)
+        : collector_(collector), control_(control) {
+    }
+
+    CollectedNode(const CollectedNode&) = delete;
+    CollectedNode& operator=(const CollectedNode&) = delete;
+
+protected:
+    virtual ~CollectedNode() = default;
+
+    virtual void TraceObject(Tracer& tracer) = 0;
+
+    // Destroys the object of a garbage cycle, whose count is held up by the collector.
+    virtual void DestroyCollected() = 0;
+
+    // Drops the count held up by the collector without destroying the object again.
+    virtual void Discard() = 0;
+
+    CycleCollector* const collector_;
+
+private:
+    enum class Color {
+        // Not part of the current round.
+        kNone,
+        // Reached by trial deletion, `trial_` is its count minus references from the round.
+        kGray,
+        // Candidate garbage.
+        kWhite,
+        // Referenced from outside the round.
+        kBlack,
+    };
+
+    ControlBlock* const control_;
+    std::atomic<bool> buffered_ = false;
+    Color color_ = Color::kNone;
+    int trial_ = 0;
+
+    friend CycleCollector;
+};
+
+// Trial-deletion cycle collector in the style of Bacon and Rajan. A strong release that leaves
+// an object created with `MakeCollected` alive buffers its block as a possible root of a garbage
+// cycle. A round takes the buffered roots and subtracts the references among the objects
+// reachable from them: whatever is left with a zero count is referenced only from within the
+// round, that is, from garbage cycles.
+//
+// `Collect(budget)` runs a round in slices of bounded time, the graph may change between slices.
+// The last step therefore checks the candidates against their current counts and edges before
+// destroying anything, and is not sliced. A round never runs concurrently with mutation of the
+// graph it traces: call `Collect` where no other thread changes the collected objects.
+// References through objects not created with `MakeCollected` are opaque to the collector, and
+// cycles through them are not found. The collector must outlive the objects created with it.
+class CycleCollector {
+public:
+    struct Stats {
+        // Blocks buffered as possible roots.
+        size_t possible_roots = 0;
+
+        size_t rounds = 0;
+        size_t slices = 0;
+        size_t collected = 0;
+    };
+
+    CycleCollector() = default;
+
+    CycleCollector(const CycleCollector&) = delete;
+    CycleCollector& operator=(const CycleCollector&) = delete;
+
+    ~CycleCollector() {
+        Collect();
+    }
+
+    // Runs rounds until no roots are buffered.
+    void Collect() {
+        while (!Collect(Clock::time_point::max()) || PendingRoots() != 0) {
+        }
+    }
+
+    // Works on the current round, or starts one on the buffered roots, for about `budget`.
+    // Returns true once the round is done.
+    bool Collect(std::chrono::nanoseconds budget) {
+        return Collect(Clock::now() + budget);
+    }
+
+    size_t PendingRoots() const {
+        std::lock_guard lock(roots_mutex_);
+        return pending_.size();
+    }
+
+    Stats GetStats() const {
+        std::lock_guard lock(mutex_);
+        Stats stats = stats_;
+        std::lock_guard roots_lock(roots_mutex_);
+        stats.possible_roots = possible_roots_;
+        return stats;
+    }
+
+    // Called from `DecreaseCustom` on any thread.
+    void Buffer(CollectedNode* node) {
+        if (node->buffered_.exchange(true, std::memory_order_relaxed)) {
+            return;
+        }
+        node->control_->IncreaseWeakCounter();
+        std::lock_guard lock(roots_mutex_);
+        pending_.push_back(node);
+        ++possible_roots_;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using Color = CollectedNode::Color;
+
+    // Units of work between clock reads.
+    static constexpr size_t kCheckEvery = 32;
+
+    enum class Phase {
+        kIdle,
+        kMarkGray,
+        kScan,
+    };
+
+    bool Collect(Clock::time_point deadline) {
+        std::lock_guard lock(mutex_);
+        ++stats_.slices;
+        if (phase_ == Phase::kIdle && !StartRound()) {
+            return true;
+        }
+        for (size_t work = 1;; ++work) {
+            if (phase_ == Phase::kMarkGray) {
+                if (stack_.empty()) {
+                    stack_ = roots_;
+                    phase_ = Phase::kScan;
+                } else {
+                    MarkGrayStep();
+                }
+            } else if (black_stack_.empty() && stack_.empty()) {
+                FinishRound();
+                return true;
+            } else {
+                ScanStep();
+            }
+            if (work % kCheckEvery == 0 && Clock::now() >= deadline) {
+                return false;
+            }
+        }
+    }
+
+    bool StartRound() {
+        std::vector<CollectedNode*> pending;
+        {
+            std::lock_guard lock(roots_mutex_);
+            pending.swap(pending_);
+        }
+        for (CollectedNode* node : pending) {
+            node->buffered_.store(false, std::memory_order_relaxed);
+            if (IsAlive(node)) {
+                Gray(node);
+                roots_.push_back(node);
+            }
+            node->control_->DecreaseWeakCounter();
+        }
+        if (roots_.empty()) {
+            return false;
+        }
+        ++stats_.rounds;
+        stack_ = roots_;
+        phase_ = Phase::kMarkGray;
+        return true;
+    }
+
+    // Takes a weak reference for the rest of the round, so that the block survives the object
+    // dying between slices.
+    void Gray(CollectedNode* node) {
+        node->control_->IncreaseWeakCounter();
+        node->color_ = Color::kGray;
+        node->trial_ = node->control_->GetSharedCounter();
+        nodes_.push_back(node);
+    }
+
+    void MarkGrayStep() {
+        CollectedNode* node = Pop(stack_);
+        ForEachChild(node, [this](CollectedNode* child) {
+            if (child->color_ == Color::kNone) {
+                Gray(child);
+                stack_.push_back(child);
+            }
+            --child->trial_;
+        });
+    }
+
+    void ScanStep() {
+        if (!black_stack_.empty()) {
+            ForEachChild(Pop(black_stack_), [this](CollectedNode* child) {
+                if (child->color_ == Color::kNone) {
+                    return;
+                }
+                ++child->trial_;
+                if (child->color_ != Color::kBlack) {
+                    child->color_ = Color::kBlack;
+                    black_stack_.push_back(child);
+                }
+            });
+            return;
+        }
+        CollectedNode* node = Pop(stack_);
+        if (node->color_ != Color::kGray) {
+            return;
+        }
+        if (node->trial_ > 0 || !IsAlive(node)) {
+            node->color_ = Color::kBlack;
+            black_stack_.push_back(node);
+            return;
+        }
+        node->color_ = Color::kWhite;
+        ForEachChild(node, [this](CollectedNode* child) {
+            if (child->color_ == Color::kGray) {
+                stack_.push_back(child);
+            }
+        });
+    }
+
+    // The candidates were found on a graph that may have changed since: repeats trial deletion
+    // among them on their current counts and keeps only the ones nothing else references.
+    void FinishRound() {
+        std::vector<CollectedNode*> white;
+        for (CollectedNode* node : nodes_) {
+            if (node->color_ != Color::kWhite) {
+                continue;
+            }
+            if (IsAlive(node)) {
+                node->trial_ = node->control_->GetSharedCounter();
+                white.push_back(node);
+            } else {
+                node->color_ = Color::kBlack;
+            }
+        }
+        for (CollectedNode* node : white) {
+            ForEachChild(node, [](CollectedNode* child) {
+                if (child->color_ == Color::kWhite) {
+                    --child->trial_;
+                }
+            });
+        }
+        for (CollectedNode* node : white) {
+            if (node->color_ == Color::kWhite && node->trial_ > 0) {
+                node->color_ = Color::kBlack;
+                black_stack_.push_back(node);
+            }
+        }
+        while (!black_stack_.empty()) {
+            ForEachChild(Pop(black_stack_), [this](CollectedNode* child) {
+                if (child->color_ == Color::kWhite) {
+                    child->color_ = Color::kBlack;
+                    black_stack_.push_back(child);
+                }
+            });
+        }
+
+        std::vector<CollectedNode*> garbage;
+        for (CollectedNode* node : white) {
+            if (node->color_ == Color::kWhite) {
+                garbage.push_back(node);
+            }
+        }
+        // Pinned, so that destructors releasing each other do not destroy any of them twice,
+        // and marked as buffered, so that those releases do not buffer them again.
+        for (CollectedNode* node : garbage) {
+            node->buffered_.store(true, std::memory_order_relaxed);
+            node->control_->IncreaseSharedCounter();
+        }
+        for (CollectedNode* node : garbage) {
+            node->DestroyCollected();
+        }
+        for (CollectedNode* node : garbage) {
+            node->Discard();
+        }
+        stats_.collected += garbage.size();
+
+        for (CollectedNode* node : nodes_) {
+            node->color_ = Color::kNone;
+            node->control_->DecreaseWeakCounter();
+        }
+        nodes_.clear();
+        roots_.clear();
+        phase_ = Phase::kIdle;
+    }
+
+    template <typename Visit>
+    static void ForEachChild(CollectedNode* node, Visit visit) {
+        if (!IsAlive(node)) {
+            return;
+        }
+        auto visit_block = [&visit](ControlBlock* block) {
+            if (auto* child = dynamic_cast<CollectedNode*>(block)) {
+                visit(child);
+            }
+        };
+        Tracer tracer(visit_block);
+        node->TraceObject(tracer);
+    }
+
+    static bool IsAlive(const CollectedNode* node) {
+        return node->control_->GetSharedCounter() != 0;
+    }
+
+    static CollectedNode* Pop(std::vector<CollectedNode*>& stack) {
+        CollectedNode* node = stack.back();
+        stack.pop_back();
+        return node;
+    }
+
+    mutable std::mutex mutex_;
+    Phase phase_ = Phase::kIdle;
+    std::vector<CollectedNode*> roots_;
+    std::vector<CollectedNode*> nodes_;
+    std::vector<CollectedNode*> stack_;
+    std::vector<CollectedNode*> black_stack_;
+    Stats stats_;
+
+    mutable std::mutex roots_mutex_;
+    std::vector<CollectedNode*> pending_;
+    size_t possible_roots_ = 0;
+};
+
+template <typename T>
+class CollectedControlBlock : public ControlBlockObject<T>, public CollectedNode {
+public:
+    template <typename... Args>
+    explicit CollectedControlBlock(CycleCollector* collector, Args&&... args)
+        : ControlBlockObject<T>(std::forward<Args>(args)...), CollectedNode(collector, this) {
+        this->shared_counter_.store(ControlBlock::kCustomCounter | 1, std::memory_order_relaxed);
+    }
+
+protected:
+    // A release that leaves the object alive buffers it as a possible root. The weak reference
+    // keeps the block alive for that if another thread drops the last strong reference meanwhile.
+    void DecreaseCustom(int count) override {
+        this->IncreaseWeakCounter();
+        int old = this->shared_counter_.fetch_sub(count, std::memory_order_acq_rel);
+        if ((old & ControlBlock::kCountMask) == count) {
+            this->ReleaseObject();
+        } else {
+            collector_->Buffer(this);
+        }
+        this->DecreaseWeakCounter();
+    }
+
+    void TraceObject(Tracer& tracer) override {
+        static_cast<const T*>(this->GetObject())->Trace(tracer);
+    }
+
+    void DestroyCollected() override {
+        SMART_PTRS_TRACE_EVENT(kZero, kShared, static_cast<ControlBlock*>(this));
+        ControlBlockObject<T>::DestroyObject();
+    }
+
+    void Discard() override {
+        this->shared_counter_.store(ControlBlock::kCustomCounter, std::memory_order_relaxed);
+        this->DecreaseWeakCounter();
+    }
+};
+
+// Like `MakeShared<T>(args...)`, but garbage cycles through the object are destroyed by
+// `collector`. `T` reports its `SharedPtr` fields from `void Trace(Tracer& tracer) const`.
+template <typename T, typename... Args>
+SharedPtr<T> MakeCollected(CycleCollector& collector, Args&&... args) {
+    auto* block = new CollectedControlBlock<T>(&collector, std::forward<Args>(args)...);
+    return AdoptShared(block->GetObject(), block);
+}
@@ -0,0 +1,219 @@
+#include "cycles.h"
+
+#include "../weak/weak.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node {
+    static std::atomic<int> alive;
+
+    Node() {
+        ++alive;
+    }
+
+    ~Node() {
+        --alive;
+    }
+
+    void Trace(Tracer& tracer) const {
+        for (const auto& child : children) {
+            tracer(child);
+        }
+    }
+
+    std::vector<SharedPtr<Node>> children;
+};
+
+std::atomic<int> Node::alive = 0;
+
+// Not traced: a plain `SharedPtr` object held by collected ones.
+struct Leaf {
+    static int alive;
+
+    Leaf() {
+        ++alive;
+    }
+
+    ~Leaf() {
+        --alive;
+    }
+};
+
+int Leaf::alive = 0;
+
+struct Document {
+    void Trace(Tracer& tracer) const {
+        tracer(root);
+        tracer(self);
+    }
+
+    SharedPtr<Node> root;
+    SharedPtr<Leaf> leaf;
+    SharedPtr<Document> self;
+};
+
+SharedPtr<Node> MakeRing(CycleCollector& collector, int size) {
+    auto head = MakeCollected<Node>(collector);
+    auto tail = head;
+    for (int i = 1; i < size; ++i) {
+        auto node = MakeCollected<Node>(collector);
+        tail->children.push_back(node);
+        tail = node;
+    }
+    tail->children.push_back(head);
+    return head;
+}
+
+}  // namespace
+
+TEST_CASE("Cycle collector") {
+    Node::alive = 0;
+    Leaf::alive = 0;
+    CycleCollector collector;
+
+    SECTION("Parent and child") {
+        {
+            auto parent = MakeCollected<Node>(collector);
+            auto child = MakeCollected<Node>(collector);
+            parent->children.push_back(child);
+            child->children.push_back(parent);
+        }
+        REQUIRE(Node::alive == 2);
+        REQUIRE(collector.PendingRoots() == 2);
+        collector.Collect();
+        REQUIRE(Node::alive == 0);
+
+        auto stats = collector.GetStats();
+        REQUIRE(stats.collected == 2);
+        REQUIRE(stats.possible_roots == 2);
+        REQUIRE(collector.PendingRoots() == 0);
+    }
+
+    SECTION("Self loop") {
+        {
+            auto node = MakeCollected<Node>(collector);
+            node->children.push_back(node);
+        }
+        collector.Collect();
+        REQUIRE(Node::alive == 0);
+    }
+
+    SECTION("Reachable cycles survive") {
+        auto ring = MakeRing(collector, 10);
+        // Dropping a temporary copy buffers the ring head.
+        SharedPtr<Node>(ring).Reset();
+        collector.Collect();
+        REQUIRE(Node::alive == 10);
+        REQUIRE(collector.GetStats().collected == 0);
+
+        WeakPtr<Node> weak(ring);
+        ring.Reset();
+        collector.Collect();
+        REQUIRE(Node::alive == 0);
+        REQUIRE(weak.Expired());
+    }
+
+    SECTION("Acyclic garbage is freed without the collector") {
+        auto node = MakeCollected<Node>(collector);
+        node->children.push_back(MakeCollected<Node>(collector));
+        node.Reset();
+        REQUIRE(Node::alive == 0);
+        collector.Collect();
+        REQUIRE(collector.GetStats().collected == 0);
+    }
+
+    SECTION("Untraced members") {
+        {
+            auto document = MakeCollected<Document>(collector);
+            document->root = MakeRing(collector, 3);
+            document->root->children.push_back(MakeRing(collector, 3));
+            document->leaf = MakeShared<Leaf>();
+            document->self = document;
+        }
+        REQUIRE(Node::alive == 6);
+        REQUIRE(Leaf::alive == 1);
+        collector.Collect();
+        REQUIRE(Node::alive == 0);
+        REQUIRE(Leaf::alive == 0);
+    }
+}
+
+TEST_CASE("Cycle collector slices") {
+    Node::alive = 0;
+    CycleCollector collector;
+
+    SECTION("Bounded slices") {
+        MakeRing(collector, 10000);
+        REQUIRE(Node::alive == 10000);
+        size_t slices = 1;
+        while (!collector.Collect(std::chrono::nanoseconds(0))) {
+            ++slices;
+        }
+        REQUIRE(slices > 1);
+        REQUIRE(Node::alive == 0);
+        REQUIRE(collector.GetStats().slices == slices);
+    }
+
+    SECTION("Graph changes between slices") {
+        WeakPtr<Node> weak = MakeRing(collector, 1000);
+        REQUIRE(!collector.Collect(std::chrono::nanoseconds(0)));
+        // Resurrected from a weak reference in the middle of the round.
+        auto ring = weak.Lock();
+        REQUIRE(ring);
+        collector.Collect();
+        REQUIRE(Node::alive == 1000);
+
+        ring->children.clear();
+        ring.Reset();
+        REQUIRE(Node::alive == 0);
+    }
+
+    SECTION("Edges change between slices") {
+        auto ring = MakeRing(collector, 1000);
+        auto other = MakeRing(collector, 1000);
+        SharedPtr<Node>(ring).Reset();
+        REQUIRE(!collector.Collect(std::chrono::nanoseconds(0)));
+        // The only outside reference moves into another live ring.
+        other->children.push_back(ring);
+        ring.Reset();
+        collector.Collect();
+        REQUIRE(Node::alive == 2000);
+
+        other.Reset();
+        collector.Collect();
+        REQUIRE(Node::alive == 0);
+    }
+}
+
+// Run under TSan: cmake -DCMAKE_BUILD_TYPE=TSAN
+TEST_CASE("Possible roots from many threads") {
+    constexpr int kThreads = 4;
+    constexpr int kRings = 200;
+
+    Node::alive = 0;
+    CycleCollector collector;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < kRings; ++i) {
+                MakeRing(collector, 3);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(collector.PendingRoots() == 3 * kThreads * kRings);
+    collector.Collect();
+    REQUIRE(Node::alive == 0);
+    REQUIRE(collector.GetStats().collected == 3 * kThreads * kRings);
+}
@@ -0,0 +1,295 @@
+#pragma once
+
+#include "../intrusive/intrusive.h"
+#include "../weak/shared.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Epoch-based reclamation: readers traverse a structure inside a `Guard` without touching
+// reference counts, writers unlink nodes and `Retire` the owning handles. A retired handle is
+// released once every thread that could still see the node has left its guard.
+//
+// A thread inside a guard announces the global epoch it observed. The epoch advances only when
+// every announcing thread has caught up with it, so a handle retired in epoch `e` is released
+// once the global epoch reaches `e + 2`.
+//
+// The domain must outlive the readers and writers using it, except that threads may still exit
+// after it is gone. `Default()` is never destroyed.
+class EbrDomain {
+    struct Record;
+    struct State;
+
+public:
+    // A thread tries to advance the epoch and release its retired handles after retiring
+    // this many.
+    static constexpr size_t kCollectThreshold = 64;
+
+    class Guard {
+    public:
+        explicit Guard(EbrDomain& domain = Default())
+            : state_(domain.state_), record_(LocalRecord(state_)) {
+            if (record_->nesting++ == 0) {
+                // Announcing an epoch that is already stale would let the writers free nodes
+                // this reader can still reach, so retry until the announcement is current.
+                uint64_t epoch = state_->epoch.load(std::memory_order_relaxed);
+                while (true) {
+                    // A full barrier: the announcement is visible before any load of the structure.
+                    record_->epoch.exchange(epoch, std::memory_order_seq_cst);
+                    uint64_t current = state_->epoch.load(std::memory_order_seq_cst);
+                    if (current == epoch) {
+                        break;
+                    }
+                    epoch = current;
+                }
+            }
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+        ~Guard() {
+            if (--record_->nesting == 0) {
+                record_->epoch.store(kQuiescent, std::memory_order_release);
+            }
+        }
+
+    private:
+        State* state_;
+        Record* record_;
+    };
+
+    EbrDomain() : state_(new State) {
+    }
+
+    EbrDomain(const EbrDomain&) = delete;
+    EbrDomain& operator=(const EbrDomain&) = delete;
+
+    // Releases the handles retired by the calling thread and by exited threads right away,
+    // handles of other threads are released when they exit.
+    ~EbrDomain() {
+        state_->closed.store(true, std::memory_order_release);
+        ReleaseIf(LocalRecord(state_)->limbo, [](const Retired&) { return true; });
+        ReleaseOrphans([](const Retired&) { return true; });
+        Unref(state_);
+    }
+
+    template <typename T>
+    void Retire(SharedPtr<T> ptr) {
+        RetireHandle(std::move(ptr));
+    }
+
+    template <typename T>
+    void Retire(IntrusivePtr<T> ptr) {
+        RetireHandle(std::move(ptr));
+    }
+
+    // Advances the epoch if readers allow it and releases what became safe.
+    void Collect() {
+        TryAdvance();
+        uint64_t epoch = state_->epoch.load(std::memory_order_acquire);
+        auto safe = [epoch](const Retired& retired) { return retired.epoch + 2 <= epoch; };
+        ReleaseIf(LocalRecord(state_)->limbo, safe);
+        ReleaseOrphans(safe);
+    }
+
+    // Waits for readers and releases every handle retired so far by the calling thread and by
+    // exited threads. Must not be called inside a guard.
+    void Synchronize() {
+        uint64_t target = state_->epoch.load(std::memory_order_seq_cst) + 2;
+        while (state_->epoch.load(std::memory_order_acquire) < target) {
+            if (!TryAdvance()) {
+                std::this_thread::yield();
+            }
+        }
+        Collect();
+    }
+
+    // Handles retired and not released yet, by all threads.
+    size_t PendingCount() const {
+        return state_->pending.load(std::memory_order_relaxed);
+    }
+
+    static EbrDomain& Default() {
+        static auto* domain = new EbrDomain();
+        return *domain;
+    }
+
+private:
+    static constexpr uint64_t kQuiescent = 0;
+
+    // A retired handle, type-erased: the handle itself lives in `storage` and is moved around
+    // bitwise, which is fine for `SharedPtr` and `IntrusivePtr`.
+    struct Retired {
+        alignas(void*) unsigned char storage[2 * sizeof(void*)];
+        void (*release)(void*);
+        uint64_t epoch;
+    };
+
+    struct alignas(64) Record {
+        // Epoch announced by the owner inside a guard, `kQuiescent` outside.
+        std::atomic<uint64_t> epoch = kQuiescent;
+        std::atomic<bool> in_use = true;
+        Record* next = nullptr;
+
+        // Touched by the owner thread only.
+        size_t nesting = 0;
+        std::vector<Retired> limbo;
+    };
+
+    struct State {
+        ~State() {
+            for (Record* record = records.load(); record != nullptr;) {
+                delete std::exchange(record, record->next);
+            }
+        }
+
+        std::atomic<uint64_t> epoch = 1;
+        std::atomic<Record*> records = nullptr;
+        std::atomic<size_t> pending = 0;
+        std::atomic<bool> closed = false;
+
+        // Handles left behind by exited threads.
+        std::mutex orphans_mutex;
+        std::vector<Retired> orphans;
+
+        // The domain and every thread that has used it.
+        std::atomic<int> refs = 1;
+    };
+
+    // Records of the calling thread, one per domain, given back when the thread exits.
+    struct ThreadRecords {
+        ~ThreadRecords() {
+            for (auto [state, record] : entries) {
+                if (state->closed.load(std::memory_order_acquire)) {
+                    ReleaseAll(state, record->limbo);
+                } else if (!record->limbo.empty()) {
+                    std::lock_guard lock(state->orphans_mutex);
+                    state->orphans.insert(state->orphans.end(), record->limbo.begin(),
+                                          record->limbo.end());
+                    record->limbo.clear();
+                }
+                record->in_use.store(false, std::memory_order_release);
+                Unref(state);
+            }
+        }
+
+        std::vector<std::pair<State*, Record*>> entries;
+    };
+
+    static Record* LocalRecord(State* state) {
+        thread_local ThreadRecords records;
+        for (auto [known, record] : records.entries) {
+            if (known == state) {
+                return record;
+            }
+        }
+        Record* record = AcquireRecord(state);
+        state->refs.fetch_add(1, std::memory_order_relaxed);
+        records.entries.emplace_back(state, record);
+        return record;
+    }
+
+    // Reuses a record of an exited thread or adds a new one; records are never unlinked.
+    static Record* AcquireRecord(State* state) {
+        for (Record* record = state->records.load(std::memory_order_acquire); record != nullptr;
+             record = record->next) {
+            bool free = false;
+            if (!record->in_use.load(std::memory_order_relaxed) &&
+                record->in_use.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+                return record;
+            }
+        }
+        auto* record = new Record();
+        record->next = state->records.load(std::memory_order_relaxed);
+        while (!state->records.compare_exchange_weak(record->next, record,
+                                                     std::memory_order_release)) {
+        }
+        return record;
+    }
+
+    static void Unref(State* state) {
+        if (state->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete state;
+        }
+    }
+
+    // Fails if some thread inside a guard has not observed the current epoch yet.
+    bool TryAdvance() {
+        uint64_t epoch = state_->epoch.load(std::memory_order_seq_cst);
+        for (Record* record = state_->records.load(std::memory_order_acquire); record != nullptr;
+             record = record->next) {
+            uint64_t announced = record->epoch.load(std::memory_order_seq_cst);
+            if (announced != kQuiescent && announced != epoch) {
+                return false;
+            }
+        }
+        return state_->epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_acq_rel);
+    }
+
+    template <typename Ptr>
+    void RetireHandle(Ptr ptr) {
+        static_assert(sizeof(Ptr) <= sizeof(Retired::storage));
+        Record* record = LocalRecord(state_);
+        Retired retired;
+        new (retired.storage) Ptr(std::move(ptr));
+        retired.release = [](void* storage) { static_cast<Ptr*>(storage)->~Ptr(); };
+        // Ordered after the caller unlinked the node.
+        retired.epoch = state_->epoch.load(std::memory_order_seq_cst);
+        record->limbo.push_back(retired);
+        state_->pending.fetch_add(1, std::memory_order_relaxed);
+        if (record->limbo.size() % kCollectThreshold == 0) {
+            Collect();
+        }
+    }
+
+    // Releasing a handle may run destructors that retire more handles, so the released ones are
+    // taken out of `retired` first.
+    template <typename Predicate>
+    void ReleaseIf(std::vector<Retired>& retired, Predicate safe) {
+        std::vector<Retired> ready;
+        size_t kept = 0;
+        for (const Retired& item : retired) {
+            if (safe(item)) {
+                ready.push_back(item);
+            } else {
+                retired[kept++] = item;
+            }
+        }
+        retired.resize(kept);
+        ReleaseAll(state_, ready);
+    }
+
+    template <typename Predicate>
+    void ReleaseOrphans(Predicate safe) {
+        std::vector<Retired> orphans;
+        {
+            std::unique_lock lock(state_->orphans_mutex, std::try_to_lock);
+            if (!lock || state_->orphans.empty()) {
+                return;
+            }
+            orphans.swap(state_->orphans);
+        }
+        ReleaseIf(orphans, safe);
+        if (!orphans.empty()) {
+            std::lock_guard lock(state_->orphans_mutex);
+            state_->orphans.insert(state_->orphans.end(), orphans.begin(), orphans.end());
+        }
+    }
+
+    static void ReleaseAll(State* state, std::vector<Retired>& retired) {
+        for (Retired& item : retired) {
+            item.release(item.storage);
+        }
+        state->pending.fetch_sub(retired.size(), std::memory_order_relaxed);
+        retired.clear();
+    }
+
+    State* state_;
+};
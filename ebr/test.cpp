@@ -0,0 +1,133 @@
+#include "ebr.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Config {
+    static std::atomic<int> alive;
+
+    explicit Config(int version) : version(version), check(version) {
+        alive.fetch_add(1);
+    }
+
+    ~Config() {
+        check = -1;
+        alive.fetch_sub(1);
+    }
+
+    int version;
+    int check;
+};
+
+std::atomic<int> Config::alive = 0;
+
+struct Node : AtomicRefCounted<Node> {
+    static std::atomic<int> alive;
+
+    Node() {
+        alive.fetch_add(1);
+    }
+
+    ~Node() {
+        alive.fetch_sub(1);
+    }
+};
+
+std::atomic<int> Node::alive = 0;
+
+}  // namespace
+
+TEST_CASE("Retire") {
+    EbrDomain domain;
+
+    SECTION("Deferred while a reader is inside a guard") {
+        auto config = MakeShared<Config>(1);
+        EbrDomain::Guard guard(domain);
+        domain.Retire(std::move(config));
+        domain.Collect();
+        domain.Collect();
+        REQUIRE(Config::alive == 1);
+        REQUIRE(domain.PendingCount() == 1);
+    }
+
+    SECTION("Released after readers leave") {
+        {
+            EbrDomain::Guard guard(domain);
+            domain.Retire(MakeShared<Config>(1));
+            domain.Retire(MakeIntrusive<Node>());
+        }
+        domain.Synchronize();
+        REQUIRE(Config::alive == 0);
+        REQUIRE(Node::alive == 0);
+        REQUIRE(domain.PendingCount() == 0);
+    }
+
+    SECTION("Only the last reference is deferred") {
+        auto config = MakeShared<Config>(1);
+        domain.Retire(config);
+        domain.Synchronize();
+        REQUIRE(Config::alive == 1);
+        REQUIRE(config.UseCount() == 1);
+    }
+
+    SECTION("Exited threads") {
+        std::thread([&] { domain.Retire(MakeShared<Config>(1)); }).join();
+        REQUIRE(Config::alive == 1);
+        domain.Synchronize();
+        REQUIRE(Config::alive == 0);
+    }
+}
+
+TEST_CASE("Destroying the domain releases everything") {
+    {
+        EbrDomain domain;
+        domain.Retire(MakeShared<Config>(1));
+    }
+    REQUIRE(Config::alive == 0);
+}
+
+// Readers dereference the published raw pointer without touching its reference count.
+TEST_CASE("EBR stress") {
+    constexpr int kReaders = 3;
+    constexpr int kUpdates = 2000;
+
+    EbrDomain domain;
+    SharedPtr<Config> owner = MakeShared<Config>(0);
+    std::atomic<Config*> published = owner.Get();
+    std::atomic<bool> done = false;
+    std::atomic<int> torn = 0;
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < kReaders; ++i) {
+        readers.emplace_back([&] {
+            while (!done.load()) {
+                EbrDomain::Guard guard(domain);
+                Config* config = published.load(std::memory_order_acquire);
+                if (config->check != config->version) {
+                    torn.fetch_add(1);
+                }
+            }
+        });
+    }
+
+    for (int version = 1; version <= kUpdates; ++version) {
+        auto next = MakeShared<Config>(version);
+        published.store(next.Get(), std::memory_order_release);
+        domain.Retire(std::exchange(owner, std::move(next)));
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    domain.Synchronize();
+    REQUIRE(torn == 0);
+    REQUIRE(Config::alive == 1);
+}
@@ -0,0 +1,372 @@
+#pragma once
+
+#include "../weak/shared.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Hazard pointers: a reader publishes the pointer it is about to dereference in one of its
+// hazard slots, and writers free retired memory only if no slot holds it.
+//
+// Unlike epochs, a stalled reader pins only what it protects. Each thread scans its retired
+// list once it holds `kScanThreshold` more entries than there are hazard slots in the domain, or
+// twice what its last scan left, whichever is more. A block is retired once per reference, so
+// a hazard on it keeps every retired copy, and a scan may leave any number of entries; waiting
+// for the list to double keeps the scanning work per retire constant. So a thread holds at most
+// `kScanThreshold + kSlotsPerThread * threads` unreclaimed entries, or twice the number of
+// entries its last scan found protected.
+//
+// The domain must outlive the threads using it. `Default()` is never destroyed.
+class HazardDomain {
+    struct Record;
+
+public:
+    static constexpr size_t kSlotsPerThread = 4;
+    static constexpr size_t kScanThreshold = 64;
+
+    // One of the calling thread's hazard slots, given back on destruction.
+    class Hazard {
+    public:
+        explicit Hazard(HazardDomain& domain) : record_(domain.LocalRecord()) {
+            for (auto& slot : record_->hazards) {
+                if (!record_->owned[&slot - record_->hazards.data()]) {
+                    slot_ = &slot;
+                    record_->owned[&slot - record_->hazards.data()] = true;
+                    return;
+                }
+            }
+            throw std::length_error("HazardDomain: all hazard slots of the thread are in use");
+        }
+
+        Hazard(const Hazard&) = delete;
+        Hazard& operator=(const Hazard&) = delete;
+
+        ~Hazard() {
+            slot_->store(nullptr, std::memory_order_release);
+            record_->owned[slot_ - record_->hazards.data()] = false;
+        }
+
+        // Publishes the current value of `source` and returns it; once this returns the value
+        // cannot be freed until the hazard is cleared or reused.
+        template <typename P>
+        P* Protect(const std::atomic<P*>& source) {
+            P* ptr = source.load(std::memory_order_relaxed);
+            while (true) {
+                // A full barrier: the hazard is visible before `source` is checked again.
+                slot_->exchange(ptr, std::memory_order_seq_cst);
+                P* current = source.load(std::memory_order_seq_cst);
+                if (current == ptr) {
+                    return ptr;
+                }
+                ptr = current;
+            }
+        }
+
+        void Clear() {
+            slot_->store(nullptr, std::memory_order_release);
+        }
+
+    private:
+        Record* record_;
+        std::atomic<const void*>* slot_ = nullptr;
+    };
+
+    HazardDomain() = default;
+
+    HazardDomain(const HazardDomain&) = delete;
+    HazardDomain& operator=(const HazardDomain&) = delete;
+
+    // No other thread may be using the domain anymore.
+    ~HazardDomain() {
+        auto& entries = LocalRecords().entries;
+        std::erase_if(entries, [this](const auto& entry) { return entry.first == this; });
+        for (Record* record = records_.load(); record != nullptr;) {
+            ReleaseAll(record->retired);
+            delete std::exchange(record, record->next);
+        }
+        ReleaseAll(orphans_);
+    }
+
+    // `deleter(ptr)` runs once no hazard holds `ptr`.
+    void Retire(const void* ptr, void (*deleter)(const void*)) {
+        Record* record = LocalRecord();
+        record->retired.push_back({ptr, deleter});
+        pending_.fetch_add(1, std::memory_order_relaxed);
+        size_t hazards = records_count_.load(std::memory_order_relaxed) * kSlotsPerThread;
+        if (record->retired.size() >= std::max(kScanThreshold + hazards, 2 * record->survivors)) {
+            Scan();
+        }
+    }
+
+    // Frees everything retired by the calling thread (and by exited threads) that no hazard
+    // holds.
+    void Scan() {
+        ScanRecord(LocalRecord());
+    }
+
+    // Retired and not freed yet, by all threads.
+    size_t PendingCount() const {
+        return pending_.load(std::memory_order_relaxed);
+    }
+
+    static HazardDomain& Default() {
+        static auto* domain = new HazardDomain();
+        return *domain;
+    }
+
+private:
+    struct Retired {
+        const void* ptr;
+        void (*deleter)(const void*);
+    };
+
+    struct alignas(64) Record {
+        std::array<std::atomic<const void*>, kSlotsPerThread> hazards{};
+        std::atomic<bool> in_use = true;
+        Record* next = nullptr;
+
+        // Touched by the owner thread only.
+        std::array<bool, kSlotsPerThread> owned{};
+        std::vector<Retired> retired;
+
+        // Left in `retired` by the last scan.
+        size_t survivors = 0;
+    };
+
+    // Records of the calling thread, one per domain, given back when the thread exits.
+    struct ThreadRecords {
+        ~ThreadRecords() {
+            for (auto [domain, record] : entries) {
+                domain->ScanRecord(record);
+                if (!record->retired.empty()) {
+                    std::lock_guard lock(domain->orphans_mutex_);
+                    domain->orphans_.insert(domain->orphans_.end(), record->retired.begin(),
+                                            record->retired.end());
+                    record->retired.clear();
+                }
+                record->survivors = 0;
+                record->in_use.store(false, std::memory_order_release);
+            }
+        }
+
+        std::vector<std::pair<HazardDomain*, Record*>> entries;
+    };
+
+    static ThreadRecords& LocalRecords() {
+        thread_local ThreadRecords records;
+        return records;
+    }
+
+    void ScanRecord(Record* own) {
+        std::vector<const void*> hazards;
+        for (Record* record = records_.load(std::memory_order_acquire); record != nullptr;
+             record = record->next) {
+            for (auto& slot : record->hazards) {
+                if (const void* ptr = slot.load(std::memory_order_seq_cst)) {
+                    hazards.push_back(ptr);
+                }
+            }
+        }
+        std::sort(hazards.begin(), hazards.end());
+        auto unprotected = [&](const Retired& retired) {
+            return !std::binary_search(hazards.begin(), hazards.end(), retired.ptr);
+        };
+
+        ReleaseIf(own->retired, unprotected);
+        own->survivors = own->retired.size();
+
+        std::vector<Retired> orphans;
+        {
+            std::unique_lock lock(orphans_mutex_, std::try_to_lock);
+            if (!lock) {
+                return;
+            }
+            orphans.swap(orphans_);
+        }
+        ReleaseIf(orphans, unprotected);
+        std::lock_guard lock(orphans_mutex_);
+        orphans_.insert(orphans_.end(), orphans.begin(), orphans.end());
+    }
+
+    Record* LocalRecord() {
+        auto& records = LocalRecords();
+        for (auto [domain, record] : records.entries) {
+            if (domain == this) {
+                return record;
+            }
+        }
+        Record* record = AcquireRecord();
+        records.entries.emplace_back(this, record);
+        return record;
+    }
+
+    // Reuses a record of an exited thread or adds a new one; records are never unlinked.
+    Record* AcquireRecord() {
+        for (Record* record = records_.load(std::memory_order_acquire); record != nullptr;
+             record = record->next) {
+            bool free = false;
+            if (!record->in_use.load(std::memory_order_relaxed) &&
+                record->in_use.compare_exchange_strong(free, true, std::memory_order_acquire)) {
+                return record;
+            }
+        }
+        auto* record = new Record();
+        record->next = records_.load(std::memory_order_relaxed);
+        while (!records_.compare_exchange_weak(record->next, record, std::memory_order_release)) {
+        }
+        records_count_.fetch_add(1, std::memory_order_relaxed);
+        return record;
+    }
+
+    // Deleters may retire more pointers, so the freed entries are taken out first.
+    template <typename Predicate>
+    void ReleaseIf(std::vector<Retired>& retired, Predicate predicate) {
+        auto middle = std::partition(retired.begin(), retired.end(),
+                                     [&](const Retired& item) { return !predicate(item); });
+        std::vector<Retired> ready(middle, retired.end());
+        retired.erase(middle, retired.end());
+        ReleaseAll(ready);
+    }
+
+    void ReleaseAll(std::vector<Retired>& retired) {
+        for (const Retired& item : retired) {
+            item.deleter(item.ptr);
+        }
+        pending_.fetch_sub(retired.size(), std::memory_order_relaxed);
+        retired.clear();
+    }
+
+    std::atomic<Record*> records_ = nullptr;
+    std::atomic<size_t> records_count_ = 0;
+    std::atomic<size_t> pending_ = 0;
+
+    std::mutex orphans_mutex_;
+    std::vector<Retired> orphans_;
+};
+
+// A slot holding a `SharedPtr<T>` that readers can dereference under a hazard pointer without
+// touching the reference count, promoting to a `SharedPtr` only when they need to keep it.
+//
+// The slot keeps the object pointer and the control block of its value, and owns one strong
+// reference to the block. Readers protect the block; `Store` retires the old block, whose
+// reference is dropped once no reader protects it. The two words are published under a version
+// counter, so readers only wait while a `Store` is writing them.
+template <typename T>
+class HazardSlot {
+public:
+    // Keeps the slot's control block from being released while alive. At most
+    // `HazardDomain::kSlotsPerThread` per thread at a time.
+    class Protected {
+    public:
+        T* Get() const {
+            return ptr_;
+        }
+
+        T* operator->() const {
+            return Get();
+        }
+
+        T& operator*() const {
+            return *Get();
+        }
+
+        explicit operator bool() const {
+            return Get() != nullptr;
+        }
+
+        // Takes a strong reference on the protected block.
+        SharedPtr<T> Promote() const {
+            return PromoteShared(ptr_, block_);
+        }
+
+    private:
+        Protected(HazardDomain& domain, const HazardSlot& slot) : hazard_(domain) {
+            while (true) {
+                uint64_t version = slot.version_.load(std::memory_order_seq_cst);
+                if (version & 1) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                block_ = hazard_.Protect(slot.block_);
+                ptr_ = slot.ptr_.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.version_.load(std::memory_order_seq_cst) == version) {
+                    return;
+                }
+            }
+        }
+
+        HazardDomain::Hazard hazard_;
+        ControlBlock* block_ = nullptr;
+        T* ptr_ = nullptr;
+
+        friend HazardSlot;
+    };
+
+    explicit HazardSlot(HazardDomain& domain = HazardDomain::Default()) : domain_(domain) {
+    }
+
+    explicit HazardSlot(SharedPtr<T> value, HazardDomain& domain = HazardDomain::Default())
+        : domain_(domain) {
+        Store(std::move(value));
+    }
+
+    HazardSlot(const HazardSlot&) = delete;
+    HazardSlot& operator=(const HazardSlot&) = delete;
+
+    ~HazardSlot() {
+        Retire(block_.load(std::memory_order_relaxed));
+    }
+
+    void Store(SharedPtr<T> value) {
+        T* ptr = value.Get();
+        ControlBlock* block = DetachShared(value);
+
+        // Odd while the two words are written, which also keeps other writers out.
+        uint64_t version = version_.load(std::memory_order_relaxed);
+        while ((version & 1) ||
+               !version_.compare_exchange_weak(version, version + 1, std::memory_order_seq_cst)) {
+            if (version & 1) {
+                std::this_thread::yield();
+                version = version_.load(std::memory_order_relaxed);
+            }
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        ControlBlock* old = block_.load(std::memory_order_relaxed);
+        ptr_.store(ptr, std::memory_order_relaxed);
+        block_.store(block, std::memory_order_relaxed);
+        version_.store(version + 2, std::memory_order_seq_cst);
+        Retire(old);
+    }
+
+    Protected Protect() const {
+        return Protected(domain_, *this);
+    }
+
+    SharedPtr<T> Load() const {
+        return Protect().Promote();
+    }
+
+private:
+    void Retire(ControlBlock* block) {
+        if (block != nullptr) {
+            domain_.Retire(block, [](const void* ptr) {
+                const_cast<ControlBlock*>(static_cast<const ControlBlock*>(ptr))
+                    ->DecreaseSharedCounter();
+            });
+        }
+    }
+
+    HazardDomain& domain_;
+    std::atomic<uint64_t> version_ = 0;
+    std::atomic<ControlBlock*> block_ = nullptr;
+    std::atomic<T*> ptr_ = nullptr;
+};
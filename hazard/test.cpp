@@ -0,0 +1,183 @@
+#include "hazard.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Config {
+    static std::atomic<int> alive;
+
+    explicit Config(int version) : version(version), check(version) {
+        alive.fetch_add(1);
+    }
+
+    ~Config() {
+        check = -1;
+        alive.fetch_sub(1);
+    }
+
+    int version;
+    int check;
+};
+
+std::atomic<int> Config::alive = 0;
+
+}  // namespace
+
+TEST_CASE("Hazard slot") {
+    HazardDomain domain;
+    HazardSlot<Config> slot(MakeShared<Config>(1), domain);
+
+    SECTION("Protected value survives a store") {
+        auto config = slot.Protect();
+        slot.Store(MakeShared<Config>(2));
+        domain.Scan();
+        REQUIRE(Config::alive == 2);
+        REQUIRE(config->version == 1);
+        REQUIRE(config->check == 1);
+        REQUIRE(domain.PendingCount() == 1);
+    }
+
+    SECTION("Released once unprotected") {
+        {
+            auto config = slot.Protect();
+            slot.Store(MakeShared<Config>(2));
+        }
+        domain.Scan();
+        REQUIRE(Config::alive == 1);
+        REQUIRE(domain.PendingCount() == 0);
+        REQUIRE(slot.Protect()->version == 2);
+    }
+
+    SECTION("Promote") {
+        SharedPtr<Config> promoted;
+        {
+            auto config = slot.Protect();
+            promoted = config.Promote();
+        }
+        REQUIRE(promoted.UseCount() == 2);
+        slot.Store(SharedPtr<Config>());
+        domain.Scan();
+        REQUIRE(!slot.Protect());
+        REQUIRE(promoted.UseCount() == 1);
+        REQUIRE(promoted->version == 1);
+        REQUIRE(!slot.Load());
+    }
+
+    SECTION("Aliasing values") {
+        auto owner = MakeShared<Config>(2);
+        slot.Store(owner);
+        HazardSlot<int> member(SharedPtr<int>(owner, &owner->check), domain);
+        owner.Reset();
+        REQUIRE(*member.Protect() == 2);
+
+        auto kept = member.Load();
+        REQUIRE(kept.Get() == &slot.Protect()->check);
+        REQUIRE(kept.UseCount() == 3);
+    }
+
+    SECTION("Slots per thread") {
+        static_assert(HazardDomain::kSlotsPerThread == 4);
+        auto a = slot.Protect();
+        auto b = slot.Protect();
+        auto c = slot.Protect();
+        auto d = slot.Protect();
+        REQUIRE_THROWS_AS(slot.Protect(), std::length_error);
+    }
+}
+
+TEST_CASE("Retired list is bounded") {
+    HazardDomain domain;
+    HazardSlot<Config> slot(MakeShared<Config>(0), domain);
+    auto pinned = slot.Protect();
+
+    size_t max_pending = 0;
+    for (int version = 1; version <= 1000; ++version) {
+        slot.Store(MakeShared<Config>(version));
+        max_pending = std::max(max_pending, domain.PendingCount());
+    }
+    REQUIRE(max_pending <= HazardDomain::kScanThreshold + HazardDomain::kSlotsPerThread);
+    REQUIRE(pinned->check == 0);
+}
+
+TEST_CASE("Storing a protected block over and over") {
+    HazardDomain domain;
+    auto config = MakeShared<Config>(0);
+    HazardSlot<Config> slot(config, domain);
+    {
+        auto pinned = slot.Protect();
+        // Every store retires a reference to the pinned block, none of which can be released.
+        for (int i = 0; i < 10000; ++i) {
+            slot.Store(config);
+        }
+        REQUIRE(domain.PendingCount() == 10000);
+    }
+    domain.Scan();
+    REQUIRE(domain.PendingCount() == 0);
+    REQUIRE(config.UseCount() == 2);
+}
+
+TEST_CASE("Destroying the domain releases everything") {
+    {
+        HazardDomain domain;
+        HazardSlot<Config> slot(MakeShared<Config>(1), domain);
+        slot.Store(MakeShared<Config>(2));
+    }
+    REQUIRE(Config::alive == 0);
+
+    std::thread([] {
+        HazardSlot<Config> slot(MakeShared<Config>(1));
+        slot.Store(MakeShared<Config>(2));
+    }).join();
+    HazardDomain::Default().Scan();
+    REQUIRE(Config::alive == 0);
+}
+
+TEST_CASE("Hazard stress") {
+    constexpr int kReaders = 3;
+    constexpr int kUpdates = 2000;
+
+    HazardDomain domain;
+    HazardSlot<Config> slot(MakeShared<Config>(0), domain);
+    std::atomic<bool> done = false;
+    std::atomic<int> torn = 0;
+
+    std::vector<std::thread> readers;
+    for (int i = 0; i < kReaders; ++i) {
+        readers.emplace_back([&, i] {
+            while (!done.load()) {
+                auto config = slot.Protect();
+                if (config->check != config->version) {
+                    torn.fetch_add(1);
+                }
+                if (i == 0) {
+                    auto kept = config.Promote();
+                    if (kept->check != kept->version) {
+                        torn.fetch_add(1);
+                    }
+                }
+            }
+        });
+    }
+
+    for (int version = 1; version <= kUpdates; ++version) {
+        slot.Store(MakeShared<Config>(version));
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    domain.Scan();
+    REQUIRE(torn == 0);
+    REQUIRE(domain.PendingCount() == 0);
+    REQUIRE(Config::alive == 1);
+}
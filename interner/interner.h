@@ -0,0 +1,169 @@
+#pragma once
+
+#include "../intrusive/intrusive.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// Flyweight table: `Intern(value)` returns the one handle for all equal values, so equal
+// handles can be compared by pointer. A value is erased from the table by the `Deleter` of its
+// node when the last handle goes away.
+//
+// The table is split into `kShards` shards by hash, each an open-addressing table with linear
+// probing under its own mutex, so threads interning different values rarely meet. A lookup that
+// finds a value whose count has already dropped to zero does not revive it (`TryIncRef` fails)
+// and puts a new node in its slot; the dying node then finds its slot taken and only frees
+// itself.
+//
+// The interner must outlive its handles.
+template <typename T, typename Hash = std::hash<T>, typename Equal = std::equal_to<T>>
+class Interner {
+    struct Shard;
+    struct NodeDelete;
+
+public:
+    class Node : public AtomicRefCounted<Node, NodeDelete> {
+    public:
+        const T& Get() const {
+            return value_;
+        }
+
+        const T& operator*() const {
+            return value_;
+        }
+
+        const T* operator->() const {
+            return &value_;
+        }
+
+    private:
+        template <typename U>
+        Node(U&& value, uint64_t hash, Shard* shard)
+            : value_(std::forward<U>(value)), hash_(hash), shard_(shard) {
+        }
+
+        const T value_;
+        const uint64_t hash_;
+        Shard* const shard_;
+
+        friend Interner;
+    };
+
+    using Handle = IntrusivePtr<Node>;
+
+    static constexpr size_t kShards = 64;
+
+    Interner() = default;
+
+    Interner(const Interner&) = delete;
+    Interner& operator=(const Interner&) = delete;
+
+    template <typename U>
+    Handle Intern(U&& value) {
+        uint64_t hash = Mix(Hash()(value));
+        Shard& shard = shards_[hash >> (64 - kShardBits)];
+        std::lock_guard lock(shard.mutex);
+        if (2 * (shard.size + 1) > shard.slots.size()) {
+            shard.Grow();
+        }
+        size_t mask = shard.slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            Node*& slot = shard.slots[i];
+            if (slot == nullptr) {
+                ++shard.size;
+            } else if (slot->hash_ != hash || !Equal()(slot->value_, value)) {
+                continue;
+            } else if (slot->TryIncRef()) {
+                return Handle(slot, false);
+            }
+            // Either a free slot or a dying node with this value, which no longer owns it.
+            slot = new Node(std::forward<U>(value), hash, &shard);
+            return Handle(slot);
+        }
+    }
+
+    // Distinct values alive.
+    size_t Size() const {
+        size_t size = 0;
+        for (const Shard& shard : shards_) {
+            std::lock_guard lock(shard.mutex);
+            size += shard.size;
+        }
+        return size;
+    }
+
+private:
+    static constexpr size_t kShardBits = 6;
+    static_assert(size_t{1} << kShardBits == kShards);
+
+    struct alignas(64) Shard {
+        // Capacity is a power of two, at most half of the slots are used.
+        void Grow() {
+            std::vector<Node*> old(std::max<size_t>(16, 2 * slots.size()), nullptr);
+            old.swap(slots);
+            size_t mask = slots.size() - 1;
+            for (Node* node : old) {
+                if (node != nullptr) {
+                    size_t i = node->hash_ & mask;
+                    while (slots[i] != nullptr) {
+                        i = (i + 1) & mask;
+                    }
+                    slots[i] = node;
+                }
+            }
+        }
+
+        // Backward shift deletion: entries after the hole move into it unless that would put
+        // them before their home slot.
+        void Remove(const Node* node) {
+            size_t mask = slots.size() - 1;
+            size_t hole = node->hash_ & mask;
+            while (slots[hole] != node) {
+                if (slots[hole] == nullptr) {
+                    return;
+                }
+                hole = (hole + 1) & mask;
+            }
+            --size;
+            for (size_t i = (hole + 1) & mask; slots[i] != nullptr; i = (i + 1) & mask) {
+                size_t home = slots[i]->hash_ & mask;
+                bool stays = hole <= i ? hole < home && home <= i : hole < home || home <= i;
+                if (!stays) {
+                    slots[hole] = slots[i];
+                    hole = i;
+                }
+            }
+            slots[hole] = nullptr;
+        }
+
+        mutable std::mutex mutex;
+        std::vector<Node*> slots;
+        size_t size = 0;
+    };
+
+    struct NodeDelete {
+        static void Destroy(Node* node) {
+            {
+                std::lock_guard lock(node->shard_->mutex);
+                node->shard_->Remove(node);
+            }
+            delete node;
+        }
+    };
+
+    // Shards take the top bits and slots the bottom ones, both have to be well mixed.
+    static uint64_t Mix(uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    std::array<Shard, kShards> shards_;
+};
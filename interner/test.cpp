@@ -0,0 +1,139 @@
+#include "interner.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Every value lands in the same shard and the same home slot.
+struct ConstantHash {
+    size_t operator()(int) const {
+        return 0;
+    }
+};
+
+struct TupleHash {
+    size_t operator()(const std::tuple<int, int>& value) const {
+        return std::hash<int>()(std::get<0>(value)) * 31 + std::hash<int>()(std::get<1>(value));
+    }
+};
+
+}  // namespace
+
+TEST_CASE("Interner") {
+    Interner<std::string> interner;
+
+    SECTION("Equal values share a handle") {
+        auto a = interner.Intern(std::string("a long enough string to live on the heap"));
+        auto b = interner.Intern(std::string("a long enough string to live on the heap"));
+        auto c = interner.Intern(std::string("another one"));
+        REQUIRE(a == b);
+        REQUIRE(!(a == c));
+        REQUIRE(a.UseCount() == 2);
+        REQUIRE(a->Get().size() == 40);
+        REQUIRE(c->Get() == "another one");
+        REQUIRE(interner.Size() == 2);
+    }
+
+    SECTION("Erased with the last handle") {
+        auto a = interner.Intern(std::string("x"));
+        auto copy = a;
+        a.Reset();
+        REQUIRE(interner.Size() == 1);
+        copy.Reset();
+        REQUIRE(interner.Size() == 0);
+        REQUIRE(interner.Intern(std::string("x")).UseCount() == 1);
+    }
+
+    SECTION("Many values") {
+        std::vector<Interner<std::string>::Handle> handles;
+        for (int i = 0; i < 10000; ++i) {
+            handles.push_back(interner.Intern(std::to_string(i % 5000)));
+        }
+        REQUIRE(interner.Size() == 5000);
+        for (int i = 0; i < 5000; ++i) {
+            REQUIRE(handles[i] == handles[i + 5000]);
+        }
+        handles.resize(5000);
+        REQUIRE(interner.Size() == 5000);
+        handles.clear();
+        REQUIRE(interner.Size() == 0);
+    }
+}
+
+TEST_CASE("Interner probing") {
+    // One long probe chain: removals in the middle must keep the rest reachable.
+    Interner<int, ConstantHash> interner;
+    std::vector<Interner<int, ConstantHash>::Handle> handles;
+    for (int i = 0; i < 100; ++i) {
+        handles.push_back(interner.Intern(i));
+    }
+    for (int i = 0; i < 100; i += 3) {
+        handles[i].Reset();
+    }
+    REQUIRE(interner.Size() == 66);
+    for (int i = 0; i < 100; ++i) {
+        auto handle = interner.Intern(i);
+        if (i % 3 != 0) {
+            REQUIRE(handle == handles[i]);
+        } else {
+            REQUIRE(handle.UseCount() == 1);
+        }
+    }
+    REQUIRE(interner.Size() == 66);
+}
+
+TEST_CASE("Interner tuples") {
+    Interner<std::tuple<int, int>, TupleHash> interner;
+    auto a = interner.Intern(std::tuple(1, 2));
+    auto b = interner.Intern(std::tuple(1, 2));
+    auto c = interner.Intern(std::tuple(2, 1));
+    REQUIRE(a == b);
+    REQUIRE(!(a == c));
+    REQUIRE(std::get<1>(**c) == 1);
+}
+
+// Run under TSan: cmake -DCMAKE_BUILD_TYPE=TSAN
+TEST_CASE("Interner across threads") {
+    constexpr int kThreads = 4;
+    constexpr int kRounds = 20000;
+    constexpr int kValues = 64;
+
+    Interner<std::string> interner;
+    // Half of the values stay alive, the other half keeps dying and coming back.
+    std::vector<Interner<std::string>::Handle> pinned;
+    for (int i = 0; i < kValues; i += 2) {
+        pinned.push_back(interner.Intern(std::to_string(i)));
+    }
+
+    std::atomic<int> wrong = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < kRounds; ++i) {
+                int value = (i * 7 + t) % kValues;
+                auto handle = interner.Intern(std::to_string(value));
+                if (handle->Get() != std::to_string(value)) {
+                    wrong.fetch_add(1);
+                }
+                if (value % 2 == 0 && !(handle == pinned[value / 2])) {
+                    wrong.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(interner.Size() == kValues / 2);
+    pinned.clear();
+    REQUIRE(interner.Size() == 0);
+}
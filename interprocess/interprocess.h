@@ -0,0 +1,570 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+template <typename T>
+class InterprocessSharedPtr;
+
+// A POSIX shared memory segment holding named objects shared by the processes that map it.
+// Everything in the segment is addressed by offsets from its start, so each process may map it
+// at a different address; objects must be position-independent themselves: no pointers, no
+// virtual functions, nothing owned outside the segment.
+//
+// Each mapping takes one of `kMaxProcesses` process slots. A block records which slots hold
+// references to it in a bit mask, and counts the references of each slot separately; the object
+// dies when the mask becomes empty. A process that dies while holding references leaves its
+// slot behind, and `Recover` (also run when a process maps the segment) clears the bits of dead
+// processes, destroying what only they held. Processes are told dead by their pid, so a pid
+// reused for another process before recovery keeps the slot.
+//
+// Handles belong to the mapping they came from and must not outlive it; a forked child does not
+// inherit the parent's slot and maps the segment again.
+class SharedSegment {
+public:
+    static constexpr size_t kMaxProcesses = 63;
+    static constexpr size_t kMaxBlocks = 256;
+    static constexpr size_t kMaxName = 64;
+
+    // Creates a segment of `size` bytes of object space; fails if `name` exists.
+    static SharedSegment Create(const std::string& name, size_t size) {
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+        }
+        size_t total = sizeof(Header) + size;
+        if (ftruncate(fd, static_cast<off_t>(total)) != 0) {
+            int error = errno;
+            close(fd);
+            shm_unlink(name.c_str());
+            throw std::system_error(error, std::generic_category(), "ftruncate " + name);
+        }
+        SharedSegment segment(fd, total);
+        segment.Initialize(total);
+        segment.Attach();
+        return segment;
+    }
+
+    static SharedSegment Open(const std::string& name) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+        }
+        struct stat stat;
+        if (fstat(fd, &stat) != 0) {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), "fstat " + name);
+        }
+        // Touching the header of a shorter mapping would fault.
+        if (stat.st_size < static_cast<off_t>(sizeof(Header))) {
+            close(fd);
+            throw std::runtime_error("SharedSegment: " + name + " is not initialized");
+        }
+        SharedSegment segment(fd, static_cast<size_t>(stat.st_size));
+        if (segment.header_->magic.load(std::memory_order_acquire) != kMagic ||
+            segment.header_->capacity > segment.size_ - sizeof(Header)) {
+            throw std::runtime_error("SharedSegment: " + name + " is not initialized");
+        }
+        segment.Attach();
+        return segment;
+    }
+
+    // Removes the name; mappings stay valid until unmapped.
+    static void Unlink(const std::string& name) {
+        shm_unlink(name.c_str());
+    }
+
+    // Handles refer to the `SharedSegment` object: it must not be moved once they exist.
+    SharedSegment(SharedSegment&& other) noexcept
+        : header_(std::exchange(other.header_, nullptr)),
+          size_(std::exchange(other.size_, 0)),
+          slot_(std::exchange(other.slot_, kDetached)) {
+    }
+
+    SharedSegment& operator=(SharedSegment&&) = delete;
+
+    SharedSegment(const SharedSegment&) = delete;
+    SharedSegment& operator=(const SharedSegment&) = delete;
+
+    // Drops whatever references of this mapping are left, like a process dying would.
+    ~SharedSegment() {
+        if (header_ == nullptr) {
+            return;
+        }
+        if (slot_ != kDetached) {
+            ReleaseSlot(slot_);
+            header_->pids[slot_].store(0, std::memory_order_release);
+        }
+        munmap(header_, size_);
+    }
+
+    // Creates `T` under `name` and returns the first handle to it. The name holds a reference
+    // of its own until `Erase`.
+    template <typename T, typename... Args>
+    InterprocessSharedPtr<T> Make(std::string_view name, Args&&... args) {
+        static_assert(std::is_trivially_destructible_v<T> && !std::is_polymorphic_v<T>,
+                      "objects in shared memory are freed without running destructors, possibly "
+                      "by another process");
+        if (name.size() >= kMaxName) {
+            throw std::length_error("SharedSegment: name is too long");
+        }
+        uint32_t index = Reserve(sizeof(T), alignof(T));
+        Block& block = header_->blocks[index];
+        try {
+            new (Data() + block.object) T(std::forward<Args>(args)...);
+        } catch (...) {
+            Release(index);
+            throw;
+        }
+        {
+            Lock lock(header_);
+            if (FindLocked(name) != kNoBlock) {
+                lock.Unlock();
+                Release(index);
+                throw std::invalid_argument("SharedSegment: name is taken");
+            }
+            name.copy(block.name, name.size());
+            block.name[name.size()] = '\0';
+            block.holders.fetch_or(kNamedBit, std::memory_order_relaxed);
+            block.state = State::kLive;
+        }
+        return InterprocessSharedPtr<T>(this, index);
+    }
+
+    // Empty if there is no object under `name`.
+    template <typename T>
+    InterprocessSharedPtr<T> Find(std::string_view name) {
+        Lock lock(header_);
+        uint32_t index = FindLocked(name);
+        if (index == kNoBlock) {
+            return {};
+        }
+        // The reference of the name keeps the object alive meanwhile.
+        Acquire(index);
+        return InterprocessSharedPtr<T>(this, index);
+    }
+
+    // Drops the reference of the name. Returns false if there is no object under `name`.
+    bool Erase(std::string_view name) {
+        uint32_t index;
+        {
+            Lock lock(header_);
+            index = FindLocked(name);
+            if (index == kNoBlock) {
+                return false;
+            }
+            header_->blocks[index].name[0] = '\0';
+        }
+        Drop(index, kNamedBit);
+        return true;
+    }
+
+    // Clears the slots of dead processes. Returns how many there were.
+    size_t Recover() {
+        size_t recovered = 0;
+        auto self = static_cast<int32_t>(getpid());
+        for (size_t slot = 0; slot < kMaxProcesses; ++slot) {
+            int32_t pid = header_->pids[slot].load(std::memory_order_acquire);
+            // A negative pid marks a slot being recovered by that process.
+            if (pid == 0 || slot == slot_ || IsAlive(pid < 0 ? -pid : pid)) {
+                continue;
+            }
+            if (!header_->pids[slot].compare_exchange_strong(pid, -self,
+                                                             std::memory_order_acq_rel)) {
+                continue;
+            }
+            ReleaseSlot(slot);
+            header_->pids[slot].store(0, std::memory_order_release);
+            ++recovered;
+        }
+        Sweep();
+        return recovered;
+    }
+
+    // Live objects, named or not.
+    size_t LiveObjects() const {
+        Lock lock(header_);
+        return std::count_if(std::begin(header_->blocks), std::end(header_->blocks),
+                             [](const Block& block) { return block.state != State::kFree; });
+    }
+
+    // Processes attached to the segment, dead ones not yet recovered included.
+    size_t Processes() const {
+        return std::count_if(std::begin(header_->pids), std::end(header_->pids),
+                             [](const auto& pid) { return pid.load() != 0; });
+    }
+
+private:
+    template <typename T>
+    friend class InterprocessSharedPtr;
+
+    static constexpr uint64_t kMagic = 0x736d6172745f7368;
+    static constexpr uint64_t kNamedBit = uint64_t{1} << kMaxProcesses;
+    static constexpr uint32_t kNoBlock = ~uint32_t{0};
+
+    enum class State : uint32_t {
+        // The region, if any, may be reused.
+        kFree,
+        kConstructing,
+        kLive,
+    };
+
+    struct Block {
+        // Bit `i` for process slot `i`, `kNamedBit` for the name.
+        std::atomic<uint64_t> holders;
+        std::atomic<uint32_t> counts[kMaxProcesses];
+
+        // Under the segment mutex.
+        State state;
+        uint64_t object;
+        uint64_t capacity;
+        char name[kMaxName];
+    };
+
+    // Cache line aligned, so is the object space after it.
+    struct alignas(64) Header {
+        std::atomic<uint64_t> magic;
+
+        // Robust: a process dying while holding it does not lock out the others.
+        pthread_mutex_t mutex;
+
+        // Under the mutex.
+        uint64_t used;
+        uint64_t capacity;
+
+        std::atomic<int32_t> pids[kMaxProcesses];
+        Block blocks[kMaxBlocks];
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+    static_assert(std::atomic<uint32_t>::is_always_lock_free);
+    static_assert(std::atomic<int32_t>::is_always_lock_free);
+
+    class Lock {
+    public:
+        explicit Lock(Header* header) : mutex_(&header->mutex) {
+            if (pthread_mutex_lock(mutex_) == EOWNERDEAD) {
+                // Every update under the mutex leaves the header consistent at each store.
+                pthread_mutex_consistent(mutex_);
+            }
+        }
+
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+
+        ~Lock() {
+            Unlock();
+        }
+
+        void Unlock() {
+            if (mutex_ != nullptr) {
+                pthread_mutex_unlock(std::exchange(mutex_, nullptr));
+            }
+        }
+
+    private:
+        pthread_mutex_t* mutex_;
+    };
+
+    SharedSegment(int fd, size_t size) : size_(size) {
+        void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int error = errno;
+        close(fd);
+        if (memory == MAP_FAILED) {
+            throw std::system_error(error, std::generic_category(), "mmap");
+        }
+        header_ = static_cast<Header*>(memory);
+    }
+
+    void Initialize(size_t total) {
+        // The mapping is zero-filled: the counters, pids and blocks start out empty.
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&header_->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+        header_->capacity = total - sizeof(Header);
+        header_->magic.store(kMagic, std::memory_order_release);
+    }
+
+    void Attach() {
+        auto self = static_cast<int32_t>(getpid());
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            for (size_t slot = 0; slot < kMaxProcesses; ++slot) {
+                int32_t free = 0;
+                if (header_->pids[slot].compare_exchange_strong(free, self,
+                                                                std::memory_order_acq_rel)) {
+                    slot_ = slot;
+                    Recover();
+                    return;
+                }
+            }
+            Recover();
+        }
+        munmap(header_, size_);
+        header_ = nullptr;
+        throw std::length_error("SharedSegment: all process slots are in use");
+    }
+
+    static bool IsAlive(int32_t pid) {
+        return kill(pid, 0) == 0 || errno != ESRCH;
+    }
+
+    char* Data() const {
+        return reinterpret_cast<char*>(header_ + 1);
+    }
+
+    // A block in `kConstructing` with one reference of this process and room for the object.
+    uint32_t Reserve(size_t size, size_t alignment) {
+        Lock lock(header_);
+        // A free region of a dead object that fits, or else an unused block, or else any free
+        // one, abandoning its region.
+        uint32_t index = kNoBlock;
+        uint32_t unused = kNoBlock;
+        uint32_t any = kNoBlock;
+        for (uint32_t i = 0; i < kMaxBlocks && index == kNoBlock; ++i) {
+            const Block& block = header_->blocks[i];
+            if (block.state != State::kFree) {
+                continue;
+            }
+            if (block.capacity >= size && block.object % alignment == 0) {
+                index = i;
+            } else if (block.capacity == 0 && unused == kNoBlock) {
+                unused = i;
+            } else if (any == kNoBlock) {
+                any = i;
+            }
+        }
+        index = index != kNoBlock ? index : unused != kNoBlock ? unused : any;
+        if (index == kNoBlock) {
+            throw std::length_error("SharedSegment: all blocks are in use");
+        }
+        Block& block = header_->blocks[index];
+        if (block.capacity < size) {
+            uint64_t begin = (header_->used + alignment - 1) & ~(alignment - 1);
+            if (begin + size > header_->capacity) {
+                throw std::bad_alloc();
+            }
+            uint64_t capacity = std::max<uint64_t>(size, 1);
+            // The bump goes first: a process dying before the block is written leaks the region
+            // rather than leaving a free block over space the next bump hands out again.
+            header_->used = begin + capacity;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            block.object = begin;
+            block.capacity = capacity;
+        }
+        block.name[0] = '\0';
+        block.counts[slot_].store(1, std::memory_order_relaxed);
+        block.holders.store(Bit(slot_), std::memory_order_relaxed);
+        block.state = State::kConstructing;
+        return index;
+    }
+
+    uint32_t FindLocked(std::string_view name) const {
+        for (uint32_t i = 0; i < kMaxBlocks; ++i) {
+            const Block& block = header_->blocks[i];
+            if (block.state == State::kLive && block.name[0] != '\0' && name == block.name) {
+                return i;
+            }
+        }
+        return kNoBlock;
+    }
+
+    static uint64_t Bit(size_t slot) {
+        return uint64_t{1} << slot;
+    }
+
+    // A reference of this process to a block something else keeps alive. Lock order: the
+    // segment mutex, then `transitions_`.
+    void Acquire(uint32_t index) {
+        Block& block = header_->blocks[index];
+        std::lock_guard lock(transitions_);
+        if (block.counts[slot_].fetch_add(1, std::memory_order_relaxed) == 0) {
+            block.holders.fetch_or(Bit(slot_), std::memory_order_relaxed);
+        }
+    }
+
+    void Copy(uint32_t index) {
+        header_->blocks[index].counts[slot_].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Release(uint32_t index) {
+        Block& block = header_->blocks[index];
+        if (block.counts[slot_].fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        // The count may have gone back up from zero meanwhile, and the bit must stay then.
+        std::unique_lock lock(transitions_);
+        if (block.counts[slot_].load(std::memory_order_relaxed) != 0) {
+            return;
+        }
+        bool last = ClearHolder(index, Bit(slot_));
+        lock.unlock();
+        if (last) {
+            Free(index);
+        }
+    }
+
+    // Returns true if `bit` was the last holder.
+    bool ClearHolder(uint32_t index, uint64_t bit) {
+        return header_->blocks[index].holders.fetch_and(~bit, std::memory_order_acq_rel) == bit;
+    }
+
+    void Drop(uint32_t index, uint64_t bit) {
+        if (ClearHolder(index, bit)) {
+            Free(index);
+        }
+    }
+
+    // Idempotent: whoever finds the block live without holders frees it.
+    void Free(uint32_t index) {
+        Lock lock(header_);
+        Block& block = header_->blocks[index];
+        if (block.state != State::kFree && block.holders.load(std::memory_order_acquire) == 0) {
+            block.name[0] = '\0';
+            block.state = State::kFree;
+        }
+    }
+
+    // Drops every reference of `slot`.
+    void ReleaseSlot(size_t slot) {
+        for (uint32_t index = 0; index < kMaxBlocks; ++index) {
+            Block& block = header_->blocks[index];
+            block.counts[slot].store(0, std::memory_order_relaxed);
+            if (block.holders.load(std::memory_order_relaxed) & Bit(slot)) {
+                Drop(index, Bit(slot));
+            }
+        }
+    }
+
+    // Frees blocks whose last holder died between clearing its bit and freeing them.
+    void Sweep() {
+        for (uint32_t index = 0; index < kMaxBlocks; ++index) {
+            if (header_->blocks[index].holders.load(std::memory_order_acquire) == 0) {
+                Free(index);
+            }
+        }
+    }
+
+    // Until `Attach` takes a slot: a mapping that failed to open must not release the slot of
+    // another process.
+    static constexpr size_t kDetached = kMaxProcesses;
+
+    Header* header_ = nullptr;
+    size_t size_ = 0;
+    size_t slot_ = kDetached;
+
+    // Serializes the transitions of this process's counts between zero and one with setting and
+    // clearing its bit.
+    std::mutex transitions_;
+};
+
+// A reference to an object in a `SharedSegment`, counted in the segment so that the object dies
+// with the last reference of any process. The handle itself is process-local.
+template <typename T>
+class InterprocessSharedPtr {
+public:
+    InterprocessSharedPtr() = default;
+
+    InterprocessSharedPtr(const InterprocessSharedPtr& other)
+        : segment_(other.segment_), index_(other.index_) {
+        if (segment_ != nullptr) {
+            segment_->Copy(index_);
+        }
+    }
+
+    InterprocessSharedPtr(InterprocessSharedPtr&& other) noexcept
+        : segment_(std::exchange(other.segment_, nullptr)), index_(other.index_) {
+    }
+
+    InterprocessSharedPtr& operator=(InterprocessSharedPtr other) noexcept {
+        Swap(other);
+        return *this;
+    }
+
+    ~InterprocessSharedPtr() {
+        Reset();
+    }
+
+    void Reset() {
+        if (segment_ != nullptr) {
+            std::exchange(segment_, nullptr)->Release(index_);
+        }
+    }
+
+    void Swap(InterprocessSharedPtr& other) noexcept {
+        std::swap(segment_, other.segment_);
+        std::swap(index_, other.index_);
+    }
+
+    T* Get() const {
+        if (segment_ == nullptr) {
+            return nullptr;
+        }
+        return std::launder(
+            reinterpret_cast<T*>(segment_->Data() + segment_->header_->blocks[index_].object));
+    }
+
+    T& operator*() const {
+        return *Get();
+    }
+
+    T* operator->() const {
+        return Get();
+    }
+
+    explicit operator bool() const {
+        return segment_ != nullptr;
+    }
+
+    // References of the calling process.
+    size_t UseCount() const {
+        if (segment_ == nullptr) {
+            return 0;
+        }
+        return segment_->header_->blocks[index_].counts[segment_->slot_].load(
+            std::memory_order_relaxed);
+    }
+
+    // Processes holding the object; the name counts as one.
+    size_t Holders() const {
+        if (segment_ == nullptr) {
+            return 0;
+        }
+        return std::popcount(
+            segment_->header_->blocks[index_].holders.load(std::memory_order_relaxed));
+    }
+
+private:
+    friend SharedSegment;
+
+    // Takes over a reference already counted.
+    InterprocessSharedPtr(SharedSegment* segment, uint32_t index)
+        : segment_(segment), index_(index) {
+    }
+
+    SharedSegment* segment_ = nullptr;
+    uint32_t index_ = 0;
+};
@@ -0,0 +1,251 @@
+#include "interprocess.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Table {
+    int64_t values[16] = {};
+    std::atomic<int> visits = 0;
+};
+
+// Unique per test run, removed by the destructor.
+class SegmentName {
+public:
+    explicit SegmentName(const std::string& test)
+        : name_("/smart_ptrs_" + test + "_" + std::to_string(getpid())) {
+        SharedSegment::Unlink(name_);
+    }
+
+    ~SegmentName() {
+        SharedSegment::Unlink(name_);
+    }
+
+    const std::string& Get() const {
+        return name_;
+    }
+
+private:
+    std::string name_;
+};
+
+// Runs `body` in a forked child; its result is the exit code.
+template <typename F>
+pid_t Fork(F body) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int code = 1;
+        try {
+            code = body();
+        } catch (...) {
+        }
+        _exit(code);
+    }
+    return pid;
+}
+
+int Wait(pid_t pid) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+}  // namespace
+
+TEST_CASE("Counting in one process") {
+    SegmentName name("counting");
+    auto segment = SharedSegment::Create(name.Get(), 1 << 16);
+    REQUIRE(segment.Processes() == 1);
+
+    auto table = segment.Make<Table>("table");
+    REQUIRE(table);
+    REQUIRE(table.UseCount() == 1);
+    REQUIRE(table.Holders() == 2);
+    table->values[3] = 42;
+
+    auto found = segment.Find<Table>("table");
+    REQUIRE(found.Get() == table.Get());
+    REQUIRE(found->values[3] == 42);
+    REQUIRE(table.UseCount() == 2);
+
+    auto copy = found;
+    REQUIRE(table.UseCount() == 3);
+    copy.Reset();
+    found.Reset();
+    REQUIRE(table.UseCount() == 1);
+
+    REQUIRE(!segment.Find<Table>("missing"));
+    REQUIRE_THROWS_AS(segment.Make<Table>("table"), std::invalid_argument);
+    REQUIRE(segment.LiveObjects() == 1);
+
+    // The name keeps the object alive without handles, and the last handle after `Erase`.
+    table.Reset();
+    REQUIRE(segment.LiveObjects() == 1);
+    table = segment.Find<Table>("table");
+    REQUIRE(table->values[3] == 42);
+    REQUIRE(segment.Erase("table"));
+    REQUIRE(!segment.Erase("table"));
+    REQUIRE(!segment.Find<Table>("table"));
+    REQUIRE(segment.LiveObjects() == 1);
+    table.Reset();
+    REQUIRE(segment.LiveObjects() == 0);
+
+    // The name and the region are reused.
+    auto again = segment.Make<Table>("table");
+    REQUIRE(again->values[3] == 0);
+    REQUIRE(segment.LiveObjects() == 1);
+}
+
+TEST_CASE("Objects are shared between processes") {
+    SegmentName name("shared");
+    auto segment = SharedSegment::Create(name.Get(), 1 << 16);
+    auto table = segment.Make<Table>("table");
+    for (int i = 0; i < 16; ++i) {
+        table->values[i] = i * i;
+    }
+
+    constexpr int kChildren = 4;
+    pid_t children[kChildren];
+    for (pid_t& child : children) {
+        child = Fork([&name] {
+            // Mapped at an address of its own.
+            auto segment = SharedSegment::Open(name.Get());
+            auto table = segment.Find<Table>("table");
+            if (!table) {
+                return 2;
+            }
+            for (int i = 0; i < 16; ++i) {
+                if (table->values[i] != i * i) {
+                    return 3;
+                }
+            }
+            table->visits.fetch_add(1);
+            return 0;
+        });
+    }
+    for (pid_t child : children) {
+        REQUIRE(Wait(child) == 0);
+    }
+    REQUIRE(table->visits.load() == kChildren);
+
+    // The children released their slots when they unmapped the segment.
+    REQUIRE(segment.Processes() == 1);
+    REQUIRE(table.Holders() == 2);
+
+    // A child keeps an object the parent let go of alive.
+    int ready[2];
+    int done[2];
+    REQUIRE(pipe(ready) == 0);
+    REQUIRE(pipe(done) == 0);
+    pid_t child = Fork([&name, &ready, &done] {
+        auto segment = SharedSegment::Open(name.Get());
+        auto table = segment.Find<Table>("table");
+        char byte = 1;
+        if (!table || write(ready[1], &byte, 1) != 1) {
+            return 2;
+        }
+        // Until the parent erased the name and dropped its handle.
+        if (read(done[0], &byte, 1) != 1 || table.Holders() != 1) {
+            return 3;
+        }
+        return table->values[4] == 16 ? 0 : 4;
+    });
+    char byte;
+    REQUIRE(read(ready[0], &byte, 1) == 1);
+    REQUIRE(table.Holders() == 3);
+    REQUIRE(segment.Erase("table"));
+    table.Reset();
+    REQUIRE(segment.LiveObjects() == 1);
+    REQUIRE(write(done[1], &byte, 1) == 1);
+    REQUIRE(Wait(child) == 0);
+    for (int fd : {ready[0], ready[1], done[0], done[1]}) {
+        close(fd);
+    }
+    REQUIRE(segment.LiveObjects() == 0);
+}
+
+TEST_CASE("References of dead processes are recovered") {
+    SegmentName name("recovery");
+    auto segment = SharedSegment::Create(name.Get(), 1 << 16);
+    auto table = segment.Make<Table>("table");
+
+    // Dies holding a reference to the table and the only one to an object of its own.
+    pid_t child = Fork([&name] {
+        auto segment = SharedSegment::Open(name.Get());
+        auto table = segment.Find<Table>("table");
+        auto own = segment.Make<Table>("own");
+        segment.Erase("own");
+        _exit(table && own ? 0 : 2);
+        return 0;
+    });
+    REQUIRE(Wait(child) == 0);
+    REQUIRE(segment.Processes() == 2);
+    REQUIRE(table.Holders() == 3);
+    REQUIRE(segment.LiveObjects() == 2);
+
+    REQUIRE(segment.Recover() == 1);
+    REQUIRE(segment.Recover() == 0);
+    REQUIRE(segment.Processes() == 1);
+    REQUIRE(table.Holders() == 2);
+    REQUIRE(segment.LiveObjects() == 1);
+
+    // A new mapping recovers too.
+    child = Fork([&name] {
+        auto segment = SharedSegment::Open(name.Get());
+        auto table = segment.Find<Table>("table");
+        _exit(table ? 0 : 2);
+        return 0;
+    });
+    REQUIRE(Wait(child) == 0);
+    REQUIRE(table.Holders() == 3);
+    child = Fork([&name] {
+        auto segment = SharedSegment::Open(name.Get());
+        return segment.Processes() == 2 ? 0 : 2;
+    });
+    REQUIRE(Wait(child) == 0);
+    REQUIRE(table.Holders() == 2);
+}
+
+TEST_CASE("Opening a segment that is not ready") {
+    SegmentName name("not_ready");
+    auto segment = SharedSegment::Create(name.Get(), 1 << 16);
+    auto table = segment.Make<Table>("table");
+    table->values[0] = 7;
+
+    // Hide the segment's magic, as if its creator had not initialized it yet.
+    int fd = shm_open(name.Get().c_str(), O_RDWR, 0);
+    REQUIRE(fd >= 0);
+    void* raw = mmap(nullptr, sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    REQUIRE(raw != MAP_FAILED);
+    auto* magic = static_cast<std::atomic<uint64_t>*>(raw);
+    uint64_t saved = magic->exchange(0);
+    REQUIRE_THROWS_AS(SharedSegment::Open(name.Get()), std::runtime_error);
+    magic->store(saved);
+    munmap(raw, sizeof(uint64_t));
+
+    // The failed open left the slot of this process alone.
+    REQUIRE(segment.Processes() == 1);
+    REQUIRE(table.UseCount() == 1);
+    REQUIRE(segment.Find<Table>("table")->values[0] == 7);
+    REQUIRE(segment.LiveObjects() == 1);
+
+    SegmentName truncated("truncated");
+    fd = shm_open(truncated.Get().c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    REQUIRE(fd >= 0);
+    REQUIRE(ftruncate(fd, 16) == 0);
+    close(fd);
+    REQUIRE_THROWS_AS(SharedSegment::Open(truncated.Get()), std::runtime_error);
+}
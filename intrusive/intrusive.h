@@ -1,5 +1,9 @@
 #pragma once
 
+#include "../lifetime/lifetime.h"
+#include "../trace/trace.h"
+
+#include <atomic>
 #include <cstddef>  // for std::nullptr_t
 #include <utility>  // for std::exchange / std::swap
 
@@ -23,6 +27,38 @@ private:
     size_t count_ = 0;
 };
 
+// Lets handles to the same object be copied and dropped from different threads.
+class AtomicCounter {
+public:
+    size_t IncRef() {
+        return count_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    size_t DecRef() {
+        return count_.fetch_sub(1, std::memory_order_acq_rel) - 1;
+    }
+
+    // Fails once the count has dropped to zero: the object is being destroyed.
+    bool TryIncRef() {
+        size_t count = count_.load(std::memory_order_relaxed);
+        while (count != 0) {
+            if (count_.compare_exchange_weak(count, count + 1, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Acquire, so that a caller seeing 1 may modify the object in place: everything the other,
+    // already gone, owners did with it happens before.
+    size_t RefCount() const {
+        return count_.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<size_t> count_ = 0;
+};
+
 struct DefaultDelete {
 
     template <typename T>
@@ -31,77 +67,70 @@ struct DefaultDelete {
     }
 };
 
+// The counter lives inside the object, so an `IntrusivePtr` costs one allocation per object.
+// Copying or assigning the object does not copy its counter: the count is a property of the
+// object's identity, not of its value.
 template <typename Derived, typename Counter, typename Deleter>
 class RefCounted {
 public:
-    RefCounted() : counter_(new Counter()) {
-    }
+    RefCounted() = default;
 
-    // Increase reference counter.
-    void IncRef() {
-        counter_->IncRef();
+    RefCounted(const RefCounted&) {
     }
 
-    // Decrease reference counter.
-    // Destroy object using Deleter when the last instance dies.
-    void DecRef() {
-        counter_->DecRef();
-        if (RefCount() == 0) {
-            Deleter::Destroy(static_cast<Derived*>(this));
-        }
+    RefCounted& operator=(const RefCounted&) {
+        return *this;
     }
 
-    // Get current counter value (the number of strong references).
-    size_t RefCount() const {
-        if (counter_ != nullptr) {
-            return counter_->RefCount();
+    // Increase reference counter.
+    void IncRef() {
+        if (counter_.IncRef() == 1) {
+            SMART_PTRS_TRACE_EVENT(kCreate, kIntrusive, static_cast<Derived*>(this));
         } else {
-            return 0;
+            SMART_PTRS_TRACE_EVENT(kCopy, kIntrusive, static_cast<Derived*>(this));
         }
     }
 
-    RefCounted& operator=(const RefCounted& other) {
-        Counter* old_counter = counter_;
-        counter_ = other.counter_;
-        IncRef();
-        if (old_counter != nullptr) {
-            delete old_counter;
+    // Increase reference counter unless it has reached zero; only counters with `TryIncRef`.
+    bool TryIncRef() {
+        if (!counter_.TryIncRef()) {
+            SMART_PTRS_TRACE_EVENT(kLockFail, kIntrusive, static_cast<Derived*>(this));
+            return false;
         }
-        return *this;
+        SMART_PTRS_TRACE_EVENT(kCopy, kIntrusive, static_cast<Derived*>(this));
+        return true;
     }
 
-    RefCounted& operator=(RefCounted&& other) {
-        if (this != &other) {
-            Counter* old_counter = counter_;
-            if (counter_ != nullptr) {
-                counter_->DecRef();
-            }
-            counter_ = std::move(other.counter_);
-            other.counter_ = nullptr;
-            if (RefCount() == 0) {
-                IncRef();
-            }
-            if (old_counter != nullptr && old_counter->RefCount() == 0) {
-                delete old_counter;
-            }
+    // Decrease reference counter.
+    // Destroy object using Deleter when the last instance dies.
+    void DecRef() {
+        SMART_PTRS_TRACE_EVENT(kDestroy, kIntrusive, static_cast<Derived*>(this));
+        if (counter_.DecRef() == 0) {
+            SMART_PTRS_TRACE_EVENT(kZero, kIntrusive, static_cast<Derived*>(this));
+            SMART_PTRS_LIFETIME_RECORD(Derived, lifetime_stamp_);
+            Deleter::Destroy(static_cast<Derived*>(this));
         }
-        return *this;
     }
 
-    ~RefCounted() {
-        if (counter_ != nullptr) {
-            delete counter_;
-            counter_ = nullptr;
-        }
+    // Get current counter value (the number of strong references).
+    size_t RefCount() const {
+        return counter_.RefCount();
     }
 
 private:
-    Counter* counter_;
+    Counter counter_;
+
+#ifdef SMART_PTRS_LIFETIME
+    ptr_lifetime::Stamp lifetime_stamp_;
+#endif
 };
 
 template <typename Derived, typename D = DefaultDelete>
 using SimpleRefCounted = RefCounted<Derived, SimpleCounter, D>;
 
+template <typename Derived, typename D = DefaultDelete>
+using AtomicRefCounted = RefCounted<Derived, AtomicCounter, D>;
+
 template <typename T>
 class IntrusivePtr {
     template <typename Y>
@@ -121,6 +150,13 @@ public:
         }
     }
 
+    // With `add_ref == false` takes over a reference the caller has already counted.
+    IntrusivePtr(T* ptr, bool add_ref) : ptr_(ptr) {
+        if (ptr_ != nullptr && add_ref) {
+            ptr_->IncRef();
+        }
+    }
+
     template <typename Y>
     IntrusivePtr(const IntrusivePtr<Y>& other) {
         if (other.ptr_ != nullptr) {
@@ -135,6 +171,7 @@ public:
     IntrusivePtr(IntrusivePtr<Y>&& other) {
         ptr_ = std::move(dynamic_cast<T*>(other.ptr_));
         other.ptr_ = nullptr;
+        SMART_PTRS_TRACE_EVENT(kMove, kIntrusive, ptr_);
     }
 
     IntrusivePtr(const IntrusivePtr& other) : ptr_(other.ptr_) {
@@ -145,6 +182,7 @@ public:
 
     IntrusivePtr(IntrusivePtr&& other) : ptr_(std::move(other.ptr_)) {
         other.ptr_ = nullptr;
+        SMART_PTRS_TRACE_EVENT(kMove, kIntrusive, ptr_);
     }
 
     // `operator=`-s
@@ -173,6 +211,7 @@ public:
             T* old_ptr = ptr_;
             ptr_ = std::move(dynamic_cast<T*>(other.ptr_));
             other.ptr_ = nullptr;
+            SMART_PTRS_TRACE_EVENT(kMove, kIntrusive, ptr_);
             if (old_ptr != nullptr) {
                 old_ptr->DecRef();
             }
@@ -188,6 +227,7 @@ public:
         T* old_ptr = ptr_;
         ptr_ = std::move(dynamic_cast<T*>(other.ptr_));
         other.ptr_ = nullptr;
+        SMART_PTRS_TRACE_EVENT(kMove, kIntrusive, ptr_);
         if (old_ptr != nullptr) {
             old_ptr->DecRef();
         }
@@ -254,6 +294,11 @@ private:
     T* ptr_;
 };
 
+template <typename T, typename U>
+inline bool operator==(const IntrusivePtr<T>& left, const IntrusivePtr<U>& right) {
+    return left.Get() == right.Get();
+}
+
 template <typename T, typename... Args>
 IntrusivePtr<T> MakeIntrusive(Args&&... args) {
     return IntrusivePtr<T>(new T(std::forward<Args>(args)...));
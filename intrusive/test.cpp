@@ -3,7 +3,10 @@
 #include "allocations_checker.h"
 #include "catch2/catch_test_macros.hpp"
 
+#include <atomic>
 #include <string>
+#include <thread>
+#include <vector>
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -396,3 +399,28 @@ TEST_CASE("Object pool") {
         REQUIRE(strs.NumInUse() == 1);
     }
 }
+
+TEST_CASE("Atomic counter") {
+    struct Shared : AtomicRefCounted<Shared> {
+        int value = 7;
+    };
+
+    constexpr int kThreads = 4;
+    constexpr int kCopies = 100'000;
+    auto ptr = MakeIntrusive<Shared>();
+    std::atomic<int> wrong = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back([&ptr, &wrong] {
+            for (int j = 0; j < kCopies; ++j) {
+                IntrusivePtr<Shared> copy = ptr;
+                wrong.fetch_add(copy->value != 7, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(ptr.UseCount() == 1);
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+// Per-type lifetime histograms. Built with `-DSMART_PTRS_LIFETIME`, control blocks and
+// `RefCounted` objects remember when they were created, and the lifetime of every object
+// destroyed through `SharedPtr` or `IntrusivePtr` is added to the histogram of its type;
+// otherwise the hooks expand to nothing.
+//
+// The whole program has to agree on the flag: it changes the layout of `ControlBlock` and
+// `RefCounted`.
+#ifndef SMART_PTRS_LIFETIME
+
+#define SMART_PTRS_LIFETIME_RECORD(T, stamp) static_cast<void>(0)
+
+#else
+
+#define SMART_PTRS_LIFETIME_RECORD(T, stamp) ::ptr_lifetime::Record<T>(stamp)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+#include <cxxabi.h>
+
+namespace ptr_lifetime {
+
+inline uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Creation time, taken when the owner is constructed.
+struct Stamp {
+    uint64_t created = Now();
+};
+
+// Log-linear histogram of nanoseconds: values below `kSubBuckets` are counted exactly, every
+// power of two above is split into `kSubBuckets` equal buckets, so a bucket is at most
+// 1 / `kSubBuckets` of its values wide. Adding is a relaxed increment, readers see a histogram
+// that may be a few values behind.
+class Histogram {
+public:
+    static constexpr int kSubBits = 4;
+    static constexpr size_t kSubBuckets = size_t{1} << kSubBits;
+    static constexpr size_t kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+    static size_t BucketOf(uint64_t value) {
+        if (value < kSubBuckets) {
+            return value;
+        }
+        int shift = std::bit_width(value) - 1 - kSubBits;
+        return (shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets);
+    }
+
+    // The smallest value of the bucket.
+    static uint64_t LowerBound(size_t bucket) {
+        if (bucket < kSubBuckets) {
+            return bucket;
+        }
+        int shift = static_cast<int>(bucket / kSubBuckets) - 1;
+        return (kSubBuckets + bucket % kSubBuckets) << shift;
+    }
+
+    // The largest value of the bucket.
+    static uint64_t UpperBound(size_t bucket) {
+        return bucket + 1 == kBuckets ? UINT64_MAX : LowerBound(bucket + 1) - 1;
+    }
+
+    Histogram() = default;
+
+    Histogram(const Histogram&) = delete;
+    Histogram& operator=(const Histogram&) = delete;
+
+    void Add(uint64_t value) {
+        buckets_[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    // Counts racing with `Reset` may survive it.
+    void Reset() {
+        for (auto& bucket : buckets_) {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        sum_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t Count() const {
+        uint64_t count = 0;
+        for (const auto& bucket : buckets_) {
+            count += bucket.load(std::memory_order_relaxed);
+        }
+        return count;
+    }
+
+    double Mean() const {
+        uint64_t count = Count();
+        return count == 0 ? 0 : static_cast<double>(sum_.load(std::memory_order_relaxed)) / count;
+    }
+
+    // Upper bounds of the buckets holding the given quantiles, from one pass over the counts.
+    // Zeros for an empty histogram.
+    std::vector<uint64_t> Percentiles(const std::vector<double>& quantiles) const {
+        std::vector<uint64_t> counts(kBuckets);
+        uint64_t total = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            counts[i] = buckets_[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        std::vector<uint64_t> result;
+        for (double quantile : quantiles) {
+            if (total == 0) {
+                result.push_back(0);
+                continue;
+            }
+            auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(quantile * total)));
+            uint64_t seen = 0;
+            size_t bucket = 0;
+            while (seen + counts[bucket] < rank) {
+                seen += counts[bucket++];
+            }
+            result.push_back(UpperBound(bucket));
+        }
+        return result;
+    }
+
+    uint64_t Percentile(double quantile) const {
+        return Percentiles({quantile})[0];
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> sum_ = 0;
+};
+
+// Histogram of one type, linked into `histograms` when the type records its first object.
+class TypeHistogram : public Histogram {
+public:
+    explicit TypeHistogram(const std::type_info& type) : type_(type) {
+    }
+
+    const std::type_info& Type() const {
+        return type_;
+    }
+
+    TypeHistogram* next = nullptr;
+
+private:
+    const std::type_info& type_;
+};
+
+// Histograms are never freed: objects destroyed during static destruction still record.
+inline std::atomic<TypeHistogram*> histograms = nullptr;
+
+template <typename T>
+TypeHistogram& HistogramOf() {
+    static TypeHistogram* histogram = [] {
+        auto* histogram = new TypeHistogram(typeid(T));
+        TypeHistogram* head = histograms.load(std::memory_order_relaxed);
+        do {
+            histogram->next = head;
+        } while (!histograms.compare_exchange_weak(head, histogram, std::memory_order_release,
+                                                   std::memory_order_relaxed));
+        return histogram;
+    }();
+    return *histogram;
+}
+
+template <typename T>
+void Record(const Stamp& stamp) {
+    HistogramOf<T>().Add(Now() - stamp.created);
+}
+
+inline std::string Demangle(const char* name) {
+    int status = 0;
+    std::unique_ptr<char, void (*)(void*)> demangled(
+        abi::__cxa_demangle(name, nullptr, nullptr, &status), std::free);
+    return status == 0 ? demangled.get() : name;
+}
+
+struct TypeLifetimes {
+    std::string type;
+    uint64_t count = 0;
+
+    // Nanoseconds.
+    double mean = 0;
+    std::vector<uint64_t> percentiles;
+};
+
+// Types that destroyed at least one object, most destroyed first. `percentiles[i]` is the
+// lifetime in nanoseconds at `quantiles[i]`, rounded up to the end of its bucket.
+inline std::vector<TypeLifetimes> Report(
+    const std::vector<double>& quantiles = {0.5, 0.9, 0.99, 0.999}) {
+    std::vector<TypeLifetimes> report;
+    for (TypeHistogram* histogram = histograms.load(std::memory_order_acquire);
+         histogram != nullptr; histogram = histogram->next) {
+        uint64_t count = histogram->Count();
+        if (count == 0) {
+            continue;
+        }
+        report.push_back({Demangle(histogram->Type().name()), count, histogram->Mean(),
+                          histogram->Percentiles(quantiles)});
+    }
+    std::stable_sort(report.begin(), report.end(),
+                     [](const auto& a, const auto& b) { return a.count > b.count; });
+    return report;
+}
+
+// Forgets everything recorded so far.
+inline void Reset() {
+    for (TypeHistogram* histogram = histograms.load(std::memory_order_acquire);
+         histogram != nullptr; histogram = histogram->next) {
+        histogram->Reset();
+    }
+}
+
+// One line per type, times in microseconds:
+//
+//         count      mean       p50       p90       p99     p99.9  type
+//        100000     0.120     0.087     0.151     1.215    13.311  Node
+inline void Dump(std::ostream& out) {
+    char line[128];
+    std::snprintf(line, sizeof(line), "%12s  %8s  %8s  %8s  %8s  %8s  %s\n", "count", "mean",
+                  "p50", "p90", "p99", "p99.9", "type");
+    out << line;
+    for (const TypeLifetimes& lifetimes : Report()) {
+        std::snprintf(line, sizeof(line), "%12llu  %8.3f",
+                      static_cast<unsigned long long>(lifetimes.count), lifetimes.mean / 1000);
+        out << line;
+        for (uint64_t percentile : lifetimes.percentiles) {
+            std::snprintf(line, sizeof(line), "  %8.3f", static_cast<double>(percentile) / 1000);
+            out << line;
+        }
+        out << "  " << lifetimes.type << '\n';
+    }
+}
+
+}  // namespace ptr_lifetime
+
+#endif
@@ -0,0 +1,168 @@
+#include "lifetime.h"
+
+#include "../arena/arena.h"
+#include "../intrusive/intrusive.h"
+#include "../weak/shared.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+using ptr_lifetime::Histogram;
+
+struct Short {
+    int value = 0;
+};
+
+struct Long {
+    int value = 0;
+};
+
+struct Widget : AtomicRefCounted<Widget> {};
+
+struct Pod {
+    int value = 0;
+};
+
+ptr_lifetime::TypeLifetimes LifetimesOf(const std::string& type) {
+    for (auto& lifetimes : ptr_lifetime::Report()) {
+        if (lifetimes.type == type) {
+            return lifetimes;
+        }
+    }
+    return {};
+}
+
+}  // namespace
+
+TEST_CASE("Buckets") {
+    for (uint64_t value : {uint64_t{0}, uint64_t{15}, uint64_t{16}, uint64_t{17}, uint64_t{1000},
+                           uint64_t{123456789}, UINT64_MAX}) {
+        size_t bucket = Histogram::BucketOf(value);
+        REQUIRE(bucket < Histogram::kBuckets);
+        REQUIRE(Histogram::LowerBound(bucket) <= value);
+        REQUIRE(value <= Histogram::UpperBound(bucket));
+        uint64_t width = Histogram::UpperBound(bucket) - Histogram::LowerBound(bucket);
+        REQUIRE(width <= value / Histogram::kSubBuckets);
+    }
+    int wrong = 0;
+    for (size_t bucket = 0; bucket + 1 < Histogram::kBuckets; ++bucket) {
+        wrong += Histogram::UpperBound(bucket) + 1 != Histogram::LowerBound(bucket + 1);
+        wrong += Histogram::BucketOf(Histogram::LowerBound(bucket)) != bucket;
+    }
+    REQUIRE(wrong == 0);
+}
+
+TEST_CASE("Percentiles") {
+    Histogram histogram;
+    REQUIRE(histogram.Percentile(0.5) == 0);
+    for (uint64_t value = 1; value <= 10000; ++value) {
+        histogram.Add(value);
+    }
+    REQUIRE(histogram.Count() == 10000);
+    REQUIRE(histogram.Mean() == 5000.5);
+
+    auto percentiles = histogram.Percentiles({0.5, 0.99, 1});
+    REQUIRE(percentiles[0] >= 5000);
+    REQUIRE(percentiles[0] <= 5000 + 5000 / Histogram::kSubBuckets);
+    REQUIRE(percentiles[1] >= 9900);
+    REQUIRE(percentiles[1] <= 9900 + 9900 / Histogram::kSubBuckets);
+    REQUIRE(percentiles[2] >= 10000);
+
+    histogram.Reset();
+    REQUIRE(histogram.Count() == 0);
+}
+
+TEST_CASE("Lifetimes by type") {
+    ptr_lifetime::Reset();
+    for (int i = 0; i < 100; ++i) {
+        auto ptr = MakeShared<Short>();
+    }
+    {
+        auto made = MakeShared<Long>();
+        SharedPtr<Long> adopted(new Long());
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    {
+        auto widget = MakeIntrusive<Widget>();
+        auto copy = widget;
+    }
+    {
+        Arena arena;
+        auto pod = MakeArenaShared<Pod>(arena);
+    }
+
+    auto shorts = LifetimesOf("(anonymous namespace)::Short");
+    REQUIRE(shorts.count == 100);
+    REQUIRE(shorts.percentiles.size() == 4);
+    REQUIRE(shorts.percentiles[0] < 2'000'000);
+
+    auto longs = LifetimesOf("(anonymous namespace)::Long");
+    REQUIRE(longs.count == 2);
+    REQUIRE(longs.percentiles[0] >= 2'000'000);
+    REQUIRE(longs.mean >= 2'000'000);
+
+    REQUIRE(LifetimesOf("(anonymous namespace)::Widget").count == 1);
+    REQUIRE(LifetimesOf("(anonymous namespace)::Pod").count == 1);
+
+    auto report = ptr_lifetime::Report();
+    REQUIRE(report.front().type == "(anonymous namespace)::Short");
+
+    std::ostringstream out;
+    ptr_lifetime::Dump(out);
+    REQUIRE(out.str().find("p99.9") != std::string::npos);
+    REQUIRE(out.str().find("(anonymous namespace)::Long") != std::string::npos);
+
+    ptr_lifetime::Reset();
+    REQUIRE(LifetimesOf("(anonymous namespace)::Short").count == 0);
+}
+
+TEST_CASE("Objects alive are not recorded") {
+    ptr_lifetime::Reset();
+    auto ptr = MakeShared<Long>();
+    REQUIRE(LifetimesOf("(anonymous namespace)::Long").count == 0);
+    ptr.Reset();
+    REQUIRE(LifetimesOf("(anonymous namespace)::Long").count == 1);
+}
+
+// Run under TSan: cmake -DCMAKE_BUILD_TYPE=TSAN
+TEST_CASE("Recording from many threads") {
+    constexpr int kThreads = 4;
+    constexpr int kObjects = 10000;
+
+    ptr_lifetime::Reset();
+    std::atomic<bool> stop = false;
+    std::thread reader([&] {
+        while (!stop.load()) {
+            ptr_lifetime::Report();
+        }
+    });
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([] {
+            for (int i = 0; i < kObjects; ++i) {
+                auto ptr = MakeShared<Short>();
+                auto widget = MakeIntrusive<Widget>();
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    stop = true;
+    reader.join();
+
+    REQUIRE(LifetimesOf("(anonymous namespace)::Short").count == kThreads * kObjects);
+    REQUIRE(LifetimesOf("(anonymous namespace)::Widget").count == kThreads * kObjects);
+}
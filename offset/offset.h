@@ -0,0 +1,254 @@
+#pragma once
+
+#include <cstddef>  // std::nullptr_t
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Pointers to data that may be copied byte for byte to another address, written to a file and
+// mapped back anywhere: they store the distance from themselves to the object rather than its
+// address, so a structure built of them together with the objects they point to stays valid
+// wherever it lands, with no fix-up on load. Both ends have to move together: a pointer from a
+// region to outside of it, or the other way round, is valid only where it was set.
+//
+// Copying and moving the pointers themselves recompute the distance.
+
+// Non-owning.
+template <typename T>
+class OffsetPtr {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    OffsetPtr() = default;
+
+    OffsetPtr(std::nullptr_t) {
+    }
+
+    OffsetPtr(T* ptr) {
+        Set(ptr);
+    }
+
+    OffsetPtr(const OffsetPtr& other) {
+        Set(other.Get());
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    OffsetPtr& operator=(const OffsetPtr& other) {
+        Set(other.Get());
+        return *this;
+    }
+
+    OffsetPtr& operator=(T* ptr) {
+        Set(ptr);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        if (offset_ == kNull) {
+            return nullptr;
+        }
+        return reinterpret_cast<T*>(reinterpret_cast<uintptr_t>(this) + offset_);
+    }
+
+    std::add_lvalue_reference_t<T> operator*() const {
+        return *Get();
+    }
+
+    T* operator->() const {
+        return Get();
+    }
+
+    explicit operator bool() const {
+        return offset_ != kNull;
+    }
+
+private:
+    // The byte after the pointer itself, which no object that needs the pointer aligned can
+    // start at; zero would be the pointer itself, a valid target for the first member of `T`.
+    static constexpr uintptr_t kNull = 1;
+
+    void Set(T* ptr) {
+        offset_ = ptr == nullptr
+                      ? kNull
+                      : reinterpret_cast<uintptr_t>(ptr) - reinterpret_cast<uintptr_t>(this);
+    }
+
+    // Modulo 2^64, so that targets below the pointer need no signed arithmetic.
+    uintptr_t offset_ = kNull;
+};
+
+template <typename T, typename U>
+inline bool operator==(const OffsetPtr<T>& left, const OffsetPtr<U>& right) {
+    return left.Get() == right.Get();
+}
+
+// Owns the object it points to: destroys it on `Reset` and in the destructor. The memory
+// belongs to the region the object was created in, see `MakeOffsetUnique`.
+template <typename T>
+class OffsetUniquePtr {
+public:
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    OffsetUniquePtr() = default;
+
+    OffsetUniquePtr(std::nullptr_t) {
+    }
+
+    explicit OffsetUniquePtr(T* ptr) : ptr_(ptr) {
+    }
+
+    OffsetUniquePtr(OffsetUniquePtr&& other) noexcept : ptr_(other.Release()) {
+    }
+
+    OffsetUniquePtr(const OffsetUniquePtr&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    OffsetUniquePtr& operator=(OffsetUniquePtr&& other) noexcept {
+        if (this != &other) {
+            Reset(other.Release());
+        }
+        return *this;
+    }
+
+    OffsetUniquePtr& operator=(std::nullptr_t) {
+        Reset();
+        return *this;
+    }
+
+    OffsetUniquePtr& operator=(const OffsetUniquePtr&) = delete;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~OffsetUniquePtr() {
+        Reset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    T* Release() {
+        T* ptr = ptr_.Get();
+        ptr_ = nullptr;
+        return ptr;
+    }
+
+    void Reset(T* ptr = nullptr) {
+        T* old_ptr = ptr_.Get();
+        ptr_ = ptr;
+        if (old_ptr != nullptr) {
+            std::destroy_at(old_ptr);
+        }
+    }
+
+    void Swap(OffsetUniquePtr& other) {
+        T* ptr = Release();
+        ptr_ = other.Release();
+        other.ptr_ = ptr;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        return ptr_.Get();
+    }
+
+    explicit operator bool() const {
+        return static_cast<bool>(ptr_);
+    }
+
+    std::add_lvalue_reference_t<T> operator*() const {
+        return *ptr_;
+    }
+
+    T* operator->() const {
+        return ptr_.Get();
+    }
+
+private:
+    OffsetPtr<T> ptr_;
+};
+
+// Bump allocator over one contiguous buffer, for building data out of `OffsetPtr`s: the bytes
+// `[Data(), Data() + Size())` may then be written out and used from wherever they are read or
+// mapped. Nothing is freed until the region goes away, and destructors of objects no
+// `OffsetUniquePtr` owns are not run.
+class OffsetRegion {
+public:
+    // Objects in the region are aligned to at most this.
+    static constexpr size_t kAlignment = 64;
+
+    explicit OffsetRegion(size_t capacity)
+        : data_(static_cast<char*>(::operator new(capacity, std::align_val_t(kAlignment)))),
+          capacity_(capacity) {
+        // Padding ends up in the file too.
+        std::memset(data_, 0, capacity_);
+    }
+
+    OffsetRegion(const OffsetRegion&) = delete;
+    OffsetRegion& operator=(const OffsetRegion&) = delete;
+
+    ~OffsetRegion() {
+        ::operator delete(data_, std::align_val_t(kAlignment));
+    }
+
+    // Throws `std::bad_alloc` when the region is full.
+    void* Allocate(size_t size, size_t alignment) {
+        size_t begin = (size_ + alignment - 1) & ~(alignment - 1);
+        if (alignment > kAlignment || begin + size > capacity_) {
+            throw std::bad_alloc();
+        }
+        size_ = begin + size;
+        return data_ + begin;
+    }
+
+    // The first object created is the root, see `OffsetRoot`.
+    template <typename T, typename... Args>
+    T* New(Args&&... args) {
+        return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    const char* Data() const {
+        return data_;
+    }
+
+    // Bytes used so far.
+    size_t Size() const {
+        return size_;
+    }
+
+private:
+    char* data_;
+    size_t capacity_;
+    size_t size_ = 0;
+};
+
+template <typename T, typename... Args>
+OffsetUniquePtr<T> MakeOffsetUnique(OffsetRegion& region, Args&&... args) {
+    return OffsetUniquePtr<T>(region.New<T>(std::forward<Args>(args)...));
+}
+
+// The first object of a region's bytes, wherever they are now. `data` must be aligned as the
+// region was.
+template <typename T>
+T* OffsetRoot(void* data) {
+    return std::launder(static_cast<T*>(data));
+}
+
+template <typename T>
+const T* OffsetRoot(const void* data) {
+    return std::launder(static_cast<const T*>(data));
+}
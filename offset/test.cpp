@@ -0,0 +1,206 @@
+#include "offset.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node {
+    static int alive;
+
+    explicit Node(int64_t key) : key(key) {
+        ++alive;
+    }
+
+    ~Node() {
+        --alive;
+    }
+
+    int64_t key;
+    OffsetUniquePtr<Node> left;
+    OffsetUniquePtr<Node> right;
+    OffsetPtr<Node> parent;
+};
+
+int Node::alive = 0;
+
+struct Tree {
+    OffsetUniquePtr<Node> root;
+    int64_t size = 0;
+};
+
+// Balanced over `[begin, end)`.
+OffsetUniquePtr<Node> Build(OffsetRegion& region, int64_t begin, int64_t end, Node* parent) {
+    if (begin == end) {
+        return nullptr;
+    }
+    int64_t middle = begin + (end - begin) / 2;
+    auto node = MakeOffsetUnique<Node>(region, middle);
+    node->parent = parent;
+    node->left = Build(region, begin, middle, node.Get());
+    node->right = Build(region, middle + 1, end, node.Get());
+    return node;
+}
+
+bool Contains(const Tree& tree, int64_t key) {
+    for (const Node* node = tree.root.Get(); node != nullptr;) {
+        if (node->key == key) {
+            return true;
+        }
+        node = key < node->key ? node->left.Get() : node->right.Get();
+    }
+    return false;
+}
+
+// Keys in order, following parent pointers back up.
+std::vector<int64_t> InOrder(const Tree& tree) {
+    std::vector<int64_t> keys;
+    const Node* node = tree.root.Get();
+    while (node != nullptr && node->left) {
+        node = node->left.Get();
+    }
+    while (node != nullptr) {
+        keys.push_back(node->key);
+        if (node->right) {
+            node = node->right.Get();
+            while (node->left) {
+                node = node->left.Get();
+            }
+            continue;
+        }
+        const Node* child = node;
+        node = node->parent.Get();
+        while (node != nullptr && node->right.Get() == child) {
+            child = node;
+            node = node->parent.Get();
+        }
+    }
+    return keys;
+}
+
+void Check(const Tree& tree) {
+    REQUIRE(tree.size == 1000);
+    auto keys = InOrder(tree);
+    REQUIRE(keys.size() == 1000);
+    for (int64_t i = 0; i < 1000; ++i) {
+        REQUIRE(keys[i] == i);
+    }
+    REQUIRE(Contains(tree, 0));
+    REQUIRE(Contains(tree, 999));
+    REQUIRE(!Contains(tree, 1000));
+}
+
+struct AlignedDelete {
+    void operator()(char* data) const {
+        ::operator delete(data, std::align_val_t(OffsetRegion::kAlignment));
+    }
+};
+
+}  // namespace
+
+TEST_CASE("OffsetPtr") {
+    int64_t values[4] = {1, 2, 3, 4};
+    OffsetPtr<int64_t> empty;
+    REQUIRE(!empty);
+    REQUIRE(empty.Get() == nullptr);
+
+    OffsetPtr<int64_t> ptr = &values[2];
+    REQUIRE(ptr);
+    REQUIRE(*ptr == 3);
+    REQUIRE(ptr.Get() == &values[2]);
+
+    // Copies point to the same object, wherever they are.
+    auto copies = std::make_unique<OffsetPtr<int64_t>[]>(2);
+    copies[0] = ptr;
+    copies[1] = copies[0];
+    REQUIRE(copies[1].Get() == &values[2]);
+    REQUIRE(copies[1] == ptr);
+
+    // Below and above the pointer.
+    struct Pair {
+        OffsetPtr<Pair> self;
+        OffsetPtr<int64_t> value;
+    } pair;
+    pair.self = &pair;
+    pair.value = &values[0];
+    REQUIRE(pair.self.Get() == &pair);
+    REQUIRE(pair.value.Get() == &values[0]);
+    pair.value = nullptr;
+    REQUIRE(!pair.value);
+}
+
+TEST_CASE("OffsetUniquePtr owns the object") {
+    OffsetRegion region(1 << 12);
+    {
+        auto node = MakeOffsetUnique<Node>(region, 1);
+        node->left = MakeOffsetUnique<Node>(region, 0);
+        REQUIRE(Node::alive == 2);
+
+        auto moved = std::move(node);
+        REQUIRE(!node);
+        REQUIRE(moved->left->key == 0);
+
+        moved->left.Reset();
+        REQUIRE(Node::alive == 1);
+
+        OffsetUniquePtr<Node> other = MakeOffsetUnique<Node>(region, 2);
+        moved.Swap(other);
+        REQUIRE(moved->key == 2);
+        REQUIRE(other->key == 1);
+
+        Node* released = other.Release();
+        REQUIRE(!other);
+        std::destroy_at(released);
+    }
+    REQUIRE(Node::alive == 0);
+    REQUIRE_THROWS_AS(region.Allocate(1 << 12, 8), std::bad_alloc);
+}
+
+TEST_CASE("Regions are relocatable") {
+    OffsetRegion region(1 << 16);
+    auto* tree = region.New<Tree>();
+    tree->root = Build(region, 0, 1000, nullptr);
+    tree->size = 1000;
+    Check(*tree);
+
+    SECTION("Copied") {
+        std::unique_ptr<char, AlignedDelete> copy(static_cast<char*>(
+            ::operator new(region.Size(), std::align_val_t(OffsetRegion::kAlignment))));
+        std::memcpy(copy.get(), region.Data(), region.Size());
+        Check(*OffsetRoot<Tree>(copy.get()));
+        // The copy does not refer to the original.
+        tree->root->key = -1;
+        Check(*OffsetRoot<Tree>(copy.get()));
+    }
+
+    SECTION("Written and mapped") {
+        char path[] = "/tmp/smart_ptrs_offset_XXXXXX";
+        int fd = mkstemp(path);
+        REQUIRE(fd >= 0);
+        unlink(path);
+        REQUIRE(write(fd, region.Data(), region.Size()) == static_cast<ssize_t>(region.Size()));
+        void* mapped = mmap(nullptr, region.Size(), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        REQUIRE(mapped != MAP_FAILED);
+        Check(*OffsetRoot<Tree>(static_cast<const void*>(mapped)));
+        munmap(mapped, region.Size());
+    }
+
+    // The region does not destroy what it holds; the tree owns its nodes.
+    tree->~Tree();
+    REQUIRE(Node::alive == 0);
+}
@@ -0,0 +1,392 @@
+#pragma once
+
+#include "../intrusive/intrusive.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <span>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Immutable hash map: a hash array mapped trie of `IntrusivePtr`-counted nodes. Every node
+// consumes 5 bits of the hash and keeps two 32-bit maps of the slots in use, one for entries
+// stored in the node and one for children; the position of a slot in the dense entry or child
+// array is the popcount of the map below its bit. Both arrays live in the node's allocation.
+// Keys whose 64-bit hashes are equal end up in a collision node that is searched linearly.
+//
+// Copying a map is O(1). `Set` and `Erase` copy the path to the changed entry and share
+// everything else with the old version. As in `PersistentVector`, the update itself modifies
+// nodes owned by the new version alone in place, which is also what `Build` relies on.
+//
+// Versions may be read and dropped from different threads.
+template <typename K, typename V, typename Hash = std::hash<K>, typename Equal = std::equal_to<K>>
+class PersistentMap {
+    static constexpr size_t kBits = 5;
+    static constexpr size_t kMask = (size_t{1} << kBits) - 1;
+    static constexpr size_t kHashBits = 64;
+
+    struct Entry {
+        uint64_t hash;
+        K key;
+        V value;
+    };
+
+    struct NodeDelete;
+
+    // Allocated together with its arrays: `children_size` children, then `entries_size` entries.
+    struct Node : AtomicRefCounted<Node, NodeDelete> {
+        Node(uint32_t entry_map, uint32_t child_map)
+            : entry_map(entry_map), child_map(child_map) {
+        }
+
+        Node(const Node&) = delete;
+        Node& operator=(const Node&) = delete;
+
+        static size_t EntriesOffset(size_t children) {
+            size_t offset = sizeof(Node) + children * sizeof(IntrusivePtr<Node>);
+            return (offset + alignof(Entry) - 1) / alignof(Entry) * alignof(Entry);
+        }
+
+        static size_t AllocationSize(size_t entries, size_t children) {
+            return EntriesOffset(children) + entries * sizeof(Entry);
+        }
+
+        IntrusivePtr<Node>* Children() const {
+            auto* base = reinterpret_cast<char*>(const_cast<Node*>(this));
+            return std::launder(reinterpret_cast<IntrusivePtr<Node>*>(base + sizeof(Node)));
+        }
+
+        Entry* Entries() const {
+            auto* base = reinterpret_cast<char*>(const_cast<Node*>(this));
+            return std::launder(reinterpret_cast<Entry*>(base + EntriesOffset(children_size)));
+        }
+
+        uint32_t entry_map;
+        uint32_t child_map;
+
+        // Constructed so far; in a collision node the maps are unused.
+        uint32_t entries_size = 0;
+        uint32_t children_size = 0;
+    };
+
+    static_assert(alignof(Entry) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+    struct NodeDelete {
+        static void Destroy(Node* node) {
+            std::destroy_n(node->Entries(), node->entries_size);
+            std::destroy_n(node->Children(), node->children_size);
+            node->~Node();
+            ::operator delete(node);
+        }
+    };
+
+    static constexpr size_t kNone = ~size_t{0};
+
+    // How `Reshape` turns a node into a new one; indexes are positions in the dense arrays, the
+    // insert positions are taken in the new node.
+    struct Change {
+        size_t erase_entry = kNone;
+        Entry* entry = nullptr;
+        size_t insert_entry = kNone;
+
+        size_t erase_child = kNone;
+        IntrusivePtr<Node>* child = nullptr;
+        size_t insert_child = kNone;
+    };
+
+    static size_t Index(uint32_t map, uint32_t bit) {
+        return std::popcount(map & (bit - 1));
+    }
+
+    static uint32_t Bit(uint64_t hash, size_t shift) {
+        return uint32_t{1} << ((hash >> shift) & kMask);
+    }
+
+    // Replaces the node in `slot` (or an empty one if there is none) with a changed copy. The
+    // arrays are moved from the old node if `slot` owns it alone and copied otherwise.
+    static void Reshape(IntrusivePtr<Node>& slot, uint32_t entry_map, uint32_t child_map,
+                        const Change& change) {
+        Node* old = slot.Get();
+        bool steal = old != nullptr && slot.UseCount() == 1;
+        size_t old_entries = old == nullptr ? 0 : old->entries_size;
+        size_t old_children = old == nullptr ? 0 : old->children_size;
+        size_t entries = old_entries - (change.erase_entry != kNone) + (change.entry != nullptr);
+        size_t children =
+            old_children - (change.erase_child != kNone) + (change.child != nullptr);
+
+        void* memory = ::operator new(Node::AllocationSize(entries, children));
+        auto* node = new (memory) Node(entry_map, child_map);
+        for (size_t to = 0, from = 0; to < children; ++to) {
+            IntrusivePtr<Node>* target = node->Children() + to;
+            if (to == change.insert_child) {
+                new (target) IntrusivePtr<Node>(std::move(*change.child));
+            } else {
+                from += from == change.erase_child;
+                IntrusivePtr<Node>& source = old->Children()[from++];
+                new (target) IntrusivePtr<Node>(steal ? std::move(source) : source);
+            }
+            ++node->children_size;
+        }
+        try {
+            for (size_t to = 0, from = 0; to < entries; ++to) {
+                Entry* target = node->Entries() + to;
+                if (to == change.insert_entry) {
+                    new (target) Entry(std::move(*change.entry));
+                } else {
+                    from += from == change.erase_entry;
+                    Entry& source = old->Entries()[from++];
+                    if (steal) {
+                        new (target) Entry(std::move(source));
+                    } else {
+                        new (target) Entry(source);
+                    }
+                }
+                ++node->entries_size;
+            }
+        } catch (...) {
+            NodeDelete::Destroy(node);
+            throw;
+        }
+        slot = IntrusivePtr<Node>(node);
+    }
+
+    static Node& Editable(IntrusivePtr<Node>& slot) {
+        if (!slot || slot.UseCount() != 1) {
+            uint32_t entry_map = slot ? slot->entry_map : 0;
+            uint32_t child_map = slot ? slot->child_map : 0;
+            Reshape(slot, entry_map, child_map, {});
+        }
+        return *slot;
+    }
+
+    static const Entry* Find(const Node* node, uint64_t hash, const K& key) {
+        Equal equal;
+        for (size_t shift = 0; node != nullptr; shift += kBits) {
+            if (shift >= kHashBits) {
+                for (const Entry& entry : std::span(node->Entries(), node->entries_size)) {
+                    if (equal(entry.key, key)) {
+                        return &entry;
+                    }
+                }
+                return nullptr;
+            }
+            uint32_t bit = Bit(hash, shift);
+            if (node->entry_map & bit) {
+                const Entry& entry = node->Entries()[Index(node->entry_map, bit)];
+                return entry.hash == hash && equal(entry.key, key) ? &entry : nullptr;
+            }
+            if (!(node->child_map & bit)) {
+                return nullptr;
+            }
+            node = node->Children()[Index(node->child_map, bit)].Get();
+        }
+        return nullptr;
+    }
+
+    // Returns true if the key was not in the map.
+    static bool Insert(IntrusivePtr<Node>& slot, size_t shift, Entry&& entry) {
+        const Node* node = slot.Get();
+        uint32_t entry_map = node == nullptr ? 0 : node->entry_map;
+        uint32_t child_map = node == nullptr ? 0 : node->child_map;
+
+        if (shift >= kHashBits) {
+            for (size_t i = 0; node != nullptr && i < node->entries_size; ++i) {
+                if (Equal()(node->Entries()[i].key, entry.key)) {
+                    Editable(slot).Entries()[i].value = std::move(entry.value);
+                    return false;
+                }
+            }
+            size_t end = node == nullptr ? 0 : node->entries_size;
+            Reshape(slot, 0, 0, {.entry = &entry, .insert_entry = end});
+            return true;
+        }
+
+        uint32_t bit = Bit(entry.hash, shift);
+        if (child_map & bit) {
+            return Insert(Editable(slot).Children()[Index(child_map, bit)], shift + kBits,
+                          std::move(entry));
+        }
+        size_t index = Index(entry_map, bit);
+        if (!(entry_map & bit)) {
+            Reshape(slot, entry_map | bit, child_map, {.entry = &entry, .insert_entry = index});
+            return true;
+        }
+        const Entry& existing = node->Entries()[index];
+        if (existing.hash == entry.hash && Equal()(existing.key, entry.key)) {
+            Editable(slot).Entries()[index].value = std::move(entry.value);
+            return false;
+        }
+
+        // Two keys in one slot: both go one level down.
+        IntrusivePtr<Node> child;
+        if (slot.UseCount() == 1) {
+            Insert(child, shift + kBits, std::move(slot->Entries()[index]));
+        } else {
+            Insert(child, shift + kBits, Entry(existing));
+        }
+        Insert(child, shift + kBits, std::move(entry));
+        Reshape(slot, entry_map & ~bit, child_map | bit,
+                {.erase_entry = index, .child = &child, .insert_child = Index(child_map, bit)});
+        return true;
+    }
+
+    // The key must be in the map. A child left with a single entry is merged into its parent,
+    // so that the trie stays as shallow as if the key had never been inserted.
+    static void Remove(IntrusivePtr<Node>& slot, size_t shift, uint64_t hash, const K& key) {
+        const Node* node = slot.Get();
+        if (shift >= kHashBits) {
+            size_t index = 0;
+            while (!Equal()(node->Entries()[index].key, key)) {
+                ++index;
+            }
+            Reshape(slot, 0, 0, {.erase_entry = index});
+            return;
+        }
+
+        uint32_t bit = Bit(hash, shift);
+        if (node->entry_map & bit) {
+            Reshape(slot, node->entry_map & ~bit, node->child_map,
+                    {.erase_entry = Index(node->entry_map, bit)});
+            return;
+        }
+        size_t index = Index(node->child_map, bit);
+        IntrusivePtr<Node>& child = Editable(slot).Children()[index];
+        Remove(child, shift + kBits, hash, key);
+        if (child->children_size == 0 && child->entries_size == 1) {
+            // `Remove` has just rebuilt the child, nobody else owns it.
+            Entry entry = std::move(child->Entries()[0]);
+            Reshape(slot, slot->entry_map | bit, slot->child_map & ~bit,
+                    {.entry = &entry,
+                     .insert_entry = Index(slot->entry_map, bit),
+                     .erase_child = index});
+        }
+    }
+
+    template <typename F>
+    static void ForEach(const Node* node, F& f) {
+        if (node == nullptr) {
+            return;
+        }
+        for (const Entry& entry : std::span(node->Entries(), node->entries_size)) {
+            f(entry.key, entry.value);
+        }
+        for (const auto& child : std::span(node->Children(), node->children_size)) {
+            ForEach(child.Get(), f);
+        }
+    }
+
+public:
+    PersistentMap() = default;
+
+    size_t Size() const {
+        return size_;
+    }
+
+    bool Empty() const {
+        return size_ == 0;
+    }
+
+    // Null if there is no such key. Valid while this version is alive.
+    const V* Find(const K& key) const {
+        const Entry* entry = Find(root_.Get(), Hash()(key), key);
+        return entry == nullptr ? nullptr : &entry->value;
+    }
+
+    bool Contains(const K& key) const {
+        return Find(key) != nullptr;
+    }
+
+    // Inserts or replaces.
+    PersistentMap Set(K key, V value) const {
+        PersistentMap result = *this;
+        uint64_t hash = Hash()(key);
+        if (Insert(result.root_, 0, Entry{hash, std::move(key), std::move(value)})) {
+            ++result.size_;
+        }
+        return result;
+    }
+
+    PersistentMap Erase(const K& key) const {
+        uint64_t hash = Hash()(key);
+        if (Find(root_.Get(), hash, key) == nullptr) {
+            return *this;
+        }
+        PersistentMap result = *this;
+        Remove(result.root_, 0, hash, key);
+        --result.size_;
+        return result;
+    }
+
+    // Calls `f(key, value)` for every entry, in no particular order.
+    template <typename F>
+    void ForEach(F f) const {
+        ForEach(root_.Get(), f);
+    }
+
+    // Builds a map from scratch on `threads` threads; of equal keys the last one wins. Hashes
+    // are computed in parallel, then every thread builds the subtrees of a share of the root's
+    // 32 slots, modifying its own nodes in place.
+    static PersistentMap Build(std::vector<std::pair<K, V>> items,
+                               size_t threads = std::thread::hardware_concurrency()) {
+        threads = std::clamp<size_t>(threads, 1, kMask + 1);
+        std::vector<uint64_t> hashes(items.size());
+        IntrusivePtr<Node> subtrees[kMask + 1];
+        size_t sizes[kMask + 1] = {};
+
+        auto run = [threads](auto work) {
+            std::vector<std::thread> workers;
+            for (size_t t = 1; t < threads; ++t) {
+                workers.emplace_back(work, t);
+            }
+            work(0);
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        };
+        run([&](size_t t) {
+            for (size_t i = t; i < items.size(); i += threads) {
+                hashes[i] = Hash()(items[i].first);
+            }
+        });
+        run([&](size_t t) {
+            for (size_t i = 0; i < items.size(); ++i) {
+                size_t slot = hashes[i] & kMask;
+                if (slot % threads == t) {
+                    Entry entry{hashes[i], std::move(items[i].first), std::move(items[i].second)};
+                    sizes[slot] += Insert(subtrees[slot], kBits, std::move(entry));
+                }
+            }
+        });
+
+        // The root is assembled the way `Insert` would have left it: a lone entry stays inline.
+        PersistentMap result;
+        Editable(result.root_);
+        for (size_t slot = 0; slot <= kMask; ++slot) {
+            IntrusivePtr<Node>& subtree = subtrees[slot];
+            if (!subtree) {
+                continue;
+            }
+            const Node& root = *result.root_;
+            uint32_t bit = uint32_t{1} << slot;
+            if (subtree->children_size == 0 && subtree->entries_size == 1) {
+                Reshape(result.root_, root.entry_map | bit, root.child_map,
+                        {.entry = subtree->Entries(), .insert_entry = root.entries_size});
+            } else {
+                Reshape(result.root_, root.entry_map, root.child_map | bit,
+                        {.child = &subtree, .insert_child = root.children_size});
+            }
+            result.size_ += sizes[slot];
+        }
+        return result;
+    }
+
+private:
+    IntrusivePtr<Node> root_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,260 @@
+#pragma once
+
+#include "../intrusive/intrusive.h"
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+// Immutable vector: a 32-way radix trie of `IntrusivePtr`-counted nodes plus a separate tail
+// leaf for the last up to 32 elements. `Set` and `PushBack` copy the path to the changed
+// element, O(log32 n) nodes, and share everything else with the old version.
+//
+// A `Transient` applies a batch of changes to a copy of a version. It modifies nodes it owns
+// alone (reference count 1) in place, so a node is copied at most once per batch; nodes still
+// reachable from other versions are copied first, exactly as in the persistent operations.
+//
+// Versions may be read and dropped from different threads. A `Transient` is not thread safe.
+template <typename T>
+class PersistentVector {
+    static constexpr size_t kBits = 5;
+    static constexpr size_t kWidth = size_t{1} << kBits;
+    static constexpr size_t kMask = kWidth - 1;
+
+    struct NodeDelete;
+
+    struct Node : AtomicRefCounted<Node, NodeDelete> {
+        explicit Node(bool leaf) : leaf(leaf) {
+        }
+
+        const bool leaf;
+    };
+
+    struct Branch : Node {
+        Branch() : Node(false) {
+        }
+
+        std::array<IntrusivePtr<Node>, kWidth> children;
+    };
+
+    // Elements are stored inline, so a leaf is a single allocation.
+    struct Leaf : Node {
+        Leaf() : Node(true) {
+        }
+
+        Leaf(const Leaf& other) : Node(true) {
+            try {
+                for (size_t i = 0; i < other.size; ++i) {
+                    Push(other.Data()[i]);
+                }
+            } catch (...) {
+                std::destroy_n(Data(), size);
+                throw;
+            }
+        }
+
+        ~Leaf() {
+            std::destroy_n(Data(), size);
+        }
+
+        T* Data() {
+            return std::launder(reinterpret_cast<T*>(storage));
+        }
+
+        const T* Data() const {
+            return std::launder(reinterpret_cast<const T*>(storage));
+        }
+
+        template <typename U>
+        void Push(U&& value) {
+            new (storage + size * sizeof(T)) T(std::forward<U>(value));
+            ++size;
+        }
+
+        size_t size = 0;
+        alignas(T) unsigned char storage[kWidth * sizeof(T)];
+    };
+
+    // The only deleter knowing the node types; the nodes need no virtual destructor.
+    struct NodeDelete {
+        static void Destroy(Node* node) {
+            if (node->leaf) {
+                delete static_cast<Leaf*>(node);
+            } else {
+                delete static_cast<Branch*>(node);
+            }
+        }
+    };
+
+    // Operations shared by versions and transients. They modify the nodes `Data` owns alone and
+    // copy the shared ones.
+    struct Data {
+        size_t size = 0;
+
+        // Levels of branches above the leaves, times `kBits`.
+        size_t shift = kBits;
+
+        IntrusivePtr<Node> root;
+        IntrusivePtr<Node> tail;
+
+        size_t TailOffset() const {
+            return size < kWidth ? 0 : (size - 1) & ~kMask;
+        }
+
+        const Leaf& LeafFor(size_t index) const {
+            if (index >= TailOffset()) {
+                return *static_cast<const Leaf*>(tail.Get());
+            }
+            const Node* node = root.Get();
+            for (size_t level = shift; level > 0; level -= kBits) {
+                node = static_cast<const Branch*>(node)->children[(index >> level) & kMask].Get();
+            }
+            return *static_cast<const Leaf*>(node);
+        }
+
+        T& MutableAt(size_t index) {
+            if (index >= TailOffset()) {
+                return EditableLeaf(tail).Data()[index & kMask];
+            }
+            IntrusivePtr<Node>* slot = &root;
+            for (size_t level = shift; level > 0; level -= kBits) {
+                slot = &EditableBranch(*slot).children[(index >> level) & kMask];
+            }
+            return EditableLeaf(*slot).Data()[index & kMask];
+        }
+
+        template <typename U>
+        void PushBack(U&& value) {
+            if (size - TailOffset() == kWidth) {
+                PushTail();
+            }
+            if (!tail) {
+                tail = IntrusivePtr<Node>(new Leaf());
+            }
+            EditableLeaf(tail).Push(std::forward<U>(value));
+            ++size;
+        }
+
+        // Moves the full tail into the trie, adding a level on top if the trie is full.
+        void PushTail() {
+            size_t offset = size - kWidth;
+            if ((size >> kBits) > (size_t{1} << shift)) {
+                auto* top = new Branch();
+                top->children[0] = std::move(root);
+                root = IntrusivePtr<Node>(top);
+                shift += kBits;
+            }
+            IntrusivePtr<Node>* slot = &root;
+            for (size_t level = shift; level > kBits; level -= kBits) {
+                slot = &EditableBranch(*slot).children[(offset >> level) & kMask];
+            }
+            EditableBranch(*slot).children[(offset >> kBits) & kMask] = std::move(tail);
+        }
+
+        static Branch& EditableBranch(IntrusivePtr<Node>& slot) {
+            if (!slot) {
+                slot = IntrusivePtr<Node>(new Branch());
+            } else if (slot.UseCount() != 1) {
+                slot = IntrusivePtr<Node>(new Branch(*static_cast<const Branch*>(slot.Get())));
+            }
+            return *static_cast<Branch*>(slot.Get());
+        }
+
+        static Leaf& EditableLeaf(IntrusivePtr<Node>& slot) {
+            if (slot.UseCount() != 1) {
+                slot = IntrusivePtr<Node>(new Leaf(*static_cast<const Leaf*>(slot.Get())));
+            }
+            return *static_cast<Leaf*>(slot.Get());
+        }
+    };
+
+public:
+    class Transient {
+    public:
+        explicit Transient(const PersistentVector& base) : data_(base.data_) {
+        }
+
+        const T& operator[](size_t index) const {
+            return data_.LeafFor(index).Data()[index & kMask];
+        }
+
+        const T& At(size_t index) const {
+            CheckIndex(index, data_.size);
+            return (*this)[index];
+        }
+
+        size_t Size() const {
+            return data_.size;
+        }
+
+        Transient& Set(size_t index, T value) {
+            CheckIndex(index, data_.size);
+            data_.MutableAt(index) = std::move(value);
+            return *this;
+        }
+
+        Transient& PushBack(T value) {
+            data_.PushBack(std::move(value));
+            return *this;
+        }
+
+        // The transient stays usable; its next changes copy the nodes shared with the result.
+        PersistentVector Persistent() const {
+            return PersistentVector(data_);
+        }
+
+    private:
+        Data data_;
+    };
+
+    PersistentVector() = default;
+
+    const T& operator[](size_t index) const {
+        return data_.LeafFor(index).Data()[index & kMask];
+    }
+
+    const T& At(size_t index) const {
+        CheckIndex(index, data_.size);
+        return (*this)[index];
+    }
+
+    size_t Size() const {
+        return data_.size;
+    }
+
+    bool Empty() const {
+        return data_.size == 0;
+    }
+
+    PersistentVector Set(size_t index, T value) const {
+        CheckIndex(index, data_.size);
+        Data data = data_;
+        data.MutableAt(index) = std::move(value);
+        return PersistentVector(std::move(data));
+    }
+
+    PersistentVector PushBack(T value) const {
+        Data data = data_;
+        data.PushBack(std::move(value));
+        return PersistentVector(std::move(data));
+    }
+
+    Transient AsTransient() const {
+        return Transient(*this);
+    }
+
+private:
+    explicit PersistentVector(Data data) : data_(std::move(data)) {
+    }
+
+    static void CheckIndex(size_t index, size_t size) {
+        if (index >= size) {
+            throw std::out_of_range("PersistentVector: index out of range");
+        }
+    }
+
+    Data data_;
+};
@@ -0,0 +1,183 @@
+#include "persistent_vector.h"
+
+#include "allocations_checker.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Tracked {
+    static std::atomic<int> alive;
+
+    Tracked(int value) : value(value) {
+        alive.fetch_add(1);
+    }
+
+    Tracked(const Tracked& other) : value(other.value) {
+        alive.fetch_add(1);
+    }
+
+    Tracked& operator=(const Tracked&) = default;
+
+    ~Tracked() {
+        alive.fetch_sub(1);
+    }
+
+    int value;
+};
+
+std::atomic<int> Tracked::alive = 0;
+
+PersistentVector<int> Iota(int n) {
+    auto transient = PersistentVector<int>().AsTransient();
+    for (int i = 0; i < n; ++i) {
+        transient.PushBack(i);
+    }
+    return transient.Persistent();
+}
+
+}  // namespace
+
+TEST_CASE("PersistentVector push and get") {
+    // Sizes around the tail and level boundaries: 32, 32 + 32 * 32, 32 + 32 * 32 * 32.
+    for (int n : {0, 1, 31, 32, 33, 64, 1056, 1057, 2000, 32800, 33000}) {
+        PersistentVector<int> vector;
+        for (int i = 0; i < n; ++i) {
+            vector = vector.PushBack(i);
+        }
+        REQUIRE(vector.Size() == static_cast<size_t>(n));
+        bool all_equal = true;
+        for (int i = 0; i < n; ++i) {
+            all_equal &= vector[i] == i;
+        }
+        REQUIRE(all_equal);
+        REQUIRE(Iota(n).Size() == vector.Size());
+    }
+}
+
+TEST_CASE("PersistentVector versions") {
+    auto base = Iota(5000);
+
+    SECTION("Set keeps the old version") {
+        auto changed = base.Set(0, -1).Set(4999, -2).Set(1234, -3);
+        REQUIRE(base[0] == 0);
+        REQUIRE(base[4999] == 4999);
+        REQUIRE(base[1234] == 1234);
+        REQUIRE(changed[0] == -1);
+        REQUIRE(changed[4999] == -2);
+        REQUIRE(changed[1234] == -3);
+        REQUIRE(changed[1235] == 1235);
+    }
+
+    SECTION("PushBack keeps the old version") {
+        auto longer = base.PushBack(5000);
+        auto other = base.PushBack(-1);
+        REQUIRE(base.Size() == 5000);
+        REQUIRE(longer[5000] == 5000);
+        REQUIRE(other[5000] == -1);
+    }
+
+    SECTION("Bounds") {
+        REQUIRE_THROWS_AS(base.At(5000), std::out_of_range);
+        REQUIRE_THROWS_AS(base.Set(5000, 0), std::out_of_range);
+        REQUIRE(base.At(4999) == 4999);
+    }
+}
+
+TEST_CASE("PersistentVector sharing") {
+    auto base = Iota(32 * 32 * 4);
+
+    SECTION("Set copies only the path") {
+        // Root, one branch and one leaf; the tail is shared.
+        auto before = alloc_checker::AllocCount();
+        auto changed = base.Set(100, -1);
+        REQUIRE(alloc_checker::AllocCount() == before + 3);
+    }
+
+    SECTION("Transient copies a node once") {
+        auto transient = base.AsTransient();
+        auto before = alloc_checker::AllocCount();
+        for (int i = 0; i < 32; ++i) {
+            transient.Set(i, -i);
+        }
+        REQUIRE(alloc_checker::AllocCount() == before + 3);
+        EXPECT_ZERO_ALLOCATIONS(transient.Set(5, 5));
+        REQUIRE(base[5] == 5);
+        REQUIRE(transient[31] == -31);
+    }
+
+    SECTION("Transient after Persistent") {
+        auto transient = base.AsTransient();
+        transient.Set(0, -1);
+        auto first = transient.Persistent();
+        transient.Set(0, -2);
+        auto second = transient.Persistent();
+        REQUIRE(base[0] == 0);
+        REQUIRE(first[0] == -1);
+        REQUIRE(second[0] == -2);
+    }
+
+    SECTION("Transient push into the tail does not allocate") {
+        auto transient = PersistentVector<int>().AsTransient();
+        transient.PushBack(0);
+        EXPECT_ZERO_ALLOCATIONS({
+            for (int i = 1; i < 32; ++i) {
+                transient.PushBack(i);
+            }
+        });
+    }
+}
+
+TEST_CASE("PersistentVector destroys elements") {
+    {
+        PersistentVector<Tracked> vector;
+        for (int i = 0; i < 100; ++i) {
+            vector = vector.PushBack(Tracked(i));
+        }
+        auto other = vector.Set(50, Tracked(-1));
+        REQUIRE(Tracked::alive == 100 + 32);
+        REQUIRE(other[50].value == -1);
+        REQUIRE(vector[50].value == 50);
+
+        auto transient = other.AsTransient();
+        transient.PushBack(Tracked(100)).Set(99, Tracked(0));
+        REQUIRE(transient.Size() == 101);
+    }
+    REQUIRE(Tracked::alive == 0);
+}
+
+// Run under TSan: cmake -DCMAKE_BUILD_TYPE=TSAN
+TEST_CASE("PersistentVector across threads") {
+    constexpr int kThreads = 4;
+    auto base = Iota(2000);
+    std::atomic<int> wrong = 0;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&wrong, version = base, t]() mutable {
+            for (int i = 0; i < 2000; i += 7) {
+                version = version.Set(i, -t);
+                auto transient = version.AsTransient();
+                transient.Set(i, t).PushBack(t);
+                if (transient[i] != t || version[i] != -t) {
+                    wrong.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(wrong == 0);
+    for (int i = 0; i < 2000; ++i) {
+        REQUIRE(base[i] == i);
+    }
+}
@@ -0,0 +1,162 @@
+#include "persistent_map.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Few distinct hashes, to get both deep paths and collision nodes.
+struct BadHash {
+    size_t operator()(int key) const {
+        return static_cast<size_t>(key % 7) * 0x0101010101010101ULL;
+    }
+};
+
+template <typename Map>
+std::map<int, int> Contents(const Map& map) {
+    std::map<int, int> contents;
+    map.ForEach([&](int key, int value) { contents[key] = value; });
+    return contents;
+}
+
+}  // namespace
+
+TEST_CASE("PersistentMap basics") {
+    PersistentMap<std::string, int> empty;
+    REQUIRE(empty.Empty());
+    REQUIRE(empty.Find("a") == nullptr);
+
+    auto one = empty.Set("a", 1);
+    auto two = one.Set("b", 2);
+    auto replaced = two.Set("a", 10);
+
+    REQUIRE(empty.Size() == 0);
+    REQUIRE(one.Size() == 1);
+    REQUIRE(two.Size() == 2);
+    REQUIRE(replaced.Size() == 2);
+    REQUIRE(*one.Find("a") == 1);
+    REQUIRE(!one.Contains("b"));
+    REQUIRE(*two.Find("a") == 1);
+    REQUIRE(*replaced.Find("a") == 10);
+    REQUIRE(*replaced.Find("b") == 2);
+
+    auto erased = replaced.Erase("a");
+    REQUIRE(erased.Size() == 1);
+    REQUIRE(!erased.Contains("a"));
+    REQUIRE(replaced.Contains("a"));
+    REQUIRE(erased.Erase("missing").Size() == 1);
+}
+
+TEST_CASE("PersistentMap against std::map") {
+    std::mt19937 gen(42);
+
+    auto check = [&](auto map) {
+        std::map<int, int> model;
+        std::vector<decltype(map)> versions;
+        std::vector<std::map<int, int>> models;
+        for (int i = 0; i < 20000; ++i) {
+            int key = static_cast<int>(gen() % 3000);
+            if (gen() % 3 == 0) {
+                map = map.Erase(key);
+                model.erase(key);
+            } else {
+                map = map.Set(key, i);
+                model[key] = i;
+            }
+            if (i % 2000 == 0) {
+                versions.push_back(map);
+                models.push_back(model);
+            }
+        }
+        REQUIRE(map.Size() == model.size());
+        REQUIRE(Contents(map) == model);
+        for (size_t i = 0; i < versions.size(); ++i) {
+            REQUIRE(Contents(versions[i]) == models[i]);
+            REQUIRE(versions[i].Size() == models[i].size());
+        }
+        for (auto [key, value] : model) {
+            REQUIRE(*map.Find(key) == value);
+        }
+    };
+
+    SECTION("std::hash") {
+        check(PersistentMap<int, int>());
+    }
+
+    SECTION("Collisions") {
+        check(PersistentMap<int, int, BadHash>());
+    }
+}
+
+TEST_CASE("PersistentMap erase restores shape") {
+    PersistentMap<int, int, BadHash> map;
+    map = map.Set(0, 0).Set(7, 7).Set(14, 14);
+    map = map.Erase(7).Erase(14);
+    REQUIRE(map.Size() == 1);
+    REQUIRE(*map.Find(0) == 0);
+    map = map.Erase(0);
+    REQUIRE(map.Empty());
+    REQUIRE(Contents(map).empty());
+}
+
+TEST_CASE("PersistentMap bulk build") {
+    std::vector<std::pair<int, int>> items;
+    std::map<int, int> model;
+    for (int i = 0; i < 50000; ++i) {
+        int key = (i * 7919) % 40000;
+        items.emplace_back(key, i);
+        model[key] = i;
+    }
+
+    for (size_t threads : {1, 3, 8}) {
+        auto map = PersistentMap<int, int>::Build(items, threads);
+        REQUIRE(map.Size() == model.size());
+        REQUIRE(Contents(map) == model);
+        auto updated = map.Set(1, -1).Erase(2);
+        REQUIRE(*map.Find(1) == model[1]);
+        REQUIRE(*updated.Find(1) == -1);
+        REQUIRE(!updated.Contains(2));
+    }
+
+    auto collisions = PersistentMap<int, int, BadHash>::Build(items, 4);
+    REQUIRE(Contents(collisions) == model);
+    REQUIRE(PersistentMap<int, int>::Build({}, 4).Empty());
+}
+
+// Run under TSan: cmake -DCMAKE_BUILD_TYPE=TSAN
+TEST_CASE("PersistentMap across threads") {
+    constexpr int kThreads = 4;
+    PersistentMap<int, int> base;
+    for (int i = 0; i < 1000; ++i) {
+        base = base.Set(i, i);
+    }
+    std::atomic<int> wrong = 0;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&wrong, version = base, t]() mutable {
+            for (int i = 0; i < 1000; i += 3) {
+                version = version.Set(i, -t).Erase(i + 1);
+                if (*version.Find(i) != -t || version.Contains(i + 1)) {
+                    wrong.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(base.Size() == 1000);
+    for (int i = 0; i < 1000; ++i) {
+        REQUIRE(*base.Find(i) == i);
+    }
+}
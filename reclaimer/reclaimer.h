@@ -0,0 +1,189 @@
+#pragma once
+
+#include "../weak/shared.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Destroys objects on a background thread, so that dropping the last reference to a big
+// structure does not run its whole destructor on the caller's thread.
+//
+// The queue is bounded. When it is full, the releasing thread either destroys the object itself
+// or waits for a free slot, depending on `Options::on_full`. Objects released by destructors
+// running on the reclaimer thread are destroyed inline. The reclaimer must outlive the pointers
+// created with it; its destructor drains the queue.
+class BackgroundReclaimer {
+public:
+    enum class OnFull {
+        kDestroyInline,
+        kWait,
+    };
+
+    struct Options {
+        size_t capacity = 1024;
+        OnFull on_full = OnFull::kDestroyInline;
+    };
+
+    struct Stats {
+        size_t enqueued = 0;
+        size_t reclaimed = 0;
+
+        // Destroyed by the releasing thread because the queue was full.
+        size_t inline_destroyed = 0;
+
+        // Times a releasing thread waited for a slot.
+        size_t waits = 0;
+
+        size_t queued = 0;
+        size_t max_queued = 0;
+    };
+
+    BackgroundReclaimer() : BackgroundReclaimer(Options{}) {
+    }
+
+    explicit BackgroundReclaimer(const Options& options)
+        : options_(options), ring_(options.capacity), worker_([this] { Work(); }) {
+    }
+
+    BackgroundReclaimer(const BackgroundReclaimer&) = delete;
+    BackgroundReclaimer& operator=(const BackgroundReclaimer&) = delete;
+
+    ~BackgroundReclaimer() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        has_work_.notify_one();
+        worker_.join();
+    }
+
+    // Blocks until everything released so far has been destroyed.
+    void Drain() {
+        std::unique_lock lock(mutex_);
+        drained_.wait(lock, [this] { return size_ == 0 && !busy_; });
+    }
+
+    Stats GetStats() const {
+        std::lock_guard lock(mutex_);
+        Stats stats = stats_;
+        stats.queued = size_;
+        return stats;
+    }
+
+    // Returns false if the caller has to run `task` itself.
+    bool Enqueue(void (*task)(void*), void* arg) {
+        if (std::this_thread::get_id() == worker_.get_id()) {
+            return false;
+        }
+        std::unique_lock lock(mutex_);
+        if (size_ == ring_.size()) {
+            if (options_.on_full == OnFull::kDestroyInline || ring_.empty()) {
+                ++stats_.inline_destroyed;
+                return false;
+            }
+            ++stats_.waits;
+            has_space_.wait(lock, [this] { return size_ < ring_.size(); });
+        }
+        ring_[(head_ + size_) % ring_.size()] = {task, arg};
+        ++size_;
+        ++stats_.enqueued;
+        stats_.max_queued = std::max(stats_.max_queued, size_);
+        lock.unlock();
+        has_work_.notify_one();
+        return true;
+    }
+
+private:
+    struct Task {
+        void (*run)(void*) = nullptr;
+        void* arg = nullptr;
+    };
+
+    void Work() {
+        std::unique_lock lock(mutex_);
+        while (true) {
+            has_work_.wait(lock, [this] { return size_ != 0 || stopping_; });
+            if (size_ == 0) {
+                return;
+            }
+            Task task = ring_[head_];
+            head_ = (head_ + 1) % ring_.size();
+            --size_;
+            busy_ = true;
+            lock.unlock();
+            has_space_.notify_one();
+
+            task.run(task.arg);
+
+            lock.lock();
+            busy_ = false;
+            ++stats_.reclaimed;
+            if (size_ == 0) {
+                drained_.notify_all();
+            }
+        }
+    }
+
+    const Options options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable has_work_;
+    std::condition_variable has_space_;
+    std::condition_variable drained_;
+    std::vector<Task> ring_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+    bool busy_ = false;
+    bool stopping_ = false;
+    Stats stats_;
+
+    std::thread worker_;
+};
+
+// Hands the object to the reclaimer instead of destroying it when the last strong reference
+// goes away. Keeps a weak reference meanwhile, so the block (and the object stored in it)
+// stays alive until the object is destroyed.
+template <typename Block>
+class ReclaimedControlBlock : public Block {
+public:
+    template <typename... Args>
+    explicit ReclaimedControlBlock(BackgroundReclaimer* reclaimer, Args&&... args)
+        : Block(std::forward<Args>(args)...), reclaimer_(reclaimer) {
+    }
+
+protected:
+    void DestroyObject() override {
+        this->IncreaseWeakCounter();
+        if (!reclaimer_->Enqueue(&Reclaim, this)) {
+            Reclaim(this);
+        }
+    }
+
+private:
+    static void Reclaim(void* arg) {
+        auto* block = static_cast<ReclaimedControlBlock*>(arg);
+        block->Block::DestroyObject();
+        block->DecreaseWeakCounter();
+    }
+
+    BackgroundReclaimer* reclaimer_;
+};
+
+// Per pointer policy: like `SharedPtr<T>(ptr)`, but `ptr` is deleted by `reclaimer`.
+template <typename T>
+SharedPtr<T> ReclaimedShared(BackgroundReclaimer& reclaimer, T* ptr) {
+    return AdoptShared(ptr, new ReclaimedControlBlock<ControlBlockPointer<T>>(&reclaimer, ptr));
+}
+
+// Per allocation policy: like `MakeShared<T>(args...)`, but the object is destroyed by `reclaimer`.
+template <typename T, typename... Args>
+SharedPtr<T> MakeReclaimedShared(BackgroundReclaimer& reclaimer, Args&&... args) {
+    auto* block = new ReclaimedControlBlock<ControlBlockObject<T>>(&reclaimer,
+                                                                   std::forward<Args>(args)...);
+    return AdoptShared(block->GetObject(), block);
+}
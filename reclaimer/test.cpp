@@ -0,0 +1,109 @@
+#include "reclaimer.h"
+
+#include "../weak/weak.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <thread>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Payload {
+    static std::atomic<int> alive;
+    // Stalls destruction on the reclaimer thread.
+    static std::atomic<bool> hold;
+    static std::thread::id test_thread;
+
+    Payload() {
+        alive.fetch_add(1);
+    }
+
+    ~Payload() {
+        while (hold.load() && std::this_thread::get_id() != test_thread) {
+            std::this_thread::yield();
+        }
+        destroyed_on = std::this_thread::get_id();
+        alive.fetch_sub(1);
+    }
+
+    static thread_local std::thread::id destroyed_on;
+
+    SharedPtr<Payload> child;
+};
+
+std::atomic<int> Payload::alive = 0;
+std::atomic<bool> Payload::hold = false;
+std::thread::id Payload::test_thread;
+thread_local std::thread::id Payload::destroyed_on;
+
+}  // namespace
+
+TEST_CASE("Background reclaimer") {
+    Payload::test_thread = std::this_thread::get_id();
+    Payload::destroyed_on = {};
+
+    SECTION("MakeReclaimedShared") {
+        BackgroundReclaimer reclaimer;
+        auto p = MakeReclaimedShared<Payload>(reclaimer);
+        WeakPtr<Payload> weak(p);
+        auto copy = p;
+        p.Reset();
+        copy.Reset();
+        reclaimer.Drain();
+        REQUIRE(Payload::alive == 0);
+        REQUIRE(weak.Expired());
+        REQUIRE(Payload::destroyed_on == std::thread::id());
+
+        auto stats = reclaimer.GetStats();
+        REQUIRE(stats.enqueued == 1);
+        REQUIRE(stats.reclaimed == 1);
+        REQUIRE(stats.queued == 0);
+    }
+
+    SECTION("ReclaimedShared") {
+        BackgroundReclaimer reclaimer;
+        {
+            auto p = ReclaimedShared(reclaimer, new Payload);
+            p->child = ReclaimedShared(reclaimer, new Payload);
+        }
+        reclaimer.Drain();
+        REQUIRE(Payload::alive == 0);
+        // The child is released by the parent's destructor on the reclaimer thread.
+        REQUIRE(reclaimer.GetStats().enqueued == 1);
+    }
+
+    SECTION("Full queue destroys inline") {
+        BackgroundReclaimer reclaimer({.capacity = 1});
+        Payload::hold = true;
+        MakeReclaimedShared<Payload>(reclaimer);
+        while (reclaimer.GetStats().queued != 0) {
+            std::this_thread::yield();
+        }
+        MakeReclaimedShared<Payload>(reclaimer);
+        MakeReclaimedShared<Payload>(reclaimer);
+        REQUIRE(Payload::destroyed_on == std::this_thread::get_id());
+        Payload::hold = false;
+        reclaimer.Drain();
+        REQUIRE(Payload::alive == 0);
+
+        auto stats = reclaimer.GetStats();
+        REQUIRE(stats.enqueued == 2);
+        REQUIRE(stats.inline_destroyed == 1);
+        REQUIRE(stats.max_queued == 1);
+    }
+
+    SECTION("Full queue waits") {
+        BackgroundReclaimer reclaimer(
+            {.capacity = 1, .on_full = BackgroundReclaimer::OnFull::kWait});
+        for (int i = 0; i < 100; ++i) {
+            MakeReclaimedShared<Payload>(reclaimer);
+        }
+        reclaimer.Drain();
+        REQUIRE(Payload::alive == 0);
+        REQUIRE(reclaimer.GetStats().reclaimed == 100);
+        REQUIRE(Payload::destroyed_on == std::thread::id());
+    }
+}
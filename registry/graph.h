@@ -0,0 +1,179 @@
+#pragma once
+
+#include "registry.h"
+
+#include "../cycles/cycles.h"
+#include "../weak/shared.h"
+
+#ifdef SMART_PTRS_REGISTRY
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+
+namespace ptr_registry {
+
+struct LiveBlock {
+    const ControlBlock* block = nullptr;
+    std::string type;
+
+    // Of the object.
+    size_t size = 0;
+
+    int shared = 0;
+
+    // Weak references only, without the one owned by strong references.
+    int weak = 0;
+
+    // Symbol and offset of the return address in the creating frame, or the address itself.
+    std::string site;
+};
+
+inline std::string Demangle(const char* name) {
+    int status = 0;
+    std::unique_ptr<char, void (*)(void*)> demangled(
+        abi::__cxa_demangle(name, nullptr, nullptr, &status), std::free);
+    return status == 0 ? demangled.get() : name;
+}
+
+inline std::string Symbolize(const void* address) {
+    char buffer[32];
+    Dl_info info;
+    if (dladdr(address, &info) != 0 && info.dli_sname != nullptr) {
+        std::snprintf(buffer, sizeof(buffer), "+0x%zx",
+                      static_cast<const char*>(address) - static_cast<const char*>(info.dli_saddr));
+        return Demangle(info.dli_sname) + buffer;
+    }
+    std::snprintf(buffer, sizeof(buffer), "%p", address);
+    return buffer;
+}
+
+// Blocks alive at some point during the call. Objects of blocks with a zero shared count are
+// dead already, the blocks are kept by weak references.
+inline std::vector<LiveBlock> LiveBlocks() {
+    struct Raw {
+        const ControlBlock* block;
+        const TypeInfo* type;
+        const void* site;
+        int shared;
+        int weak;
+    };
+    std::vector<Raw> raw;
+    ForEach([&raw](ControlBlock* block) {
+        const Slot& slot = *pool.At(block->registry_entry.index);
+        int shared = block->GetSharedCounter();
+        raw.push_back({block, slot.type, slot.site, shared,
+                       block->GetWeakCounter() - (shared != 0)});
+    });
+
+    std::unordered_map<const std::type_info*, std::string> names;
+    std::vector<LiveBlock> blocks;
+    blocks.reserve(raw.size());
+    for (const Raw& block : raw) {
+        auto [it, inserted] = names.try_emplace(block.type->type);
+        if (inserted) {
+            it->second = Demangle(block.type->type->name());
+        }
+        blocks.push_back({block.block, it->second, block.type->size, block.shared, block.weak,
+                          Symbolize(block.site)});
+    }
+    return blocks;
+}
+
+struct OwnershipEdge {
+    const ControlBlock* from;
+    const ControlBlock* to;
+};
+
+// Edges reported by the `Trace` hooks of the live objects. An object is kept alive by a strong
+// reference while it is traced; the graph must not change meanwhile.
+inline std::vector<OwnershipEdge> OwnershipEdges() {
+    std::vector<ControlBlock*> pinned;
+    ForEach([&pinned](ControlBlock* block) {
+        if (pool.At(block->registry_entry.index)->type->trace != nullptr &&
+            block->TryIncreaseSharedCounter()) {
+            pinned.push_back(block);
+        }
+    });
+    // Outside of the scan: dropping the pins may free blocks.
+    std::vector<OwnershipEdge> edges;
+    for (ControlBlock* block : pinned) {
+        auto visit = [&edges, block](ControlBlock* child) { edges.push_back({block, child}); };
+        Tracer tracer(visit);
+        const Slot& slot = *pool.At(block->registry_entry.index);
+        slot.type->trace(slot.object, tracer);
+    }
+    for (ControlBlock* block : pinned) {
+        block->DecreaseSharedCounter();
+    }
+    return edges;
+}
+
+enum class GraphFormat {
+    kDot,
+    kJson,
+};
+
+inline std::string Escape(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Live blocks with their type, size, counts and creation site, and the edges between them.
+// Edges may lead to blocks that died between the two passes.
+inline void DumpOwnershipGraph(std::ostream& out, GraphFormat format = GraphFormat::kDot) {
+    auto blocks = LiveBlocks();
+    auto edges = OwnershipEdges();
+    auto id = [](const ControlBlock* block) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%p", static_cast<const void*>(block));
+        return std::string(buffer);
+    };
+
+    if (format == GraphFormat::kDot) {
+        out << "digraph ownership {\n";
+        for (const LiveBlock& block : blocks) {
+            out << "    \"" << id(block.block) << "\" [label=\"" << Escape(block.type) << "\\n"
+                << block.size << " B, shared " << block.shared << ", weak " << block.weak
+                << "\\n" << Escape(block.site) << "\"];\n";
+        }
+        for (const OwnershipEdge& edge : edges) {
+            out << "    \"" << id(edge.from) << "\" -> \"" << id(edge.to) << "\";\n";
+        }
+        out << "}\n";
+        return;
+    }
+
+    out << "{\"blocks\": [";
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        const LiveBlock& block = blocks[i];
+        out << (i == 0 ? "" : ", ") << "{\"address\": \"" << id(block.block) << "\", \"type\": \""
+            << Escape(block.type) << "\", \"size\": " << block.size
+            << ", \"shared\": " << block.shared << ", \"weak\": " << block.weak
+            << ", \"site\": \"" << Escape(block.site) << "\"}";
+    }
+    out << "], \"edges\": [";
+    for (size_t i = 0; i < edges.size(); ++i) {
+        out << (i == 0 ? "" : ", ") << "{\"from\": \"" << id(edges[i].from) << "\", \"to\": \""
+            << id(edges[i].to) << "\"}";
+    }
+    out << "]}\n";
+}
+
+}  // namespace ptr_registry
+
+#endif
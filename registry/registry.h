@@ -0,0 +1,436 @@
+#pragma once
+
+// Registry of live control blocks. Built with `-DSMART_PTRS_REGISTRY`, every block created by
+// `SharedPtr(ptr)`, `MakeShared`, `MakeBiasedShared` or `AdoptShared` is registered with its type,
+// object size and creation site until the block is freed; see graph.h for listing the blocks and
+// dumping the ownership graph. Otherwise the hooks expand to nothing.
+//
+// The whole program has to agree on the flag: it changes the layout of `ControlBlock`.
+//
+// `SMART_PTRS_REGISTERING` marks the functions that register blocks. With the flag they are
+// always inlined, and `Register` is always called: the return address of that call is the
+// creation site, in the function that called `MakeShared`, and the factory stays as cheap to
+// inline as without the flag.
+#ifndef SMART_PTRS_REGISTRY
+
+#define SMART_PTRS_REGISTERING
+#define SMART_PTRS_REGISTER(T, block, object) static_cast<void>(0)
+#define SMART_PTRS_UNREGISTER(block) static_cast<void>(0)
+
+#else
+
+#define SMART_PTRS_REGISTERING [[gnu::always_inline]] inline
+#define SMART_PTRS_REGISTER(T, block, object) \
+    ::ptr_registry::Register<T>(block, (block)->registry_entry, object)
+#define SMART_PTRS_UNREGISTER(block) ::ptr_registry::Unregister(block, (block)->registry_entry)
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <typeinfo>
+#include <vector>
+
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+class ControlBlock;
+class Tracer;
+
+namespace ptr_registry {
+
+struct TypeInfo {
+    const std::type_info* type;
+    size_t size;
+
+    // Reports the `SharedPtr` fields of an object of a type with `Trace(Tracer&) const`, null
+    // for other types.
+    void (*trace)(const void* object, Tracer& tracer);
+};
+
+template <typename T>
+void TraceObject(const void* object, Tracer& tracer) {
+    static_cast<const T*>(object)->Trace(tracer);
+}
+
+template <typename T>
+constexpr auto GetTrace() -> void (*)(const void*, Tracer&) {
+    if constexpr (requires(const T& object, Tracer& tracer) { object.Trace(tracer); }) {
+        return &TraceObject<T>;
+    } else {
+        return nullptr;
+    }
+}
+
+template <typename T>
+inline constexpr TypeInfo kTypeInfo = {&typeid(T), sizeof(T), GetTrace<T>()};
+
+// Set once the process is registered for expedited `membarrier`, which lets `Scan` do the
+// fencing for both sides: a block leaving the registry then gets away without a full fence.
+// Blocks freed before the flag is set fence themselves.
+inline bool RegisterMembarrier() {
+    return syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+}
+
+inline const bool asymmetric_fence = RegisterMembarrier();
+
+// Marks the slot of a block that is being freed while a reader may still visit it, so that the
+// slot is not filled again meanwhile.
+inline ControlBlock* const kLeaving = reinterpret_cast<ControlBlock*>(uintptr_t{1});
+
+// Where a registered block is recorded, a null `block` marks a free slot.
+struct Slot {
+    static constexpr uint32_t kNone = ~uint32_t{0};
+
+    std::atomic<ControlBlock*> block = nullptr;
+    const TypeInfo* type = nullptr;
+    const void* object = nullptr;
+
+    // Return address of the creating frame.
+    const void* site = nullptr;
+};
+
+// Stored in the block: an index rather than a pointer, so that the flag adds four bytes to
+// `ControlBlock`, which an object of up to four bytes shares with the counters' padding.
+struct Entry {
+    uint32_t index = Slot::kNone;
+};
+
+// Slots of all blocks, in segments that are never freed, handed out to threads in chunks. Only
+// the thread owning a chunk fills its slots; freeing a block just clears its slot, on whatever
+// thread, and the owner finds the slot free again by sweeping the chunk once it runs out. So
+// neither registering nor unregistering keeps a free list or touches a shared cache line.
+// Chunks of exited threads are adopted by the next thread that sweeps.
+//
+// A reader publishes the block it is about to visit and checks that the slot still holds it, so a
+// block leaving the registry waits only while a reader visits that very block, never for a whole
+// scan. Its slot is freed after that wait, so the fields of a slot do not change under a visit.
+// Readers are rare: they list the blocks for debugging.
+class Pool {
+public:
+    // Room for 2^28 blocks; the table of segments is mostly untouched zero pages.
+    static constexpr size_t kSegmentSize = 4096;
+    static constexpr size_t kSegments = 65536;
+    static constexpr uint32_t kCapacity = kSegmentSize * kSegments;
+
+    static constexpr uint32_t kChunk = 256;
+
+    // Scans running at once; more wait for one to finish.
+    static constexpr size_t kVisitors = 4;
+
+    Pool() = default;
+
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    // The slot must have been reserved.
+    Slot* At(uint32_t index) const {
+        Slot* segment = segments_[index / kSegmentSize].load(std::memory_order_acquire);
+        return &segment[index % kSegmentSize];
+    }
+
+    // A chunk of never used slots, starting at the returned index, or `Slot::kNone` once all
+    // are handed out: chunks are never returned.
+    uint32_t Reserve() {
+        static_assert(kSegmentSize % kChunk == 0);
+        uint32_t begin = size_.load(std::memory_order_relaxed);
+        do {
+            if (begin >= kCapacity) {
+                return Slot::kNone;
+            }
+        } while (!size_.compare_exchange_weak(begin, begin + kChunk, std::memory_order_acq_rel));
+        auto& segment = segments_[begin / kSegmentSize];
+        if (begin % kSegmentSize == 0) {
+            segment.store(new Slot[kSegmentSize], std::memory_order_release);
+        }
+        while (segment.load(std::memory_order_acquire) == nullptr) {
+            std::this_thread::yield();
+        }
+        return begin;
+    }
+
+    // Writes the free slots of the chunk to `out`, returns their number. No reader visits the
+    // blocks they held any longer.
+    size_t Sweep(uint32_t chunk, uint32_t* out) const {
+        const Slot* slots = At(chunk);
+        size_t count = 0;
+        // Without a branch: which slots are free is hard to predict.
+        for (uint32_t i = 0; i < kChunk; ++i) {
+            out[count] = chunk + i;
+            count += slots[i].block.load(std::memory_order_acquire) == nullptr;
+        }
+        return count;
+    }
+
+    void Orphan(std::vector<uint32_t>& chunks) {
+        std::lock_guard lock(orphans_mutex_);
+        orphans_.insert(orphans_.end(), chunks.begin(), chunks.end());
+        chunks.clear();
+        has_orphans_.store(true, std::memory_order_relaxed);
+    }
+
+    void Adopt(std::vector<uint32_t>& chunks) {
+        if (!has_orphans_.load(std::memory_order_relaxed)) {
+            return;
+        }
+        std::lock_guard lock(orphans_mutex_);
+        chunks.insert(chunks.end(), orphans_.begin(), orphans_.end());
+        orphans_.clear();
+        has_orphans_.store(false, std::memory_order_relaxed);
+    }
+
+    // Fills a free slot of the orphaned chunks. `fill(index)` publishes the block under the lock,
+    // so that a thread adopting the chunk later does not sweep the slot as free.
+    template <typename Fill>
+    void FillOrphan(Fill fill) {
+        std::lock_guard lock(orphans_mutex_);
+        uint32_t free[kChunk];
+        for (uint32_t chunk : orphans_) {
+            if (Sweep(chunk, free) != 0) {
+                fill(free[0]);
+                return;
+            }
+        }
+        uint32_t chunk = Reserve();
+        if (chunk != Slot::kNone) {
+            orphans_.push_back(chunk);
+            has_orphans_.store(true, std::memory_order_relaxed);
+            fill(chunk);
+        }
+    }
+
+    // Either `Scan` never sees the block, or the block sees the scan: with the fence here, or
+    // with the one `Scan` runs on every thread. A scan then holds the block up only while it
+    // visits it; coming back to the slot later, it finds the block gone.
+    void Clear(Slot* slot, ControlBlock* block) {
+        if (asymmetric_fence) {
+            slot->block.store(kLeaving, std::memory_order_relaxed);
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        } else {
+            slot->block.store(kLeaving, std::memory_order_seq_cst);
+        }
+        if (readers_.load(std::memory_order_seq_cst) != 0) [[unlikely]] {
+            AwaitVisits(slot, block);
+        }
+        slot->block.store(nullptr, std::memory_order_release);
+    }
+
+    // `visit(block)` must not free blocks.
+    template <typename Visit>
+    void Scan(Visit& visit) {
+        readers_.fetch_add(1, std::memory_order_seq_cst);
+        if (asymmetric_fence) {
+            syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+        }
+        Visitor& visitor = Enter();
+        uint32_t size = size_.load(std::memory_order_acquire);
+        for (size_t k = 0; k * kSegmentSize < size; ++k) {
+            Slot* segment = segments_[k].load(std::memory_order_acquire);
+            if (segment == nullptr) {
+                continue;
+            }
+            for (size_t i = 0; i < kSegmentSize; ++i) {
+                ControlBlock* block = segment[i].block.load(std::memory_order_acquire);
+                if (block == nullptr || block == kLeaving) {
+                    continue;
+                }
+                visitor.block.store(block, std::memory_order_seq_cst);
+                if (segment[i].block.load(std::memory_order_seq_cst) == block) {
+                    visit(block);
+                }
+                visitor.block.store(nullptr, std::memory_order_release);
+            }
+        }
+        visitor.busy.store(false, std::memory_order_release);
+        readers_.fetch_sub(1, std::memory_order_release);
+    }
+
+private:
+    struct alignas(64) Visitor {
+        std::atomic<bool> busy = false;
+
+        // Published before the slot is checked again, so that the block waits for the visit.
+        std::atomic<ControlBlock*> block = nullptr;
+    };
+
+    Visitor& Enter() {
+        while (true) {
+            for (Visitor& visitor : visitors_) {
+                if (!visitor.busy.exchange(true, std::memory_order_acquire)) {
+                    return visitor;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    // Once a reader is seen. Storing the mark again with a full fence pairs it with a reader
+    // checking the slot after publishing the block: either the reader sees the mark, or the
+    // block sees the reader.
+    [[gnu::noinline]] void AwaitVisits(Slot* slot, ControlBlock* block) {
+        slot->block.store(kLeaving, std::memory_order_seq_cst);
+        for (Visitor& visitor : visitors_) {
+            while (visitor.block.load(std::memory_order_seq_cst) == block) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    std::array<std::atomic<Slot*>, kSegments> segments_{};
+    std::atomic<uint32_t> size_ = 0;
+    alignas(64) std::atomic<int> readers_ = 0;
+    std::array<Visitor, kVisitors> visitors_;
+
+    alignas(64) std::atomic<bool> has_orphans_ = false;
+    std::mutex orphans_mutex_;
+    std::vector<uint32_t> orphans_;
+};
+
+inline Pool pool;
+
+// Chunks of the thread and the free slots found in them.
+class LocalSlots {
+public:
+    // A sweep looks at up to `kSweeps` chunks for `kEnough` free slots before reserving a new
+    // chunk, so that chunks of long-lived blocks are not swept over and over.
+    static constexpr size_t kSweeps = 4;
+    static constexpr uint32_t kEnough = Pool::kChunk / 4;
+
+    LocalSlots() = default;
+
+    LocalSlots(const LocalSlots&) = delete;
+    LocalSlots& operator=(const LocalSlots&) = delete;
+
+    ~LocalSlots() {
+        pool.Orphan(chunks_);
+    }
+
+    bool Empty() const {
+        return size_ == 0;
+    }
+
+    uint32_t Take() {
+        return free_[--size_];
+    }
+
+    // Only once every slot found before is taken, so that none is found twice. Stays empty once
+    // the pool is exhausted.
+    void Refill() {
+        pool.Adopt(chunks_);
+        for (size_t i = 0; i < kSweeps && i < chunks_.size() && size_ < kEnough; ++i) {
+            next_ = (next_ + 1) % chunks_.size();
+            size_ += pool.Sweep(chunks_[next_], free_.data() + size_);
+        }
+        if (size_ < kEnough) {
+            uint32_t chunk = pool.Reserve();
+            if (chunk == Slot::kNone) {
+                return;
+            }
+            chunks_.push_back(chunk);
+            for (uint32_t i = Pool::kChunk; i > 0; --i) {
+                free_[size_++] = chunk + i - 1;
+            }
+        }
+    }
+
+private:
+    std::array<uint32_t, 2 * Pool::kChunk> free_;
+    uint32_t size_ = 0;
+
+    std::vector<uint32_t> chunks_;
+
+    // The chunk swept last.
+    size_t next_ = 0;
+};
+
+inline thread_local LocalSlots* local_slots = nullptr;
+inline thread_local bool local_slots_released = false;
+
+// Sets the thread's slots up on first use, returns nullptr while the thread is exiting.
+[[gnu::noinline]] inline LocalSlots* RegisterThread() {
+    struct Registration {
+        LocalSlots slots;
+
+        Registration() {
+            local_slots = &slots;
+        }
+
+        ~Registration() {
+            local_slots = nullptr;
+            local_slots_released = true;
+        }
+    };
+
+    if (!local_slots_released) {
+        thread_local Registration registration;
+    }
+    return local_slots;
+}
+
+inline LocalSlots* Local() {
+    LocalSlots* local = local_slots;
+    return local != nullptr ? local : RegisterThread();
+}
+
+inline void Publish(uint32_t index, ControlBlock* block, const TypeInfo* type, const void* object,
+                    const void* site) {
+    Slot* slot = pool.At(index);
+    slot->type = type;
+    slot->object = object;
+    slot->site = site;
+    slot->block.store(block, std::memory_order_release);
+}
+
+// Sets the thread up or refills its slots, or registers the block of an exiting thread. Leaves
+// the block unregistered once the pool is exhausted.
+[[gnu::noinline]] inline void RegisterSlow(ControlBlock* block, Entry& entry, const TypeInfo* type,
+                                           const void* object, const void* site) {
+    if (LocalSlots* local = Local()) {
+        if (local->Empty()) {
+            local->Refill();
+        }
+        if (local->Empty()) {
+            return;
+        }
+        entry.index = local->Take();
+        Publish(entry.index, block, type, object, site);
+        return;
+    }
+    pool.FillOrphan([&](uint32_t index) {
+        entry.index = index;
+        Publish(index, block, type, object, site);
+    });
+}
+
+// The common case calls nothing, so that it saves no registers.
+template <typename T>
+[[gnu::noinline]] void Register(ControlBlock* block, Entry& entry, const T* object) {
+    const void* site = __builtin_return_address(0);
+    LocalSlots* local = local_slots;
+    if (local == nullptr || local->Empty()) [[unlikely]] {
+        RegisterSlow(block, entry, &kTypeInfo<T>, object, site);
+        return;
+    }
+    entry.index = local->Take();
+    Publish(entry.index, block, &kTypeInfo<T>, object, site);
+}
+
+inline void Unregister(ControlBlock* block, const Entry& entry) {
+    if (entry.index != Slot::kNone) {
+        pool.Clear(pool.At(entry.index), block);
+    }
+}
+
+// Calls `visit(block)` for every registered block. A block cannot be freed while it is visited,
+// so `visit` must not drop references; the objects may be dead already.
+template <typename Visit>
+void ForEach(Visit visit) {
+    pool.Scan(visit);
+}
+
+}  // namespace ptr_registry
+
+#endif
@@ -0,0 +1,202 @@
+#include "graph.h"
+
+#include "../weak/weak.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Point {
+    int x = 0;
+    int y = 0;
+};
+
+struct Node {
+    explicit Node(int value) : value(value) {
+    }
+
+    int value = 0;
+    SharedPtr<Node> left;
+    SharedPtr<Node> right;
+
+    void Trace(Tracer& tracer) const {
+        tracer(left);
+        tracer(right);
+    }
+};
+
+std::vector<ptr_registry::LiveBlock> BlocksOf(const std::string& type) {
+    auto blocks = ptr_registry::LiveBlocks();
+    std::erase_if(blocks, [&type](const auto& block) { return block.type != type; });
+    return blocks;
+}
+
+SharedPtr<Point> MakePoint() {
+    return MakeShared<Point>(1, 2);
+}
+
+}  // namespace
+
+TEST_CASE("Blocks are listed while alive") {
+    REQUIRE(BlocksOf("(anonymous namespace)::Point").empty());
+    {
+        auto a = MakePoint();
+        auto b = a;
+        WeakPtr<Point> weak(a);
+        SharedPtr<Point> c(new Point{3, 4});
+
+        auto blocks = BlocksOf("(anonymous namespace)::Point");
+        REQUIRE(blocks.size() == 2);
+        auto it = std::find_if(blocks.begin(), blocks.end(),
+                               [&a](const auto& block) { return block.block == a.GetControl(); });
+        REQUIRE(it != blocks.end());
+        REQUIRE(it->size == sizeof(Point));
+        REQUIRE(it->shared == 2);
+        REQUIRE(it->weak == 1);
+        REQUIRE(!it->site.empty());
+
+        a.Reset();
+        b.Reset();
+        // The block stays until the last weak reference is gone.
+        blocks = BlocksOf("(anonymous namespace)::Point");
+        REQUIRE(blocks.size() == 2);
+    }
+    REQUIRE(BlocksOf("(anonymous namespace)::Point").empty());
+}
+
+TEST_CASE("Ownership graph") {
+    auto root = MakeShared<Node>(1);
+    root->left = MakeShared<Node>(2);
+    root->right = MakeShared<Node>(3);
+    root->right->left = root->left;
+
+    auto edges = ptr_registry::OwnershipEdges();
+    auto has_edge = [&edges](const SharedPtr<Node>& from, const SharedPtr<Node>& to) {
+        return std::count_if(edges.begin(), edges.end(), [&](const auto& edge) {
+                   return edge.from == from.GetControl() && edge.to == to.GetControl();
+               }) == 1;
+    };
+    REQUIRE(has_edge(root, root->left));
+    REQUIRE(has_edge(root, root->right));
+    REQUIRE(has_edge(root->right, root->left));
+    REQUIRE(BlocksOf("(anonymous namespace)::Node").size() == 3);
+    REQUIRE(root.UseCount() == 1);
+
+    std::ostringstream dot;
+    ptr_registry::DumpOwnershipGraph(dot);
+    REQUIRE(dot.str().starts_with("digraph ownership {\n"));
+    REQUIRE(dot.str().find(" -> ") != std::string::npos);
+    REQUIRE(dot.str().find("(anonymous namespace)::Node") != std::string::npos);
+
+    std::ostringstream json;
+    ptr_registry::DumpOwnershipGraph(json, ptr_registry::GraphFormat::kJson);
+    REQUIRE(json.str().starts_with("{\"blocks\": ["));
+    REQUIRE(json.str().find("\"from\": ") != std::string::npos);
+    REQUIRE(json.str().find("\"shared\": 2") != std::string::npos);
+}
+
+TEST_CASE("Dead objects are not traced") {
+    auto root = MakeShared<Node>(1);
+    root->left = MakeShared<Node>(2);
+    WeakPtr<Node> weak(root);
+    root.Reset();
+
+    auto blocks = BlocksOf("(anonymous namespace)::Node");
+    REQUIRE(blocks.size() == 1);
+    REQUIRE(blocks[0].shared == 0);
+    REQUIRE(ptr_registry::OwnershipEdges().empty());
+}
+
+// Run under TSan: cmake -DCMAKE_BUILD_TYPE=TSAN
+TEST_CASE("Listing while threads create and free blocks") {
+    constexpr int kThreads = 4;
+
+    std::atomic<bool> stop = false;
+    std::atomic<int> wrong = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&] {
+            std::vector<SharedPtr<Node>> nodes;
+            while (!stop.load()) {
+                nodes.push_back(MakeShared<Node>(1));
+                if (nodes.size() == 100) {
+                    nodes.clear();
+                }
+            }
+        });
+    }
+    for (int i = 0; i < 20; ++i) {
+        for (const auto& block : ptr_registry::LiveBlocks()) {
+            wrong += block.size == 0;
+        }
+        ptr_registry::OwnershipEdges();
+    }
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(wrong.load() == 0);
+    REQUIRE(BlocksOf("(anonymous namespace)::Node").empty());
+}
+
+TEST_CASE("Freeing a block does not wait for a scan") {
+    auto kept = MakePoint();
+    auto freed = MakePoint();
+    const ControlBlock* freed_block = freed.GetControl();
+    bool done = false;
+    ptr_registry::ForEach([&](ControlBlock* block) {
+        // Frees another block in the middle of the scan, and waits for that.
+        if (!done && block != freed_block) {
+            done = true;
+            std::thread([&freed] { freed.Reset(); }).join();
+        }
+    });
+    REQUIRE(done);
+    REQUIRE(BlocksOf("(anonymous namespace)::Point").size() == 1);
+}
+
+TEST_CASE("Blocks outlive the thread that registered them") {
+    struct AtExit {
+        std::vector<SharedPtr<Point>>* points;
+
+        ~AtExit() {
+            points->push_back(MakeShared<Point>());
+        }
+    };
+
+    std::vector<SharedPtr<Point>> points;
+    std::thread([&points] {
+        thread_local AtExit at_exit{&points};
+        for (int i = 0; i < 1000; ++i) {
+            points.push_back(MakeShared<Point>());
+        }
+    }).join();
+    REQUIRE(BlocksOf("(anonymous namespace)::Point").size() == 1001);
+
+    points.resize(500);
+    // Takes over the slots of the exited thread and reuses the freed ones.
+    std::thread([&points] {
+        for (int i = 0; i < 1000; ++i) {
+            points.push_back(MakeShared<Point>());
+        }
+    }).join();
+    auto blocks = BlocksOf("(anonymous namespace)::Point");
+    REQUIRE(blocks.size() == 1500);
+    std::sort(blocks.begin(), blocks.end(),
+              [](const auto& lhs, const auto& rhs) { return lhs.block < rhs.block; });
+    REQUIRE(std::adjacent_find(blocks.begin(), blocks.end(), [](const auto& lhs, const auto& rhs) {
+                return lhs.block == rhs.block;
+            }) == blocks.end());
+
+    points.clear();
+    REQUIRE(BlocksOf("(anonymous namespace)::Point").empty());
+}
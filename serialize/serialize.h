@@ -0,0 +1,446 @@
+#pragma once
+
+#include "../weak/shared.h"
+#include "../weak/weak.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+#include <unistd.h>
+
+// Saving and loading graphs of `SharedPtr`s with sharing preserved. A type describes its fields
+// once for both directions:
+//
+//     template <typename Archive>
+//     void Serialize(Archive& archive) {
+//         archive(key, name, children, parent);
+//     }
+//
+// Fields may be arithmetic types and enums, `std::string`, `std::vector`s of fields, `SharedPtr`,
+// `WeakPtr` and types with a `Serialize` of their own. Objects behind `SharedPtr`s must be
+// default constructible: they are created with `MakeShared` and filled in afterwards, so that
+// cycles load.
+//
+// Objects are told apart by their control blocks: each one is written once, the first time a
+// strong reference reaches it, and every other reference becomes its number. Bodies are queued
+// rather than written in place, so long chains take no stack. A `WeakPtr` is a non-owning edge:
+// it never makes its target written, and loads expired unless a strong reference in the same
+// root or an earlier one reaches the target. Written objects carry the name of their type,
+// checked against the type they are read as.
+//
+// Both sides stream through a buffer over a file descriptor, nothing else grows with the size of
+// the data but the table of objects seen. Arithmetic fields are written as in memory and type
+// names are those of `std::type_info`, so streams are only portable between builds of the same
+// platform and compiler.
+
+namespace graph_serialize {
+
+inline constexpr char kMagic[4] = {'S', 'P', 'G', '1'};
+inline constexpr size_t kBufferSize = size_t{1} << 16;
+
+}  // namespace graph_serialize
+
+class GraphWriter {
+public:
+    // Does not own `fd`.
+    explicit GraphWriter(int fd) : fd_(fd), buffer_(new char[graph_serialize::kBufferSize]) {
+        WriteBytes(graph_serialize::kMagic, sizeof(graph_serialize::kMagic));
+    }
+
+    GraphWriter(const GraphWriter&) = delete;
+    GraphWriter& operator=(const GraphWriter&) = delete;
+
+    // Whatever is buffered is lost if `Flush` was not called: a destructor cannot report errors.
+    ~GraphWriter() = default;
+
+    // Writes a root with everything it strongly reaches that was not written before. Roots are
+    // read back in the same order. The graph must not change until the writer is done with it:
+    // objects are known by the address of their blocks.
+    template <typename T>
+    void Write(const SharedPtr<T>& root) {
+        Field(root);
+        while (!pending_.empty()) {
+            Pending pending = pending_.front();
+            pending_.pop_front();
+            pending.write(*this, pending.object);
+        }
+    }
+
+    // Throws `std::system_error` if writing fails.
+    void Flush() {
+        size_t written = 0;
+        while (written < size_) {
+            ssize_t result = ::write(fd_, buffer_.get() + written, size_ - written);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "GraphWriter");
+            }
+            written += static_cast<size_t>(result);
+        }
+        size_ = 0;
+    }
+
+    // Objects written so far.
+    size_t Objects() const {
+        return written_;
+    }
+
+    template <typename... Fields>
+    void operator()(const Fields&... fields) {
+        (Field(fields), ...);
+    }
+
+private:
+    struct Pending {
+        void* object;
+        void (*write)(GraphWriter&, void*);
+    };
+
+    struct Seen {
+        uint64_t id;
+        bool written;
+    };
+
+    template <typename T>
+    static void WriteBody(GraphWriter& writer, void* object) {
+        static_cast<T*>(object)->Serialize(writer);
+    }
+
+    template <typename T>
+    void Field(const T& value) {
+        if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+            WriteBytes(&value, sizeof(value));
+        } else {
+            // The same member function loads, so it cannot be const.
+            const_cast<T&>(value).Serialize(*this);
+        }
+    }
+
+    void Field(const std::string& value) {
+        WriteNumber(value.size());
+        WriteBytes(value.data(), value.size());
+    }
+
+    template <typename T>
+    void Field(const std::vector<T>& values) {
+        WriteNumber(values.size());
+        for (const T& value : values) {
+            Field(value);
+        }
+    }
+
+    // Zero for null, otherwise the number of the object plus one, shifted, with the low bit set
+    // when its body follows. Then the number of its type, and the name of the type the first
+    // time.
+    template <typename T>
+    void Field(const SharedPtr<T>& ptr) {
+        if (!ptr) {
+            WriteNumber(0);
+            return;
+        }
+        Seen& seen = See(ptr.GetControl());
+        bool write = !seen.written;
+        WriteNumber((seen.id + 1) << 1 | write);
+        if (write) {
+            seen.written = true;
+            ++written_;
+            auto [it, inserted] = types_.try_emplace(&typeid(T), types_.size());
+            WriteNumber(it->second);
+            if (inserted) {
+                Field(std::string(typeid(T).name()));
+            }
+            pending_.push_back({ptr.Get(), &WriteBody<T>});
+        }
+    }
+
+    template <typename T>
+    void Field(const WeakPtr<T>& ptr) {
+        SharedPtr<T> target = ptr.Lock();
+        WriteNumber(target ? See(target.GetControl()).id + 1 : 0);
+    }
+
+    Seen& See(const ControlBlock* block) {
+        auto [it, inserted] = seen_.try_emplace(block, Seen{seen_.size(), false});
+        return it->second;
+    }
+
+    // LEB128.
+    void WriteNumber(uint64_t value) {
+        char bytes[10];
+        size_t size = 0;
+        do {
+            bytes[size++] = static_cast<char>((value & 0x7f) | (value >= 0x80 ? 0x80 : 0));
+            value >>= 7;
+        } while (value != 0);
+        WriteBytes(bytes, size);
+    }
+
+    void WriteBytes(const void* data, size_t size) {
+        const char* bytes = static_cast<const char*>(data);
+        while (size != 0) {
+            if (size_ == graph_serialize::kBufferSize) {
+                Flush();
+            }
+            size_t chunk = std::min(size, graph_serialize::kBufferSize - size_);
+            std::memcpy(buffer_.get() + size_, bytes, chunk);
+            size_ += chunk;
+            bytes += chunk;
+            size -= chunk;
+        }
+    }
+
+    int fd_;
+    std::unique_ptr<char[]> buffer_;
+    size_t size_ = 0;
+
+    std::unordered_map<const ControlBlock*, Seen> seen_;
+    std::unordered_map<const std::type_info*, uint64_t> types_;
+    std::deque<Pending> pending_;
+    size_t written_ = 0;
+};
+
+class GraphReader {
+public:
+    // Does not own `fd`. Throws `std::runtime_error` if the stream does not start like one
+    // written by `GraphWriter`.
+    explicit GraphReader(int fd) : fd_(fd), buffer_(new char[graph_serialize::kBufferSize]) {
+        char magic[sizeof(graph_serialize::kMagic)];
+        ReadBytes(magic, sizeof(magic));
+        if (std::memcmp(magic, graph_serialize::kMagic, sizeof(magic)) != 0) {
+            throw std::runtime_error("GraphReader: not a graph stream");
+        }
+    }
+
+    GraphReader(const GraphReader&) = delete;
+    GraphReader& operator=(const GraphReader&) = delete;
+
+    // Reads the next root, as `T` was written. Throws `std::runtime_error` on malformed input,
+    // including an object read as another type than before.
+    //
+    // The reader holds every object read until it is destroyed: only then do objects no strong
+    // reference reaches die and weak references to them expire. Objects only weakly referenced
+    // have no body to read, they are dropped before `Read` returns and such references expire.
+    template <typename T>
+    SharedPtr<T> Read() {
+        SharedPtr<T> root;
+        Field(root);
+        while (!pending_.empty()) {
+            Pending pending = pending_.front();
+            pending_.pop_front();
+            pending.read(*this, pending.object);
+        }
+        for (uint64_t id : unwritten_) {
+            if (!objects_[id]->written) {
+                objects_[id]->Drop();
+            }
+        }
+        unwritten_.clear();
+        return root;
+    }
+
+    // Objects read so far, expired ones included.
+    size_t Objects() const {
+        return objects_.size();
+    }
+
+    template <typename... Fields>
+    void operator()(Fields&... fields) {
+        (Field(fields), ...);
+    }
+
+private:
+    struct Pending {
+        void* object;
+        void (*read)(GraphReader&, void*);
+    };
+
+    struct Object {
+        virtual ~Object() = default;
+        virtual void Drop() = 0;
+
+        bool written = false;
+    };
+
+    template <typename T>
+    struct TypedObject : Object {
+        void Drop() override {
+            ptr.Reset();
+        }
+
+        SharedPtr<T> ptr;
+    };
+
+    template <typename T>
+    static void ReadBody(GraphReader& reader, void* object) {
+        static_cast<T*>(object)->Serialize(reader);
+    }
+
+    template <typename T>
+    void Field(T& value) {
+        if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+            ReadBytes(&value, sizeof(value));
+        } else {
+            value.Serialize(*this);
+        }
+    }
+
+    // In pieces, so that a corrupt size runs into the end of the stream rather than allocating
+    // all of it.
+    void Field(std::string& value) {
+        size_t size = ReadSize();
+        value.clear();
+        while (value.size() < size) {
+            size_t begin = value.size();
+            value.resize(begin + std::min(size - begin, graph_serialize::kBufferSize));
+            ReadBytes(value.data() + begin, value.size() - begin);
+        }
+    }
+
+    template <typename T>
+    void Field(std::vector<T>& values) {
+        size_t size = ReadSize();
+        values.clear();
+        for (size_t i = 0; i < size; ++i) {
+            Field(values.emplace_back());
+        }
+    }
+
+    template <typename T>
+    void Field(SharedPtr<T>& ptr) {
+        uint64_t number = ReadNumber();
+        if (number == 0) {
+            ptr.Reset();
+            return;
+        }
+        TypedObject<T>& object = Get<T>((number >> 1) - 1);
+        if (number & 1) {
+            if (object.written) {
+                throw std::runtime_error("GraphReader: object written twice");
+            }
+            object.written = true;
+            CheckType(typeid(T));
+            pending_.push_back({object.ptr.Get(), &ReadBody<T>});
+        } else if (!object.written) {
+            throw std::runtime_error("GraphReader: strong reference to an object with no body");
+        }
+        ptr = object.ptr;
+    }
+
+    template <typename T>
+    void Field(WeakPtr<T>& ptr) {
+        uint64_t number = ReadNumber();
+        if (number == 0) {
+            ptr.Reset();
+            return;
+        }
+        ptr = Get<T>(number - 1).ptr;
+    }
+
+    // Objects are numbered in the order they are first referenced, strongly or weakly, so an
+    // unknown number must be the next one. An object is created when a root first references
+    // it, and until its body is read it is only kept to the end of that root.
+    template <typename T>
+    TypedObject<T>& Get(uint64_t id) {
+        if (id == objects_.size()) {
+            objects_.push_back(std::make_unique<TypedObject<T>>());
+        } else if (id > objects_.size()) {
+            throw std::runtime_error("GraphReader: reference to an unknown object");
+        }
+        auto* object = dynamic_cast<TypedObject<T>*>(objects_[id].get());
+        if (object == nullptr) {
+            throw std::runtime_error("GraphReader: object read as another type");
+        }
+        if (!object->ptr) {
+            object->ptr = MakeShared<T>();
+            unwritten_.push_back(id);
+        }
+        return *object;
+    }
+
+    void CheckType(const std::type_info& type) {
+        uint64_t number = ReadNumber();
+        if (number == types_.size()) {
+            Field(types_.emplace_back());
+        } else if (number > types_.size()) {
+            throw std::runtime_error("GraphReader: unknown type");
+        }
+        if (types_[number] != type.name()) {
+            throw std::runtime_error("GraphReader: object read as another type");
+        }
+    }
+
+    size_t ReadSize() {
+        uint64_t size = ReadNumber();
+        if (size > SIZE_MAX) {
+            throw std::runtime_error("GraphReader: size out of range");
+        }
+        return static_cast<size_t>(size);
+    }
+
+    uint64_t ReadNumber() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            unsigned char byte;
+            ReadBytes(&byte, 1);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw std::runtime_error("GraphReader: number out of range");
+    }
+
+    void ReadBytes(void* data, size_t size) {
+        char* bytes = static_cast<char*>(data);
+        while (size != 0) {
+            if (begin_ == end_) {
+                Fill();
+            }
+            size_t chunk = std::min(size, end_ - begin_);
+            std::memcpy(bytes, buffer_.get() + begin_, chunk);
+            begin_ += chunk;
+            bytes += chunk;
+            size -= chunk;
+        }
+    }
+
+    void Fill() {
+        ssize_t result;
+        do {
+            result = ::read(fd_, buffer_.get(), graph_serialize::kBufferSize);
+        } while (result < 0 && errno == EINTR);
+        if (result < 0) {
+            throw std::system_error(errno, std::generic_category(), "GraphReader");
+        }
+        if (result == 0) {
+            throw std::runtime_error("GraphReader: unexpected end of stream");
+        }
+        begin_ = 0;
+        end_ = static_cast<size_t>(result);
+    }
+
+    int fd_;
+    std::unique_ptr<char[]> buffer_;
+    size_t begin_ = 0;
+    size_t end_ = 0;
+
+    std::vector<std::unique_ptr<Object>> objects_;
+    std::vector<std::string> types_;
+    std::deque<Pending> pending_;
+    // Objects created by the current root whose bodies may not come.
+    std::vector<uint64_t> unwritten_;
+};
@@ -0,0 +1,341 @@
+#include "serialize.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Node {
+    static int alive;
+
+    Node() {
+        ++alive;
+    }
+
+    Node(const Node&) = delete;
+    Node& operator=(const Node&) = delete;
+
+    ~Node() {
+        --alive;
+    }
+
+    template <typename Archive>
+    void Serialize(Archive& archive) {
+        archive(key, name, children, parent);
+    }
+
+    int64_t key = 0;
+    std::string name;
+    std::vector<SharedPtr<Node>> children;
+    WeakPtr<Node> parent;
+};
+
+int Node::alive = 0;
+
+enum class Color : uint8_t {
+    kRed,
+    kBlue,
+};
+
+struct Point {
+    template <typename Archive>
+    void Serialize(Archive& archive) {
+        archive(x, y);
+    }
+
+    double x = 0;
+    double y = 0;
+};
+
+struct Shape {
+    template <typename Archive>
+    void Serialize(Archive& archive) {
+        archive(color, points, next);
+    }
+
+    Color color = Color::kRed;
+    std::vector<Point> points;
+    SharedPtr<Shape> next;
+};
+
+// A temporary file, rewound between writing and reading.
+class Stream {
+public:
+    Stream() : file_(std::tmpfile()) {
+        REQUIRE(file_ != nullptr);
+    }
+
+    ~Stream() {
+        std::fclose(file_);
+    }
+
+    int Fd() const {
+        return fileno(file_);
+    }
+
+    void Rewind() {
+        REQUIRE(lseek(Fd(), 0, SEEK_SET) == 0);
+    }
+
+    void Truncate(off_t size) {
+        REQUIRE(ftruncate(Fd(), size) == 0);
+    }
+
+    off_t Size() const {
+        return lseek(Fd(), 0, SEEK_END);
+    }
+
+private:
+    std::FILE* file_;
+};
+
+SharedPtr<Node> MakeNode(int64_t key, const std::string& name = "") {
+    auto node = MakeShared<Node>();
+    node->key = key;
+    node->name = name;
+    return node;
+}
+
+void Link(const SharedPtr<Node>& parent, const SharedPtr<Node>& child) {
+    parent->children.push_back(child);
+    child->parent = parent;
+}
+
+}  // namespace
+
+TEST_CASE("Shared objects are written once") {
+    Stream stream;
+    {
+        // A diamond: both children share the grandchild.
+        auto root = MakeNode(1, "root");
+        auto left = MakeNode(2, "left");
+        auto right = MakeNode(3, "right");
+        auto bottom = MakeNode(4, "bottom");
+        Link(root, left);
+        Link(root, right);
+        Link(left, bottom);
+        right->children.push_back(bottom);
+
+        GraphWriter writer(stream.Fd());
+        writer.Write(root);
+        writer.Flush();
+        REQUIRE(writer.Objects() == 4);
+    }
+    REQUIRE(Node::alive == 0);
+
+    stream.Rewind();
+    SharedPtr<Node> root;
+    {
+        GraphReader reader(stream.Fd());
+        root = reader.Read<Node>();
+        REQUIRE(reader.Objects() == 4);
+    }
+    REQUIRE(Node::alive == 4);
+    REQUIRE(root->name == "root");
+    REQUIRE(root->parent.Expired());
+    const auto& left = root->children.at(0);
+    const auto& right = root->children.at(1);
+    REQUIRE(left->key == 2);
+    REQUIRE(right->name == "right");
+    REQUIRE(left->children.at(0) == right->children.at(0));
+    REQUIRE(left->children[0]->name == "bottom");
+    REQUIRE(left->children[0].UseCount() == 2);
+    REQUIRE(left->children[0]->parent.Lock() == left);
+    REQUIRE(right->parent.Lock() == root);
+    REQUIRE(root.UseCount() == 1);
+
+    root.Reset();
+    REQUIRE(Node::alive == 0);
+}
+
+TEST_CASE("Cycles and weak references") {
+    Stream stream;
+    {
+        auto a = MakeNode(1);
+        auto b = MakeNode(2);
+        Link(a, b);
+        b->children.push_back(a);
+        // Only weakly referenced: not written.
+        auto orphan = MakeNode(3);
+        a->parent = orphan;
+
+        GraphWriter writer(stream.Fd());
+        writer.Write(a);
+        writer.Flush();
+        REQUIRE(writer.Objects() == 2);
+        b->children.clear();
+    }
+    REQUIRE(Node::alive == 0);
+
+    stream.Rewind();
+    SharedPtr<Node> a;
+    {
+        GraphReader reader(stream.Fd());
+        a = reader.Read<Node>();
+        REQUIRE(reader.Objects() == 3);
+    }
+    const auto& b = a->children.at(0);
+    REQUIRE(b->children.at(0) == a);
+    REQUIRE(b->parent.Lock() == a);
+    // Nothing owned the orphan once the reader was gone.
+    REQUIRE(a->parent.Expired());
+    REQUIRE(Node::alive == 2);
+
+    b->children.clear();
+    a.Reset();
+    REQUIRE(Node::alive == 0);
+}
+
+TEST_CASE("Weak references to objects never written") {
+    Stream stream;
+    {
+        auto orphan = MakeNode(1, "orphan");
+        auto first = MakeNode(2);
+        first->parent = orphan;
+        auto second = MakeNode(3);
+        second->parent = orphan;
+        Link(second, orphan);
+
+        GraphWriter writer(stream.Fd());
+        writer.Write(first);
+        writer.Write(second);
+        writer.Flush();
+        REQUIRE(writer.Objects() == 3);
+        second->children.clear();
+    }
+    REQUIRE(Node::alive == 0);
+
+    stream.Rewind();
+    GraphReader reader(stream.Fd());
+    auto first = reader.Read<Node>();
+    // No default constructed stand-in is left behind the weak reference.
+    REQUIRE(first->parent.Expired());
+    REQUIRE(!first->parent.Lock());
+    REQUIRE(Node::alive == 1);
+
+    // Written by a later root, the target only reaches the references read with it.
+    auto second = reader.Read<Node>();
+    const auto& orphan = second->children.at(0);
+    REQUIRE(orphan->name == "orphan");
+    REQUIRE(second->parent.Lock() == orphan);
+    REQUIRE(first->parent.Expired());
+    REQUIRE(reader.Objects() == 3);
+    REQUIRE(Node::alive == 3);
+}
+
+TEST_CASE("Roots share objects") {
+    Stream stream;
+    {
+        auto shared = MakeShared<Shape>();
+        shared->color = Color::kBlue;
+        shared->points = {{1, 2}, {3, 4}};
+        auto first = MakeShared<Shape>();
+        first->next = shared;
+        auto second = MakeShared<Shape>();
+        second->next = shared;
+
+        GraphWriter writer(stream.Fd());
+        writer.Write(first);
+        writer.Write(second);
+        writer.Write(shared);
+        writer.Write(SharedPtr<Shape>());
+        writer.Flush();
+        REQUIRE(writer.Objects() == 3);
+    }
+
+    stream.Rewind();
+    GraphReader reader(stream.Fd());
+    auto first = reader.Read<Shape>();
+    auto second = reader.Read<Shape>();
+    auto shared = reader.Read<Shape>();
+    REQUIRE(!reader.Read<Shape>());
+    REQUIRE(first->next == shared);
+    REQUIRE(second->next == shared);
+    REQUIRE(shared->color == Color::kBlue);
+    REQUIRE(shared->points.size() == 2);
+    REQUIRE(shared->points[1].x == 3);
+    REQUIRE(shared->points[1].y == 4);
+    REQUIRE(!shared->next);
+}
+
+TEST_CASE("Long chains") {
+    constexpr int kLength = 100'000;
+    Stream stream;
+    {
+        auto head = MakeNode(0);
+        Node* tail = head.Get();
+        for (int i = 1; i < kLength; ++i) {
+            tail->children.push_back(MakeNode(i));
+            tail = tail->children[0].Get();
+        }
+        GraphWriter writer(stream.Fd());
+        writer.Write(head);
+        writer.Flush();
+        // Unlinked from the head, destroying recursively would take as much stack.
+        while (!head->children.empty()) {
+            head = SharedPtr<Node>(head->children[0]);
+        }
+    }
+    REQUIRE(Node::alive == 0);
+
+    stream.Rewind();
+    auto head = GraphReader(stream.Fd()).Read<Node>();
+    REQUIRE(Node::alive == kLength);
+    int64_t expected = 0;
+    int wrong = 0;
+    for (const Node* node = head.Get(); node != nullptr;
+         node = node->children.empty() ? nullptr : node->children[0].Get()) {
+        wrong += node->key != expected++;
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(expected == kLength);
+    while (!head->children.empty()) {
+        head = SharedPtr<Node>(head->children[0]);
+    }
+    head.Reset();
+    REQUIRE(Node::alive == 0);
+}
+
+TEST_CASE("Malformed streams") {
+    Stream stream;
+    {
+        auto root = MakeNode(1, "root");
+        Link(root, MakeNode(2, "child"));
+        GraphWriter writer(stream.Fd());
+        writer.Write(root);
+        writer.Flush();
+    }
+
+    SECTION("Wrong type") {
+        stream.Rewind();
+        GraphReader reader(stream.Fd());
+        REQUIRE_NOTHROW(reader.Read<Node>());
+        stream.Rewind();
+        GraphReader other(stream.Fd());
+        REQUIRE_THROWS_AS(other.Read<Shape>(), std::runtime_error);
+    }
+
+    SECTION("Truncated") {
+        stream.Truncate(stream.Size() - 3);
+        stream.Rewind();
+        GraphReader reader(stream.Fd());
+        REQUIRE_THROWS_AS(reader.Read<Node>(), std::runtime_error);
+    }
+
+    SECTION("Not a graph") {
+        stream.Truncate(0);
+        REQUIRE(write(stream.Fd(), "JSON", 4) == 4);
+        stream.Rewind();
+        REQUIRE_THROWS_AS(GraphReader(stream.Fd()), std::runtime_error);
+    }
+    REQUIRE(Node::alive == 0);
+}
@@ -1,7 +1,21 @@
 #pragma once
 
+#include "../lifetime/lifetime.h"
+#include "../registry/registry.h"
+#include "../trace/trace.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <array>
+#include <new>
+#include <thread>
+#include <utility>
+
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 class BadWeakPtr : public std::exception {};
 
@@ -16,6 +30,43 @@ class SharedPtr;
 template <typename T>
 class WeakPtr;
 
+class ControlBlock;
+
+// Identity of a thread owning biased control blocks (see `MakeBiasedShared`). Referenced by the
+// thread and by every block it owns, so that a block never takes a later thread for its owner.
+class BiasedOwner {
+public:
+    // Creates the owner of the calling thread on first use. Returns nullptr while the thread
+    // is exiting, and when the system has no `HeavyFence`.
+    static BiasedOwner* Current();
+
+    void Ref() {
+        refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Unref() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    // A full barrier on every running thread of the process, so that the other side of the
+    // pairing only needs a compiler barrier. Lets a thread take over the count an owner keeps
+    // with plain stores.
+    static void HeavyFence() {
+        syscall(__NR_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0);
+    }
+
+private:
+    std::atomic<int> refs_ = 1;
+};
+
+inline thread_local BiasedOwner* current_biased_owner = nullptr;
+inline thread_local bool biased_owner_exited = false;
+
+// Counters are updated atomically, so handles to the same object may be copied and dropped
+// from different threads. All strong references together own one weak reference: the object
+// dies with the last `SharedPtr`, the block itself with the last `WeakPtr` after that.
 class ControlBlock {
 public:
     ControlBlock() {
@@ -28,84 +79,228 @@ public:
     ControlBlock& operator=(ControlBlock&&) = delete;
 
     void IncreaseSharedCounter() {
-        ++shared_counter_;
+        if (shared_counter_.load(std::memory_order_relaxed) & kCustomCounter) {
+            IncreaseCustom();
+            return;
+        }
+        shared_counter_.fetch_add(1, std::memory_order_relaxed);
     }
 
-    virtual void DecreaseSharedCounter(int counter = 1) {
-        shared_counter_ -= counter;
+    // Used by `WeakPtr::Lock`: fails once the object has been destroyed.
+    bool TryIncreaseSharedCounter() {
+        int count = shared_counter_.load(std::memory_order_relaxed);
+        if (count & kCustomCounter) {
+            return TryIncreaseCustom();
+        }
+        while (count != 0) {
+            if (shared_counter_.compare_exchange_weak(count, count + 1,
+                                                      std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
     }
 
-    void IncreaseWeakCounter(int counter = 1) {
-        weak_counter_ += counter;
+    void DecreaseSharedCounter(int count = 1) {
+        if (shared_counter_.load(std::memory_order_relaxed) & kCustomCounter) {
+            DecreaseCustom(count);
+            return;
+        }
+        if (shared_counter_.fetch_sub(count, std::memory_order_acq_rel) == count) {
+            ReleaseObject();
+        }
+    }
+
+    void IncreaseWeakCounter() {
+        weak_counter_.fetch_add(1, std::memory_order_relaxed);
     }
 
     void DecreaseWeakCounter() {
-        --weak_counter_;
+        if (weak_counter_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
     }
 
-    int GetSharedCounter() {
-        return shared_counter_;
+    int GetSharedCounter() const {
+        int count = shared_counter_.load(std::memory_order_acquire);
+        return count & kCustomCounter ? GetSharedCustom() : count;
     }
 
-    int GetWeakCounter() {
-        return weak_counter_;
+    // Includes the reference owned by strong references while the object is alive.
+    int GetWeakCounter() const {
+        return weak_counter_.load(std::memory_order_relaxed);
     }
 
     virtual ~ControlBlock() {
+        SMART_PTRS_UNREGISTER(this);
     }
 
+#ifdef SMART_PTRS_REGISTRY
+    ptr_registry::Entry registry_entry;
+#endif
+
+#ifdef SMART_PTRS_LIFETIME
+    ptr_lifetime::Stamp lifetime_stamp;
+#endif
+
 protected:
-    int shared_counter_ = 0;
-    int weak_counter_ = 0;
+    virtual void DestroyObject() = 0;
 
-    template <typename U, typename... Args>
-    friend SharedPtr<U> MakeShared(Args&&... args);
-};
+    // Set in `shared_counter_` by blocks that count strong references their own way: every
+    // operation on the count then goes through the virtual functions below. A bit of the counter
+    // rather than a field, so that other blocks keep their size and only test the word they
+    // load anyway. By default the count is kept in the low bits as usual.
+    static constexpr int kCustomCounter = 1 << 30;
+    static constexpr int kCountMask = kCustomCounter - 1;
 
-template <typename T>
-class ControlBlockPointer : public ControlBlock {
-public:
-    ControlBlockPointer() {
+    virtual void IncreaseCustom() {
+        shared_counter_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    virtual bool TryIncreaseCustom() {
+        int count = shared_counter_.load(std::memory_order_relaxed);
+        while (count & kCountMask) {
+            if (shared_counter_.compare_exchange_weak(count, count + 1,
+                                                      std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
     }
 
-    ControlBlockPointer(T* ptr) : obj_(ptr) {
-        shared_counter_ = 1;
+    virtual void DecreaseCustom(int count) {
+        if ((shared_counter_.fetch_sub(count, std::memory_order_acq_rel) & kCountMask) == count) {
+            ReleaseObject();
+        }
     }
 
-    ControlBlockPointer(ControlBlockPointer&& other) : obj_(other.obj_) {
-        shared_counter_ = other.shared_counter_;
-        other.obj_ = nullptr;
-        other.shared_counter_ = 0;
+    virtual int GetSharedCustom() const {
+        return shared_counter_.load(std::memory_order_acquire) & kCountMask;
     }
 
-    void DecreaseSharedCounter(int counter = 1) {
-        shared_counter_ -= counter;
-        if (shared_counter_ == 0) {
-            if constexpr (std::is_convertible_v<T*, EnableSharedFromThisBase*>) {
-                ++shared_counter_;
-                delete obj_;
-                --shared_counter_;
-                obj_ = nullptr;
-            }
+    void ReleaseObject() {
+        SMART_PTRS_TRACE_EVENT(kZero, kShared, this);
+        DestroyObject();
+        DecreaseWeakCounter();
+    }
+
+    std::atomic<int> shared_counter_ = 1;
+    std::atomic<int> weak_counter_ = 1;
+};
+
+inline BiasedOwner* BiasedOwner::Current() {
+    struct Registration {
+        Registration() {
+            current_biased_owner = new BiasedOwner();
         }
+
+        ~Registration() {
+            BiasedOwner* owner = current_biased_owner;
+            current_biased_owner = nullptr;
+            biased_owner_exited = true;
+            owner->Unref();
+        }
+    };
+
+    static const bool kHasHeavyFence =
+        syscall(__NR_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+    if (current_biased_owner == nullptr && !biased_owner_exited && kHasHeavyFence) {
+        thread_local Registration registration;
     }
+    return current_biased_owner;
+}
 
-    ~ControlBlockPointer() {
-        if (obj_ != nullptr) {
-            if constexpr (std::is_convertible_v<T*, EnableSharedFromThisBase*>) {
-                ++shared_counter_;
-                delete obj_;
-                obj_ = nullptr;
-                --shared_counter_;
-            } else {
-                delete obj_;
-                obj_ = nullptr;
-            }
+// Buffers `SharedPtr` releases made by the calling thread while the scope is alive, so that
+// dropping many handles to the same few objects costs one atomic decrement per object.
+// Releases are flushed when too many distinct blocks pile up and when the scope ends: every object
+// whose last reference was dropped inside the scope is destroyed by then, including the ones
+// released by its destructor. `UseCount` overestimates while releases are pending.
+// Scopes nest, a release goes to the innermost one.
+class DeferredReleaseScope {
+public:
+    static constexpr size_t kCapacityLog = 8;
+    static constexpr size_t kCapacity = size_t{1} << kCapacityLog;
+
+    DeferredReleaseScope();
+
+    DeferredReleaseScope(const DeferredReleaseScope&) = delete;
+    DeferredReleaseScope& operator=(const DeferredReleaseScope&) = delete;
+
+    ~DeferredReleaseScope();
+
+    void Defer(ControlBlock* block);
+
+    void Flush();
+
+private:
+    struct Entry {
+        ControlBlock* block = nullptr;
+        int count = 0;
+    };
+
+    std::array<Entry, kCapacity> entries_;
+    size_t size_ = 0;
+    DeferredReleaseScope* previous_;
+};
+
+inline thread_local DeferredReleaseScope* current_deferred_release = nullptr;
+
+inline DeferredReleaseScope::DeferredReleaseScope() : previous_(current_deferred_release) {
+    current_deferred_release = this;
+}
+
+inline DeferredReleaseScope::~DeferredReleaseScope() {
+    Flush();
+    current_deferred_release = previous_;
+}
+
+inline void DeferredReleaseScope::Defer(ControlBlock* block) {
+    auto hash = reinterpret_cast<uintptr_t>(block) * 0x9E3779B97F4A7C15ull;
+    for (size_t i = hash >> (64 - kCapacityLog);; ++i) {
+        Entry& entry = entries_[i % kCapacity];
+        if (entry.block == block) {
+            ++entry.count;
+            return;
+        }
+        if (entry.block == nullptr) {
+            entry = {block, 1};
+            break;
         }
     }
+    // Keeps probe sequences short.
+    if (++size_ == kCapacity / 2) {
+        Flush();
+    }
+}
+
+inline void DeferredReleaseScope::Flush() {
+    // Destructors run by the flush release their members right away.
+    DeferredReleaseScope* current = current_deferred_release;
+    current_deferred_release = nullptr;
+    for (Entry& entry : entries_) {
+        if (entry.block != nullptr) {
+            entry.block->DecreaseSharedCounter(entry.count);
+            entry = {};
+        }
+    }
+    size_ = 0;
+    current_deferred_release = current;
+}
+
+template <typename T>
+class ControlBlockPointer : public ControlBlock {
+public:
+    explicit ControlBlockPointer(T* ptr) : obj_(ptr) {
+    }
+
+protected:
+    void DestroyObject() override {
+        SMART_PTRS_LIFETIME_RECORD(T, this->lifetime_stamp);
+        delete obj_;
+    }
 
 private:
-    T* obj_ = nullptr;
+    T* obj_;
 };
 
 template <typename T>
@@ -114,33 +309,182 @@ public:
     template <typename... Args>
     ControlBlockObject(Args&&... args) {
         new (&obj_) T(std::forward<Args>(args)...);
-        shared_counter_ = 1;
     }
 
-    ControlBlockObject(ControlBlockObject&& other) {
-        obj_ = std::move(other.obj_);
-        shared_counter_ = other.shared_counter_;
-        other.DecreaseSharedCounter(shared_counter_);
+    T* GetObject() {
+        return std::launder(reinterpret_cast<T*>(&obj_));
+    }
+
+protected:
+    void DestroyObject() override {
+        SMART_PTRS_LIFETIME_RECORD(T, this->lifetime_stamp);
+        GetObject()->~T();
+    }
+
+private:
+    alignas(T) std::array<char, sizeof(T)> obj_;
+};
+
+// Biases the count towards the thread that created the block. The owner keeps its references in
+// `biased_` with plain loads and stores, other threads count theirs in `shared_counter_`. The
+// owner merges `biased_` into `shared_counter_` when its own count would reach zero; another
+// thread takes `biased_` over when its release could be the last reference (see `Revoke`).
+// Either way the merged count then reaches zero with the last reference, on whichever thread
+// drops it. While the block is not merged `biased_` is at least one, so the object is alive.
+template <typename T>
+class BiasedControlBlockObject : public ControlBlockObject<T> {
+public:
+    template <typename... Args>
+    BiasedControlBlockObject(BiasedOwner* owner, Args&&... args)
+        : ControlBlockObject<T>(std::forward<Args>(args)...), owner_(owner) {
+        owner_->Ref();
+        this->shared_counter_.store(ControlBlock::kCustomCounter, std::memory_order_relaxed);
+    }
+
+    ~BiasedControlBlockObject() override {
+        owner_->Unref();
+    }
+
+protected:
+    void IncreaseCustom() override {
+        if (!IsOwner() || !AddBiased(biased_.load(std::memory_order_relaxed), 1)) {
+            this->shared_counter_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool TryIncreaseCustom() override {
+        if (IsOwner() && AddBiased(biased_.load(std::memory_order_relaxed), 1)) {
+            return true;
+        }
+        int count = this->shared_counter_.load(std::memory_order_relaxed);
+        while (true) {
+            if (count & kRevoking) {
+                count = WaitMerged();
+            }
+            if ((count & kMerged) && (count & kCount) == 0) {
+                return false;
+            }
+            if (this->shared_counter_.compare_exchange_weak(count, count + 1,
+                                                            std::memory_order_relaxed)) {
+                return true;
+            }
+        }
     }
 
-    void DecreaseSharedCounter(int counter = 1) {
-        shared_counter_ -= counter;
-        if (shared_counter_ == 0) {
-            if constexpr (std::is_convertible_v<T*, EnableSharedFromThisBase*>) {
-                ++shared_counter_;
-                reinterpret_cast<T*>(&obj_)->~T();
-                --shared_counter_;
-            } else {
-                reinterpret_cast<T*>(&obj_)->~T();
+    void DecreaseCustom(int count) override {
+        if (IsOwner()) {
+            DecreaseOwned(count);
+            return;
+        }
+        int word = this->shared_counter_.load(std::memory_order_relaxed);
+        while (!(word & kMerged)) {
+            if (word & kRevoking) {
+                WaitMerged();
+                break;
+            }
+            // Whatever the owner holds, the count stays positive.
+            if ((word & kCount) > count) {
+                if (this->shared_counter_.compare_exchange_weak(word, word - count,
+                                                                std::memory_order_acq_rel)) {
+                    return;
+                }
+            } else if (this->shared_counter_.compare_exchange_weak(word, word | kRevoking,
+                                                                   std::memory_order_acq_rel)) {
+                Revoke(count);
+                return;
             }
         }
+        DecreaseMerged(count);
     }
 
-    ~ControlBlockObject() {
+    int GetSharedCustom() const override {
+        int word = this->shared_counter_.load(std::memory_order_acquire);
+        int count = word & kCount;
+        return word & kMerged ? count : count + biased_.load(std::memory_order_relaxed);
     }
 
 private:
-    alignas(T) std::array<char, sizeof(T)> obj_;
+    // `biased_` is folded into the count for good.
+    static constexpr int kMerged = 1 << 29;
+    // Another thread is taking `biased_` over, the count is unknown until `kMerged`.
+    static constexpr int kRevoking = 1 << 28;
+    static constexpr int kCount = kRevoking - 1;
+
+    bool IsOwner() const {
+        return owner_ == current_biased_owner &&
+               !(this->shared_counter_.load(std::memory_order_relaxed) & kMerged);
+    }
+
+    // Owner only. Returns false if `delta` was not counted because the count was taken over
+    // meanwhile: it is then up to the caller to apply it to the merged count.
+    bool AddBiased(int biased, int delta) {
+        biased_.store(biased + delta, std::memory_order_relaxed);
+        // Pairs with the fence in `Revoke`: either this load sees `kRevoking`, or the revoking
+        // thread sees the store above.
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        if (!(this->shared_counter_.load(std::memory_order_relaxed) & (kRevoking | kMerged))) {
+            return true;
+        }
+        WaitMerged();
+        return taken_.load(std::memory_order_relaxed) == biased + delta;
+    }
+
+    void DecreaseOwned(int count) {
+        int biased = biased_.load(std::memory_order_relaxed);
+        if (biased > count) {
+            if (!AddBiased(biased, -count)) {
+                DecreaseMerged(count);
+            }
+            return;
+        }
+        // The last references the owner counts: merges what is left, which may be negative when
+        // it drops references other threads counted.
+        int word = this->shared_counter_.load(std::memory_order_relaxed);
+        do {
+            if (word & (kRevoking | kMerged)) {
+                // Taken over with `biased` in it.
+                WaitMerged();
+                DecreaseMerged(count);
+                return;
+            }
+        } while (!this->shared_counter_.compare_exchange_weak(
+            word, word + biased - count + kMerged, std::memory_order_acq_rel));
+        if ((word & kCount) + biased - count == 0) {
+            this->ReleaseObject();
+        }
+    }
+
+    // The owner may be changing `biased_` with plain stores right now. After the fence every
+    // store it made before it could see `kRevoking` is visible; if it made one after, it waits
+    // for `kMerged` and compares its value with `taken_` to learn whether it was counted.
+    void Revoke(int count) {
+        BiasedOwner::HeavyFence();
+        int biased = biased_.load(std::memory_order_relaxed);
+        taken_.store(biased, std::memory_order_relaxed);
+        int old = this->shared_counter_.fetch_add(biased - count - kRevoking + kMerged,
+                                                  std::memory_order_acq_rel);
+        if ((old & kCount) + biased - count == 0) {
+            this->ReleaseObject();
+        }
+    }
+
+    void DecreaseMerged(int count) {
+        int old = this->shared_counter_.fetch_sub(count, std::memory_order_acq_rel);
+        if ((old & kCount) == count) {
+            this->ReleaseObject();
+        }
+    }
+
+    int WaitMerged() const {
+        int word;
+        while (!((word = this->shared_counter_.load(std::memory_order_acquire)) & kMerged)) {
+            std::this_thread::yield();
+        }
+        return word;
+    }
 
-    friend SharedPtr<T>;
+    BiasedOwner* const owner_;
+    std::atomic<int> biased_ = 1;
+    // The value of `biased_` the revoking thread merged.
+    std::atomic<int> taken_ = 0;
 };
@@ -5,6 +5,7 @@
 #include "allocations_checker.h"
 
 #include <memory>
+#include <vector>
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -467,3 +468,69 @@ TEST_CASE("Destructor for correct type") {
         REQUIRE(B::destructor_called);
     }
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct Counted {
+    static int alive;
+
+    Counted() {
+        ++alive;
+    }
+
+    ~Counted() {
+        --alive;
+    }
+
+    SharedPtr<Counted> child;
+};
+
+int Counted::alive = 0;
+
+TEST_CASE("Deferred release") {
+    SECTION("Coalesced until scope end") {
+        std::vector<SharedPtr<Counted>> handles;
+        {
+            auto a = MakeShared<Counted>();
+            auto b = MakeShared<Counted>();
+            for (int i = 0; i < 1000; ++i) {
+                handles.push_back(i % 2 ? a : b);
+            }
+        }
+        {
+            DeferredReleaseScope scope;
+            handles.clear();
+            REQUIRE(Counted::alive == 2);
+        }
+        REQUIRE(Counted::alive == 0);
+    }
+
+    SECTION("Flushed at threshold") {
+        std::vector<SharedPtr<Counted>> handles;
+        for (size_t i = 0; i < DeferredReleaseScope::kCapacity; ++i) {
+            handles.push_back(MakeShared<Counted>());
+        }
+        {
+            DeferredReleaseScope scope;
+            handles.clear();
+            REQUIRE(Counted::alive < static_cast<int>(DeferredReleaseScope::kCapacity));
+        }
+        REQUIRE(Counted::alive == 0);
+    }
+
+    SECTION("Cascades and nesting") {
+        {
+            DeferredReleaseScope outer;
+            auto parent = MakeShared<Counted>();
+            parent->child = MakeShared<Counted>();
+            parent->child->child = MakeShared<Counted>();
+            {
+                DeferredReleaseScope inner;
+                parent.Reset();
+                REQUIRE(Counted::alive == 3);
+            }
+            REQUIRE(Counted::alive == 0);
+        }
+        REQUIRE(Counted::alive == 0);
+    }
+}
@@ -0,0 +1,231 @@
+#include "shared.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Counted {
+    static int alive;
+
+    explicit Counted(int value = 0) : value(value) {
+        ++alive;
+    }
+
+    virtual ~Counted() {
+        --alive;
+    }
+
+    int value;
+};
+
+int Counted::alive = 0;
+
+struct Derived : Counted {
+    using Counted::Counted;
+};
+
+// Shares its counts with its copies.
+template <typename T>
+struct CountingAllocator {
+    using value_type = T;
+
+    explicit CountingAllocator(int* allocations) : allocations(allocations) {
+    }
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& other) : allocations(other.allocations) {
+    }
+
+    T* allocate(size_t n) {
+        ++*allocations;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        --*allocations;
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    int* allocations;
+};
+
+using LocalPolicy = SharedPolicy<false, true>;
+using StrongPolicy = SharedPolicy<true, false>;
+using LocalStrongPolicy = SharedPolicy<false, false>;
+using NoDeleterPolicy = SharedPolicy<true, false, std::allocator<std::byte>, DeleterStorage::kNone>;
+using CountingPolicy = SharedPolicy<true, true, CountingAllocator<std::byte>>;
+
+}  // namespace
+
+TEST_CASE("Default policy is SharedPtr") {
+    STATIC_REQUIRE(std::is_same_v<BasicSharedPtr<int>, SharedPtr<int>>);
+    STATIC_REQUIRE(std::is_same_v<BasicWeakPtr<int>, WeakPtr<int>>);
+
+    auto ptr = MakeBasicShared<std::string>("abc");
+    REQUIRE(*ptr == "abc");
+    REQUIRE(ptr.UseCount() == 1);
+}
+
+TEST_CASE("Counting") {
+    {
+        auto a = MakeBasicShared<Counted, LocalPolicy>(1);
+        auto b = a;
+        REQUIRE(a.UseCount() == 2);
+        REQUIRE(b->value == 1);
+        auto c = std::move(b);
+        REQUIRE(!b);
+        REQUIRE(a.UseCount() == 2);
+        c.Reset();
+        REQUIRE(a.UseCount() == 1);
+        REQUIRE(Counted::alive == 1);
+
+        BasicSharedPtr<Counted, LocalPolicy> empty;
+        a = empty;
+        REQUIRE(Counted::alive == 0);
+        REQUIRE(a.UseCount() == 0);
+    }
+    {
+        auto a = MakeBasicShared<Counted, StrongPolicy>(2);
+        auto b = a;
+        a = b;
+        REQUIRE(b.UseCount() == 2);
+        REQUIRE(a == b);
+    }
+    {
+        auto a = MakeBasicShared<Counted, NoDeleterPolicy>(3);
+        auto b = a;
+        REQUIRE((*b).value == 3);
+        a.Reset();
+        REQUIRE(Counted::alive == 1);
+    }
+    REQUIRE(Counted::alive == 0);
+}
+
+TEST_CASE("Weak references") {
+    BasicWeakPtr<Counted, LocalPolicy> weak;
+    REQUIRE(weak.Expired());
+    REQUIRE_THROWS_AS((BasicSharedPtr<Counted, LocalPolicy>(weak)), BadWeakPtr);
+    {
+        auto strong = MakeBasicShared<Counted, LocalPolicy>(4);
+        weak = strong;
+        REQUIRE(weak.UseCount() == 1);
+        auto locked = weak.Lock();
+        REQUIRE(locked == strong);
+        REQUIRE(strong.UseCount() == 2);
+        BasicSharedPtr<Counted, LocalPolicy> promoted(weak);
+        REQUIRE(promoted->value == 4);
+    }
+    REQUIRE(Counted::alive == 0);
+    REQUIRE(weak.Expired());
+    REQUIRE(!weak.Lock());
+    REQUIRE_THROWS_AS((BasicSharedPtr<Counted, LocalPolicy>(weak)), BadWeakPtr);
+}
+
+TEST_CASE("Allocators") {
+    int allocations = 0;
+    CountingAllocator<std::byte> allocator(&allocations);
+    {
+        auto a = AllocatePolicyShared<Counted, CountingPolicy>(allocator, 5);
+        REQUIRE(allocations == 1);
+        BasicWeakPtr<Counted, CountingPolicy> weak = a;
+        a.Reset();
+        REQUIRE(Counted::alive == 0);
+        // The weak reference keeps the block.
+        REQUIRE(allocations == 1);
+    }
+    REQUIRE(allocations == 0);
+    {
+        BasicSharedPtr<Counted, CountingPolicy> a(new Counted(6), std::default_delete<Counted>(),
+                                                  allocator);
+        REQUIRE(allocations == 1);
+    }
+    REQUIRE(allocations == 0);
+    REQUIRE(Counted::alive == 0);
+}
+
+TEST_CASE("Deleters and conversions") {
+    int deleted = 0;
+    {
+        auto deleter = [&deleted](Counted* ptr) {
+            ++deleted;
+            delete ptr;
+        };
+        BasicSharedPtr<Derived, StrongPolicy> derived(new Derived(7), deleter);
+        BasicSharedPtr<Counted, StrongPolicy> base = derived;
+        REQUIRE(base.UseCount() == 2);
+        REQUIRE(base.Get() == derived.Get());
+        derived.Reset();
+        REQUIRE(deleted == 0);
+
+        BasicSharedPtr<Counted, StrongPolicy> moved = MakeBasicShared<Derived, StrongPolicy>(8);
+        REQUIRE(moved->value == 8);
+    }
+    REQUIRE(deleted == 1);
+    REQUIRE(Counted::alive == 0);
+
+    STATIC_REQUIRE(std::is_convertible_v<BasicSharedPtr<Derived, StrongPolicy>,
+                                         BasicSharedPtr<Counted, StrongPolicy>>);
+    STATIC_REQUIRE(!std::is_convertible_v<BasicSharedPtr<Derived, NoDeleterPolicy>,
+                                          BasicSharedPtr<Counted, NoDeleterPolicy>>);
+    STATIC_REQUIRE(!std::is_constructible_v<BasicSharedPtr<int, NoDeleterPolicy>, int*>);
+}
+
+TEST_CASE("Block layout") {
+    using WeakNoDeleterPolicy =
+        SharedPolicy<true, true, std::allocator<std::byte>, DeleterStorage::kNone>;
+    STATIC_REQUIRE(BasicSharedBlockSize<int, NoDeleterPolicy>() == 2 * sizeof(int));
+    STATIC_REQUIRE(BasicSharedBlockSize<int, WeakNoDeleterPolicy>() == 3 * sizeof(int));
+    // Next to the function pointer, the weak counter takes the padding.
+    STATIC_REQUIRE(BasicSharedBlockSize<int, LocalStrongPolicy>() ==
+                   BasicSharedBlockSize<int, LocalPolicy>());
+    STATIC_REQUIRE(BasicSharedBlockSize<int, CountingPolicy>() ==
+                   sizeof(shared_policy::ObjectBlock<int, DefaultSharedPolicy>) + sizeof(int*));
+    STATIC_REQUIRE(BasicSharedBlockSize<int, StrongPolicy>() <=
+                   BasicSharedBlockSize<int, DefaultSharedPolicy>());
+    STATIC_REQUIRE(BasicSharedBlockSize<int, DefaultSharedPolicy>() == 2 * sizeof(void*) + 8);
+}
+
+TEST_CASE("Strong-only pointers") {
+    STATIC_REQUIRE(sizeof(StrongOnlySharedPtr<Counted>) == sizeof(void*));
+    STATIC_REQUIRE(BasicSharedBlockSize<int, StrongOnlySharedPolicy>() == 2 * sizeof(int));
+    STATIC_REQUIRE(BasicSharedBlockSize<Counted, StrongOnlySharedPolicy>() ==
+                   sizeof(void*) + sizeof(Counted));
+
+    StrongOnlySharedPtr<Counted> empty;
+    REQUIRE(!empty);
+    REQUIRE(empty.Get() == nullptr);
+    REQUIRE(empty.UseCount() == 0);
+    {
+        auto a = MakeStrongOnlyShared<Counted>(9);
+        REQUIRE(a);
+        REQUIRE(a->value == 9);
+        REQUIRE(&*a == a.Get());
+        auto b = a;
+        REQUIRE(b.Get() == a.Get());
+        REQUIRE(a.UseCount() == 2);
+        auto c = std::move(a);
+        REQUIRE(!a);
+        REQUIRE(a.Get() == nullptr);
+        c.Reset();
+        REQUIRE(Counted::alive == 1);
+        b = empty;
+        REQUIRE(Counted::alive == 0);
+    }
+    {
+        std::vector<StrongOnlySharedPtr<std::string>> strings;
+        for (int i = 0; i < 100; ++i) {
+            strings.push_back(MakeStrongOnlyShared<std::string>(100, 'a' + i % 26));
+            strings.push_back(strings.back());
+        }
+        REQUIRE(strings[51]->size() == 100);
+        REQUIRE((*strings[51])[0] == 'z');
+    }
+}
@@ -0,0 +1,177 @@
+#include "trace.h"
+
+#include "../intrusive/intrusive.h"
+#include "../weak/shared.h"
+#include "../weak/weak.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+using ptr_trace::Event;
+using ptr_trace::Handle;
+
+struct Kind {
+    Handle handle;
+    Event event;
+
+    bool operator==(const Kind&) const = default;
+};
+
+std::vector<Kind> EventsOf(const void* address) {
+    std::vector<Kind> kinds;
+    for (const auto& timeline : ptr_trace::Timelines(ptr_trace::Snapshot())) {
+        if (timeline.address == address) {
+            kinds.clear();
+            for (const auto& record : timeline.events) {
+                kinds.push_back({record.handle, record.event});
+            }
+        }
+    }
+    return kinds;
+}
+
+struct Widget : SimpleRefCounted<Widget> {};
+
+}  // namespace
+
+TEST_CASE("SharedPtr timeline") {
+    ptr_trace::Clear();
+    const void* block;
+    {
+        auto a = MakeShared<int>(1);
+        block = a.GetControl();
+        auto b = a;
+        auto c = std::move(b);
+        WeakPtr<int> weak(a);
+        a.Reset();
+        c.Reset();
+        REQUIRE(!weak.Lock());
+    }
+    std::vector<Kind> expected{
+        {Handle::kShared, Event::kCreate}, {Handle::kShared, Event::kCopy},
+        {Handle::kShared, Event::kMove},   {Handle::kWeak, Event::kCopy},
+        {Handle::kShared, Event::kDestroy}, {Handle::kShared, Event::kDestroy},
+        {Handle::kShared, Event::kZero},   {Handle::kWeak, Event::kLockFail},
+        {Handle::kWeak, Event::kDestroy},
+    };
+    REQUIRE(EventsOf(block) == expected);
+
+    auto timelines = ptr_trace::Timelines(ptr_trace::Snapshot());
+    REQUIRE(timelines.size() == 1);
+    REQUIRE(timelines[0].ended);
+}
+
+TEST_CASE("IntrusivePtr timeline") {
+    ptr_trace::Clear();
+    auto* widget = new Widget();
+    {
+        IntrusivePtr<Widget> a(widget);
+        auto b = a;
+        auto c = std::move(a);
+    }
+    std::vector<Kind> expected{
+        {Handle::kIntrusive, Event::kCreate}, {Handle::kIntrusive, Event::kCopy},
+        {Handle::kIntrusive, Event::kMove},   {Handle::kIntrusive, Event::kDestroy},
+        {Handle::kIntrusive, Event::kDestroy}, {Handle::kIntrusive, Event::kZero},
+    };
+    REQUIRE(EventsOf(widget) == expected);
+}
+
+TEST_CASE("Reused addresses start new timelines") {
+    ptr_trace::Clear();
+    ControlBlock* first;
+    {
+        auto a = MakeShared<int>(1);
+        first = a.GetControl();
+    }
+    SharedPtr<int> b;
+    // The allocator hands the freed block out again, most of the time right away.
+    for (int i = 0; i < 100 && b.GetControl() != first; ++i) {
+        b = MakeShared<int>(2);
+    }
+    if (b.GetControl() == first) {
+        auto timelines = ptr_trace::Timelines(ptr_trace::Snapshot());
+        REQUIRE(timelines.size() >= 2);
+        REQUIRE(timelines.front().address == first);
+        REQUIRE(timelines.front().ended);
+        REQUIRE(!timelines.back().ended);
+    }
+}
+
+TEST_CASE("Events of all threads") {
+    constexpr int kThreads = 4;
+    constexpr int kCopies = 100;
+
+    ptr_trace::Clear();
+    auto shared = MakeShared<int>(1);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < kCopies; ++i) {
+                auto copy = shared;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    shared.Reset();
+
+    auto timelines = ptr_trace::Timelines(ptr_trace::Snapshot());
+    REQUIRE(timelines.size() == 1);
+    const auto& events = timelines[0].events;
+    REQUIRE(events.size() == 2 * kThreads * kCopies + 3);
+    REQUIRE(events.front().event == Event::kCreate);
+    REQUIRE(events.back().event == Event::kZero);
+    for (size_t i = 1; i < events.size(); ++i) {
+        REQUIRE(events[i - 1].time <= events[i].time);
+    }
+
+    std::ostringstream out;
+    ptr_trace::Dump(timelines, out);
+    REQUIRE(out.str().find("ended") != std::string::npos);
+    REQUIRE(out.str().find("shared create") != std::string::npos);
+}
+
+TEST_CASE("Ring keeps the latest events") {
+    ptr_trace::Clear();
+    std::thread([] {
+        auto shared = MakeShared<int>(1);
+        for (size_t i = 0; i < ptr_trace::Ring::kCapacity; ++i) {
+            auto copy = shared;
+        }
+    }).join();
+    auto records = ptr_trace::Snapshot();
+    REQUIRE(records.size() <= ptr_trace::Ring::kCapacity);
+    REQUIRE(records.back().event == Event::kZero);
+}
+
+// Run under TSan: cmake -DCMAKE_BUILD_TYPE=TSAN
+TEST_CASE("Snapshot while threads record") {
+    std::atomic<bool> stop = false;
+    std::thread writer([&] {
+        auto shared = MakeShared<int>(1);
+        while (!stop.load()) {
+            auto copy = shared;
+        }
+    });
+    int wrong = 0;
+    for (int i = 0; i < 20; ++i) {
+        for (const auto& record : ptr_trace::Snapshot()) {
+            wrong += record.handle != Handle::kShared;
+        }
+    }
+    stop = true;
+    writer.join();
+    REQUIRE(wrong == 0);
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+// Reference count lifecycle tracing. Built with `-DSMART_PTRS_TRACE`, `SharedPtr`, `WeakPtr` and
+// `IntrusivePtr` record their events into per-thread ring buffers; otherwise the hooks expand to
+// nothing and do not evaluate their arguments.
+//
+// The whole program has to agree on the flag: the hooks live in inline functions.
+#ifndef SMART_PTRS_TRACE
+
+#define SMART_PTRS_TRACE_EVENT(event, handle, address) static_cast<void>(0)
+
+#else
+
+#define SMART_PTRS_TRACE_EVENT(event, handle, address) \
+    ::ptr_trace::Emit(::ptr_trace::Event::event, ::ptr_trace::Handle::handle, address)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+namespace ptr_trace {
+
+enum class Event : uint8_t {
+    kCreate,
+    kCopy,
+    kMove,
+    // A handle dropped its reference.
+    kDestroy,
+    // `WeakPtr::Lock` or `TryIncRef` found the object dead.
+    kLockFail,
+    // The strong count reached zero, the object is destroyed.
+    kZero,
+};
+
+enum class Handle : uint8_t {
+    kShared,
+    kWeak,
+    kIntrusive,
+};
+
+struct Record {
+    // Nanoseconds of the steady clock.
+    uint64_t time = 0;
+
+    // Control block of `SharedPtr` and `WeakPtr`, the object itself for `IntrusivePtr`.
+    const void* address = nullptr;
+
+    // Index of the ring buffer, reused by threads started after the owner exited.
+    uint32_t thread = 0;
+
+    Event event = Event::kCreate;
+    Handle handle = Handle::kShared;
+};
+
+// Events of one thread. The owner overwrites the oldest ones without waiting for readers; each
+// slot is a seqlock, so a reader skips a slot that is being overwritten instead of reading it
+// torn.
+class Ring {
+public:
+    static constexpr size_t kCapacity = size_t{1} << 13;
+
+    explicit Ring(uint32_t thread) : thread_(thread) {
+    }
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    // Owner thread only.
+    void Push(const Record& record) {
+        uint64_t index = head_.load(std::memory_order_relaxed);
+        Slot& slot = slots_[index % kCapacity];
+        // Release on the fields orders the odd sequence before them: a reader that sees any new
+        // field sees the slot as being written when it checks the sequence again.
+        slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+        slot.time.store(record.time, std::memory_order_release);
+        slot.address.store(record.address, std::memory_order_release);
+        slot.kind.store(static_cast<uint16_t>(record.event) << 8 |
+                            static_cast<uint16_t>(record.handle),
+                        std::memory_order_release);
+        slot.sequence.store(2 * index + 2, std::memory_order_release);
+        head_.store(index + 1, std::memory_order_release);
+    }
+
+    // Appends the retained events recorded at `since` or later.
+    void Read(uint64_t since, std::vector<Record>* records) const {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t begin = head > kCapacity ? head - kCapacity : 0;
+        for (uint64_t index = begin; index < head; ++index) {
+            const Slot& slot = slots_[index % kCapacity];
+            uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+            Record record;
+            record.time = slot.time.load(std::memory_order_acquire);
+            record.address = slot.address.load(std::memory_order_acquire);
+            uint16_t kind = slot.kind.load(std::memory_order_acquire);
+            if (sequence != 2 * index + 2 ||
+                slot.sequence.load(std::memory_order_relaxed) != sequence) {
+                continue;
+            }
+            if (record.time >= since) {
+                record.thread = thread_;
+                record.event = static_cast<Event>(kind >> 8);
+                record.handle = static_cast<Handle>(kind & 0xff);
+                records->push_back(record);
+            }
+        }
+    }
+
+    // Taken by a thread for its lifetime.
+    std::atomic<bool> owned = true;
+
+    Ring* next = nullptr;
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence = 0;
+        std::atomic<uint64_t> time = 0;
+        std::atomic<const void*> address = nullptr;
+        std::atomic<uint16_t> kind = 0;
+    };
+
+    const uint32_t thread_;
+    std::array<Slot, kCapacity> slots_;
+    std::atomic<uint64_t> head_ = 0;
+};
+
+// Rings are never freed: a thread that exits leaves its events for the dumper and its ring to
+// the next thread.
+inline std::atomic<Ring*> rings = nullptr;
+inline std::atomic<uint32_t> ring_count = 0;
+inline std::atomic<uint64_t> cleared_at = 0;
+
+inline thread_local Ring* local_ring = nullptr;
+inline thread_local bool local_ring_released = false;
+
+inline uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+inline Ring* AcquireRing() {
+    for (Ring* ring = rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next) {
+        bool owned = false;
+        if (!ring->owned.load(std::memory_order_relaxed) &&
+            ring->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+            return ring;
+        }
+    }
+    auto* ring = new Ring(ring_count.fetch_add(1, std::memory_order_relaxed));
+    Ring* head = rings.load(std::memory_order_relaxed);
+    do {
+        ring->next = head;
+    } while (!rings.compare_exchange_weak(head, ring, std::memory_order_release,
+                                          std::memory_order_relaxed));
+    return ring;
+}
+
+// Returns nullptr while the thread is exiting: its late events are dropped.
+inline Ring* LocalRing() {
+    struct Registration {
+        Registration() {
+            local_ring = AcquireRing();
+        }
+
+        ~Registration() {
+            local_ring->owned.store(false, std::memory_order_release);
+            local_ring = nullptr;
+            local_ring_released = true;
+        }
+    };
+
+    if (local_ring == nullptr && !local_ring_released) {
+        thread_local Registration registration;
+    }
+    return local_ring;
+}
+
+inline void Emit(Event event, Handle handle, const void* address) {
+    if (address == nullptr) {
+        return;
+    }
+    if (Ring* ring = LocalRing()) {
+        ring->Push({Now(), address, 0, event, handle});
+    }
+}
+
+// Later snapshots skip the events recorded so far.
+inline void Clear() {
+    cleared_at.store(Now(), std::memory_order_relaxed);
+}
+
+// Retained events of all threads, oldest first.
+inline std::vector<Record> Snapshot() {
+    std::vector<Record> records;
+    uint64_t since = cleared_at.load(std::memory_order_relaxed);
+    for (Ring* ring = rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next) {
+        ring->Read(since, &records);
+    }
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record& a, const Record& b) { return a.time < b.time; });
+    return records;
+}
+
+// Events of one object, from its creation to the last handle. An address freed and reused
+// starts a new timeline with the next `kCreate`.
+struct Timeline {
+    const void* address = nullptr;
+    std::vector<Record> events;
+
+    // The strong count reached zero.
+    bool ended = false;
+};
+
+// Timelines ordered by their first event. Objects created before the retained events start
+// with whatever is left of them.
+inline std::vector<Timeline> Timelines(const std::vector<Record>& records) {
+    std::vector<Timeline> timelines;
+    std::unordered_map<const void*, size_t> open;
+    for (const Record& record : records) {
+        auto it = open.find(record.address);
+        if (it == open.end() || record.event == Event::kCreate) {
+            it = open.insert_or_assign(record.address, timelines.size()).first;
+            timelines.push_back({record.address, {}, false});
+        }
+        Timeline& timeline = timelines[it->second];
+        timeline.events.push_back(record);
+        if (record.event == Event::kZero) {
+            timeline.ended = true;
+        }
+    }
+    return timelines;
+}
+
+inline const char* EventName(Event event) {
+    switch (event) {
+        case Event::kCreate:
+            return "create";
+        case Event::kCopy:
+            return "copy";
+        case Event::kMove:
+            return "move";
+        case Event::kDestroy:
+            return "destroy";
+        case Event::kLockFail:
+            return "lock-fail";
+        case Event::kZero:
+            return "zero";
+    }
+    return "?";
+}
+
+inline const char* HandleName(Handle handle) {
+    switch (handle) {
+        case Handle::kShared:
+            return "shared";
+        case Handle::kWeak:
+            return "weak";
+        case Handle::kIntrusive:
+            return "intrusive";
+    }
+    return "?";
+}
+
+// One block per object, events with the time since its first one:
+//
+//     0x5581c8a2e2c0 ended
+//         +0.000 us  thread 0  shared create
+//         +1.250 us  thread 1  shared copy
+inline void Dump(const std::vector<Timeline>& timelines, std::ostream& out) {
+    for (const Timeline& timeline : timelines) {
+        out << timeline.address << (timeline.ended ? " ended" : " alive") << '\n';
+        uint64_t start = timeline.events.front().time;
+        for (const Record& record : timeline.events) {
+            char line[96];
+            std::snprintf(line, sizeof(line), "    +%.3f us  thread %u  %s %s\n",
+                          static_cast<double>(record.time - start) / 1000, record.thread,
+                          HandleName(record.handle), EventName(record.event));
+            out << line;
+        }
+    }
+}
+
+inline void Dump(std::ostream& out) {
+    Dump(Timelines(Snapshot()), out);
+}
+
+}  // namespace ptr_trace
+
+#endif
@@ -4,6 +4,8 @@
 
 #include <cstddef>  // std::nullptr_t
 #include <algorithm>
+#include <memory>
+#include <type_traits>
 
 // https://en.cppreference.com/w/cpp/memory/shared_ptr
 template <typename T>
@@ -18,22 +20,28 @@ public:
     SharedPtr(std::nullptr_t) {
     }
 
-    explicit SharedPtr(T* ptr) : ptr_(ptr), ctrl_(new ControlBlockPointer<T>(ptr)) {
+    SMART_PTRS_REGISTERING explicit SharedPtr(T* ptr)
+        : ptr_(ptr), ctrl_(new ControlBlockPointer<T>(ptr)) {
+        SMART_PTRS_TRACE_EVENT(kCreate, kShared, ctrl_);
+        SMART_PTRS_REGISTER(T, ctrl_, ptr);
         if constexpr (std::is_convertible_v<T*, EnableSharedFromThisBase*>) {
             ptr_->SetWeakThis(WeakPtr<T>(*this));
         }
     }
 
     template <typename U, std::enable_if_t<std::is_convertible_v<U, T>, bool> = true>
-    explicit SharedPtr(U* ptr)
+    SMART_PTRS_REGISTERING explicit SharedPtr(U* ptr)
         : ptr_(dynamic_cast<T*>(ptr)), ctrl_(new ControlBlockPointer<U>(ptr)) {
+        SMART_PTRS_TRACE_EVENT(kCreate, kShared, ctrl_);
+        SMART_PTRS_REGISTER(U, ctrl_, ptr);
         if constexpr (std::is_convertible_v<T*, EnableSharedFromThisBase*>) {
             ptr_->SetWeakThis(WeakPtr<T>(*this));
         }
     }
 
     SharedPtr(const SharedPtr<T>& other) : ptr_(other.ptr_), ctrl_(other.ctrl_) {
-        if (other) {
+        if (ctrl_ != nullptr) {
+            SMART_PTRS_TRACE_EVENT(kCopy, kShared, ctrl_);
             ctrl_->IncreaseSharedCounter();
         }
     }
@@ -41,24 +49,20 @@ public:
     template <typename U, std::enable_if_t<std::is_convertible_v<U, T>, bool> = true>
     SharedPtr(const SharedPtr<U>& other) : ptr_(other.Get()), ctrl_(other.GetControl()) {
         if (ctrl_ != nullptr) {
+            SMART_PTRS_TRACE_EVENT(kCopy, kShared, ctrl_);
             ctrl_->IncreaseSharedCounter();
         }
     }
 
-    SharedPtr(SharedPtr&& other) : ptr_(other.ptr_) {
-        ctrl_ = other.ctrl_;
-        if (ctrl_ != nullptr) {
-            ctrl_->IncreaseSharedCounter();
-        }
-        other.Reset();
+    SharedPtr(SharedPtr&& other) : ptr_(other.ptr_), ctrl_(other.ctrl_) {
+        SMART_PTRS_TRACE_EVENT(kMove, kShared, ctrl_);
+        other.Release();
     }
 
     template <typename U, std::enable_if_t<std::is_convertible_v<U, T>, bool> = true>
     SharedPtr(SharedPtr<U>&& other) : ptr_(other.Get()), ctrl_(other.GetControl()) {
-        if (ctrl_ != nullptr) {
-            ctrl_->IncreaseSharedCounter();
-        }
-        other.Reset();
+        SMART_PTRS_TRACE_EVENT(kMove, kShared, ctrl_);
+        other.Release();
     }
 
     // Aliasing constructor
@@ -69,60 +73,33 @@ public:
             if constexpr (std::is_convertible_v<T*, EnableSharedFromThisBase*>) {
                 ptr_->SetWeakThis(WeakPtr<T>(*this));
             }
+            SMART_PTRS_TRACE_EVENT(kCopy, kShared, ctrl_);
             ctrl_->IncreaseSharedCounter();
         }
     }
 
     // Promote `WeakPtr`
     // #11 from https://en.cppreference.com/w/cpp/memory/shared_ptr/shared_ptr
-    explicit SharedPtr(const WeakPtr<T>& other) : ctrl_(other.ctrl_) {
-        if (!other.Expired()) {
-            ptr_ = other.ptr_;
-            if (ctrl_ != nullptr) {
-                ctrl_->IncreaseSharedCounter();
-            }
-        } else {
+    explicit SharedPtr(const WeakPtr<T>& other) {
+        if (other.ctrl_ == nullptr || !other.ctrl_->TryIncreaseSharedCounter()) {
+            SMART_PTRS_TRACE_EVENT(kLockFail, kWeak, other.ctrl_);
             throw BadWeakPtr();
         }
+        ptr_ = other.ptr_;
+        ctrl_ = other.ctrl_;
+        SMART_PTRS_TRACE_EVENT(kCopy, kShared, ctrl_);
     }
 
     ////////////////////////////////////////////////////////////////////////////////////////////////
     // `operator=`-s
 
     SharedPtr& operator=(const SharedPtr& other) {
-        if (this != &other && other) {
-            ControlBlock* old_ctrl = ctrl_;
-            if (ctrl_ != nullptr) {
-                ctrl_->DecreaseSharedCounter();
-            }
-            ptr_ = other.ptr_;
-            ctrl_ = other.ctrl_;
-            if (ctrl_ != nullptr) {
-                ctrl_->IncreaseSharedCounter();
-            }
-            if (old_ctrl != nullptr && old_ctrl->GetSharedCounter() == 0 &&
-                old_ctrl->GetWeakCounter() == 0) {
-                delete old_ctrl;
-            }
-        }
+        SharedPtr(other).Swap(*this);
         return *this;
     }
 
     SharedPtr& operator=(SharedPtr&& other) {
-        if (this != &other && other) {
-            ControlBlock* old_ctrl = ctrl_;
-            if (ctrl_ != nullptr) {
-                ctrl_->DecreaseSharedCounter();
-            }
-            ptr_ = other.ptr_;
-            ctrl_ = other.ctrl_;
-            if (old_ctrl != nullptr && old_ctrl->GetSharedCounter() == 0 &&
-                old_ctrl->GetWeakCounter() == 0) {
-                delete old_ctrl;
-            }
-            other.ptr_ = nullptr;
-            other.ctrl_ = nullptr;
-        }
+        SharedPtr(std::move(other)).Swap(*this);
         return *this;
     }
 
@@ -143,16 +120,12 @@ public:
     }
 
     void Reset(T* ptr) {
-        DeleteControl();
-        ptr_ = ptr;
-        ctrl_ = new ControlBlockPointer(ptr);
+        SharedPtr(ptr).Swap(*this);
     }
 
     template <typename U, std::enable_if_t<std::is_convertible_v<U, T>, bool> = true>
     void Reset(U* ptr) {
-        DeleteControl();
-        ptr_ = ptr;
-        ctrl_ = new ControlBlockPointer<U>(ptr);
+        SharedPtr(ptr).Swap(*this);
     }
 
     void Swap(SharedPtr& other) {
@@ -200,22 +173,26 @@ private:
         ctrl_ = nullptr;
     }
 
-    template <typename... Args>
-    SharedPtr(bool, Args&&... args)
-        : ctrl_(new ControlBlockObject<T>(std::forward<Args>(args)...)) {
-        ptr_ = reinterpret_cast<T*>(&dynamic_cast<ControlBlockObject<T>*>(ctrl_)->obj_);
+    // Takes over a strong reference already counted in `ctrl`.
+    SharedPtr(T* ptr, ControlBlock* ctrl) : ptr_(ptr), ctrl_(ctrl) {
+    }
+
+    explicit SharedPtr(ControlBlockObject<T>* block) : ptr_(block->GetObject()), ctrl_(block) {
+        SMART_PTRS_TRACE_EVENT(kCreate, kShared, ctrl_);
         if constexpr (std::is_convertible_v<T*, EnableSharedFromThisBase*>) {
             ptr_->SetWeakThis(WeakPtr(*this));
         }
     }
 
     void DeleteControl() {
-        if (ctrl_ != nullptr) {
+        if (ctrl_ == nullptr) {
+            return;
+        }
+        SMART_PTRS_TRACE_EVENT(kDestroy, kShared, ctrl_);
+        if (current_deferred_release != nullptr) {
+            current_deferred_release->Defer(ctrl_);
+        } else {
             ctrl_->DecreaseSharedCounter();
-            if (ctrl_->GetSharedCounter() == 0 && ctrl_->GetWeakCounter() == 0) {
-                delete ctrl_;
-                ctrl_ = nullptr;
-            }
         }
     }
 
@@ -225,6 +202,21 @@ private:
     template <typename U, typename... Args>
     friend SharedPtr<U> MakeShared(Args&&... args);
 
+    template <typename U, typename... Args>
+    friend SharedPtr<U> MakeBiasedShared(Args&&... args);
+
+    template <typename U>
+    friend SharedPtr<U> AdoptShared(U* ptr, ControlBlock* block);
+
+    template <typename U>
+    friend ControlBlock* DetachShared(SharedPtr<U>& ptr);
+
+    template <typename U>
+    friend SharedPtr<U> PromoteShared(U* ptr, ControlBlock* block);
+
+    template <typename Y>
+    friend class SharedPtr;
+
     friend WeakPtr<T>;
 };
 
@@ -235,8 +227,60 @@ inline bool operator==(const SharedPtr<T>& left, const SharedPtr<U>& right) {
 
 // Allocate memory only once
 template <typename T, typename... Args>
-SharedPtr<T> MakeShared(Args&&... args) {
-    return SharedPtr<T>(true, std::forward<Args>(args)...);
+SMART_PTRS_REGISTERING SharedPtr<T> MakeShared(Args&&... args) {
+    SharedPtr<T> result(new ControlBlockObject<T>(std::forward<Args>(args)...));
+    SMART_PTRS_REGISTER(T, result.ctrl_, result.ptr_);
+    return result;
+}
+
+// Extension point for control blocks with their own destruction policy: wraps a block created
+// elsewhere, taking over its initial strong reference.
+template <typename T>
+SMART_PTRS_REGISTERING SharedPtr<T> AdoptShared(T* ptr, ControlBlock* block) {
+    SharedPtr<T> result(ptr, block);
+    SMART_PTRS_TRACE_EVENT(kCreate, kShared, block);
+    SMART_PTRS_REGISTER(T, block, ptr);
+    if constexpr (std::is_convertible_v<T*, EnableSharedFromThisBase*>) {
+        ptr->SetWeakThis(WeakPtr<T>(result));
+    }
+    return result;
+}
+
+// Extension points for code that keeps references by their control blocks, like hazard pointer
+// slots. `DetachShared` empties `ptr` and hands its strong reference over to the caller, who
+// drops it with `DecreaseSharedCounter` eventually.
+template <typename T>
+ControlBlock* DetachShared(SharedPtr<T>& ptr) {
+    ControlBlock* block = ptr.ctrl_;
+    ptr.Release();
+    return block;
+}
+
+// Takes a new strong reference through a block that cannot be freed meanwhile, but whose object
+// may already be destroyed: returns an empty pointer then.
+template <typename T>
+SharedPtr<T> PromoteShared(T* ptr, ControlBlock* block) {
+    if (block == nullptr || !block->TryIncreaseSharedCounter()) {
+        return SharedPtr<T>();
+    }
+    SMART_PTRS_TRACE_EVENT(kCopy, kShared, block);
+    return SharedPtr<T>(ptr, block);
+}
+
+// Biases the reference count towards the calling thread: its copies and drops are a plain load
+// and store, other threads pay an atomic operation. Meant for objects mostly used by the thread
+// that created them but occasionally handed to others. The first release by another thread that
+// could be the last reference costs a process-wide barrier, after which the count is an ordinary
+// atomic one. The object dies with its last reference, whichever thread drops it.
+template <typename T, typename... Args>
+SMART_PTRS_REGISTERING SharedPtr<T> MakeBiasedShared(Args&&... args) {
+    BiasedOwner* owner = BiasedOwner::Current();
+    if (owner == nullptr) {
+        return MakeShared<T>(std::forward<Args>(args)...);
+    }
+    SharedPtr<T> result(new BiasedControlBlockObject<T>(owner, std::forward<Args>(args)...));
+    SMART_PTRS_REGISTER(T, result.ctrl_, result.ptr_);
+    return result;
 }
 
 // Look for usage examples in tests
@@ -267,3 +311,615 @@ public:
 private:
     WeakPtr<T> weak_this_;
 };
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Policy-based pointers
+
+// How a block destroys its object.
+enum class DeleterStorage {
+    // A pointer to a function of the block: handles convert to handles of bases, and raw pointers
+    // with custom deleters can be adopted.
+    kErased,
+    // Nothing: the handle's type is the object's exact type, so objects only come from
+    // `MakeBasicShared` and handles do not convert.
+    kNone,
+};
+
+// `Allocator` is rebound to the block type; an empty one takes no room in the block.
+template <bool Atomic, bool Weak, typename Allocator = std::allocator<std::byte>,
+          DeleterStorage Deleter = DeleterStorage::kErased>
+struct SharedPolicy {
+    static constexpr bool kAtomic = Atomic;
+    static constexpr bool kWeak = Weak;
+    using AllocatorType = Allocator;
+    static constexpr DeleterStorage kDeleter = Deleter;
+};
+
+// The behavior of `SharedPtr`, which adds biased counting, deferred release and the debugging
+// hooks on top.
+using DefaultSharedPolicy = SharedPolicy<true, true>;
+
+template <typename T, typename Policy>
+class PolicySharedPtr;
+
+template <typename T, typename Policy>
+class PolicyWeakPtr;
+
+namespace shared_policy {
+
+// Distinct for each unused field: empty members of the same type may not share an address.
+template <int Field>
+struct Empty {
+    constexpr Empty() = default;
+
+    constexpr explicit Empty(int) {
+    }
+};
+
+template <typename Policy>
+using Counter = std::conditional_t<Policy::kAtomic, std::atomic<int>, int>;
+
+// Counts and, with `kErased`, the function destroying the object and freeing the block. Fields a
+// policy does not use are empty and take no room.
+template <typename Policy>
+class BlockHeader {
+public:
+    enum class Operation {
+        kDestroyObject,
+        kDeallocate,
+    };
+
+    using Manage = void (*)(BlockHeader*, Operation);
+
+    BlockHeader(const BlockHeader&) = delete;
+    BlockHeader& operator=(const BlockHeader&) = delete;
+
+    void IncreaseShared() {
+        FetchAdd(shared_, 1);
+    }
+
+    // Fails once the object has been destroyed.
+    bool TryIncreaseShared() {
+        if constexpr (Policy::kAtomic) {
+            int count = shared_.load(std::memory_order_relaxed);
+            while (count != 0) {
+                if (shared_.compare_exchange_weak(count, count + 1, std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        } else {
+            if (shared_ == 0) {
+                return false;
+            }
+            ++shared_;
+            return true;
+        }
+    }
+
+    // True for the last strong reference: the caller destroys the object and drops the weak
+    // reference the strong ones share, or frees the block if there are no weak ones.
+    bool DecreaseShared() {
+        return FetchSub(shared_, 1) == 1;
+    }
+
+    void IncreaseWeak() {
+        FetchAdd(weak_, 1);
+    }
+
+    // True for the last weak reference: the caller frees the block.
+    bool DecreaseWeak() {
+        return FetchSub(weak_, 1) == 1;
+    }
+
+    int GetShared() const {
+        return Load(shared_);
+    }
+
+    // Includes the reference owned by strong references while the object is alive.
+    int GetWeak() const {
+        return Load(weak_);
+    }
+
+    void Run(Operation operation) {
+        manage_(this, operation);
+    }
+
+protected:
+    explicit BlockHeader(Manage manage) {
+        if constexpr (Policy::kDeleter == DeleterStorage::kErased) {
+            manage_ = manage;
+        }
+    }
+
+    ~BlockHeader() = default;
+
+private:
+    static int FetchAdd(Counter<Policy>& counter, int delta) {
+        if constexpr (Policy::kAtomic) {
+            return counter.fetch_add(delta, std::memory_order_relaxed);
+        } else {
+            return std::exchange(counter, counter + delta);
+        }
+    }
+
+    static int FetchSub(Counter<Policy>& counter, int delta) {
+        if constexpr (Policy::kAtomic) {
+            return counter.fetch_sub(delta, std::memory_order_acq_rel);
+        } else {
+            return std::exchange(counter, counter - delta);
+        }
+    }
+
+    static int Load(const Counter<Policy>& counter) {
+        if constexpr (Policy::kAtomic) {
+            return counter.load(std::memory_order_acquire);
+        } else {
+            return counter;
+        }
+    }
+
+    Counter<Policy> shared_ = 1;
+    [[no_unique_address]] std::conditional_t<Policy::kWeak, Counter<Policy>, Empty<0>> weak_{1};
+    [[no_unique_address]] std::conditional_t<Policy::kDeleter == DeleterStorage::kErased, Manage,
+                                             Empty<1>> manage_{};
+};
+
+template <typename Block, typename Policy>
+using BlockAllocator = typename std::allocator_traits<
+    typename Policy::AllocatorType>::template rebind_alloc<Block>;
+
+// Frees a block through a copy of the allocator stored in it.
+template <typename Block, typename Policy>
+void Deallocate(Block* block) {
+    BlockAllocator<Block, Policy> allocator(std::move(block->allocator_));
+    std::destroy_at(block);
+    std::allocator_traits<BlockAllocator<Block, Policy>>::deallocate(allocator, block, 1);
+}
+
+// Allocates a block and constructs it with the allocator it came from.
+template <typename Block, typename Policy, typename... Args>
+Block* Allocate(const typename Policy::AllocatorType& source, Args&&... args) {
+    BlockAllocator<Block, Policy> allocator(source);
+    Block* block = std::allocator_traits<BlockAllocator<Block, Policy>>::allocate(allocator, 1);
+    try {
+        return new (block) Block(allocator, std::forward<Args>(args)...);
+    } catch (...) {
+        std::allocator_traits<BlockAllocator<Block, Policy>>::deallocate(allocator, block, 1);
+        throw;
+    }
+}
+
+// The block of `MakeBasicShared`: the header, the allocator if it has state, the object.
+template <typename T, typename Policy>
+class ObjectBlock : public BlockHeader<Policy> {
+public:
+    using Header = BlockHeader<Policy>;
+
+    template <typename... Args>
+    explicit ObjectBlock(const BlockAllocator<ObjectBlock, Policy>& allocator, Args&&... args)
+        : Header(&ManageBlock), allocator_(allocator) {
+        new (&object_) T(std::forward<Args>(args)...);
+    }
+
+    ~ObjectBlock() {
+    }
+
+    T* GetObject() {
+        return &object_;
+    }
+
+    void DestroyObject() {
+        std::destroy_at(&object_);
+    }
+
+    static void ManageBlock(Header* header, typename Header::Operation operation) {
+        auto* block = static_cast<ObjectBlock*>(header);
+        if (operation == Header::Operation::kDestroyObject) {
+            block->DestroyObject();
+        } else {
+            Deallocate<ObjectBlock, Policy>(block);
+        }
+    }
+
+    [[no_unique_address]] BlockAllocator<ObjectBlock, Policy> allocator_;
+
+private:
+    union {
+        T object_;
+    };
+};
+
+// The block of an adopted raw pointer, `kErased` policies only.
+template <typename T, typename Deleter, typename Policy>
+class PointerBlock : public BlockHeader<Policy> {
+public:
+    using Header = BlockHeader<Policy>;
+
+    PointerBlock(const BlockAllocator<PointerBlock, Policy>& allocator, T* ptr, Deleter deleter)
+        : Header(&ManageBlock), allocator_(allocator), ptr_(ptr), deleter_(std::move(deleter)) {
+    }
+
+    static void ManageBlock(Header* header, typename Header::Operation operation) {
+        auto* block = static_cast<PointerBlock*>(header);
+        if (operation == Header::Operation::kDestroyObject) {
+            block->deleter_(block->ptr_);
+        } else {
+            Deallocate<PointerBlock, Policy>(block);
+        }
+    }
+
+    [[no_unique_address]] BlockAllocator<PointerBlock, Policy> allocator_;
+
+private:
+    T* ptr_;
+    [[no_unique_address]] Deleter deleter_;
+};
+
+// Destroys the object of a block whose last strong reference has gone, or frees the block: for
+// `kNone` the handle's type is the block's.
+template <typename T, typename Policy>
+void Run(BlockHeader<Policy>* block, typename BlockHeader<Policy>::Operation operation) {
+    if constexpr (Policy::kDeleter == DeleterStorage::kErased) {
+        block->Run(operation);
+    } else {
+        ObjectBlock<T, Policy>::ManageBlock(block, operation);
+    }
+}
+
+template <typename T, typename Policy>
+void ReleaseShared(BlockHeader<Policy>* block) {
+    using Operation = typename BlockHeader<Policy>::Operation;
+    if (!block->DecreaseShared()) {
+        return;
+    }
+    Run<T, Policy>(block, Operation::kDestroyObject);
+    if constexpr (Policy::kWeak) {
+        if (!block->DecreaseWeak()) {
+            return;
+        }
+    }
+    Run<T, Policy>(block, Operation::kDeallocate);
+}
+
+}  // namespace shared_policy
+
+// `SharedPtr` with the counting, weak references, allocator and deleter storage chosen by
+// `Policy`. Policies without weak references have no weak counter in the block, `kNone` ones no
+// function pointer either.
+template <typename T, typename Policy>
+class PolicySharedPtr {
+public:
+    using Header = shared_policy::BlockHeader<Policy>;
+
+    static constexpr bool kConverts = Policy::kDeleter == DeleterStorage::kErased;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    PolicySharedPtr() {
+    }
+
+    PolicySharedPtr(std::nullptr_t) {
+    }
+
+    // Deletes `ptr` if allocating the block fails.
+    template <typename Deleter = std::default_delete<T>>
+        requires kConverts
+    explicit PolicySharedPtr(T* ptr, Deleter deleter = Deleter(),
+                             const typename Policy::AllocatorType& allocator = {})
+        : ptr_(ptr) {
+        using Block = shared_policy::PointerBlock<T, Deleter, Policy>;
+        try {
+            block_ = shared_policy::Allocate<Block, Policy>(allocator, ptr, deleter);
+        } catch (...) {
+            deleter(ptr);
+            throw;
+        }
+    }
+
+    PolicySharedPtr(const PolicySharedPtr& other) : ptr_(other.ptr_), block_(other.block_) {
+        if (block_ != nullptr) {
+            block_->IncreaseShared();
+        }
+    }
+
+    template <typename U>
+        requires kConverts && std::is_convertible_v<U*, T*>
+    PolicySharedPtr(const PolicySharedPtr<U, Policy>& other)
+        : ptr_(other.ptr_), block_(other.block_) {
+        if (block_ != nullptr) {
+            block_->IncreaseShared();
+        }
+    }
+
+    PolicySharedPtr(PolicySharedPtr&& other)
+        : ptr_(std::exchange(other.ptr_, {})), block_(std::exchange(other.block_, nullptr)) {
+    }
+
+    template <typename U>
+        requires kConverts && std::is_convertible_v<U*, T*>
+    PolicySharedPtr(PolicySharedPtr<U, Policy>&& other)
+        : ptr_(std::exchange(other.ptr_, {})), block_(std::exchange(other.block_, nullptr)) {
+    }
+
+    // Promote `PolicyWeakPtr`
+    explicit PolicySharedPtr(const PolicyWeakPtr<T, Policy>& other)
+        requires Policy::kWeak
+    {
+        if (other.block_ == nullptr || !other.block_->TryIncreaseShared()) {
+            throw BadWeakPtr();
+        }
+        PolicySharedPtr(other.ptr_, other.block_).Swap(*this);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    PolicySharedPtr& operator=(const PolicySharedPtr& other) {
+        PolicySharedPtr(other).Swap(*this);
+        return *this;
+    }
+
+    PolicySharedPtr& operator=(PolicySharedPtr&& other) {
+        PolicySharedPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~PolicySharedPtr() {
+        Reset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        if (block_ != nullptr) {
+            shared_policy::ReleaseShared<T, Policy>(block_);
+        }
+        ptr_ = {};
+        block_ = nullptr;
+    }
+
+    void Swap(PolicySharedPtr& other) {
+        std::swap(ptr_, other.ptr_);
+        std::swap(block_, other.block_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    T* Get() const {
+        if constexpr (kConverts) {
+            return ptr_;
+        } else {
+            return block_ == nullptr ? nullptr : Object();
+        }
+    }
+
+    T& operator*() const {
+        return *operator->();
+    }
+
+    T* operator->() const {
+        if constexpr (kConverts) {
+            return ptr_;
+        } else {
+            return Object();
+        }
+    }
+
+    size_t UseCount() const {
+        return block_ == nullptr ? 0 : block_->GetShared();
+    }
+
+    Header* GetControl() const {
+        return block_;
+    }
+
+    explicit operator bool() const {
+        return Get() != nullptr;
+    }
+
+private:
+    using Block = shared_policy::ObjectBlock<T, Policy>;
+
+    // Takes over a strong reference already counted in `block`.
+    PolicySharedPtr(T* ptr, Header* block) : block_(block) {
+        if constexpr (kConverts) {
+            ptr_ = ptr;
+        }
+    }
+
+    // Without a deleter the block is always an `ObjectBlock` of `T`.
+    T* Object() const {
+        return static_cast<Block*>(block_)->GetObject();
+    }
+
+    // Only kept with a deleter: the object may then be outside the block, or a base of it.
+    [[no_unique_address]] std::conditional_t<kConverts, T*, shared_policy::Empty<2>> ptr_{};
+    Header* block_ = nullptr;
+
+    template <typename U, typename P>
+    friend class PolicySharedPtr;
+
+    friend PolicyWeakPtr<T, Policy>;
+
+    template <typename U, typename P, typename... Args>
+    friend PolicySharedPtr<U, P> AllocatePolicyShared(const typename P::AllocatorType& allocator,
+                                                      Args&&... args);
+};
+
+template <typename T, typename U, typename Policy>
+inline bool operator==(const PolicySharedPtr<T, Policy>& left,
+                       const PolicySharedPtr<U, Policy>& right) {
+    return left.GetControl() == right.GetControl();
+}
+
+// https://en.cppreference.com/w/cpp/memory/weak_ptr, for policies with `kWeak`.
+template <typename T, typename Policy>
+class PolicyWeakPtr {
+    static_assert(Policy::kWeak, "the policy has no weak references");
+
+public:
+    using Header = shared_policy::BlockHeader<Policy>;
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Constructors
+
+    PolicyWeakPtr() {
+    }
+
+    PolicyWeakPtr(const PolicyWeakPtr& other) : ptr_(other.ptr_), block_(other.block_) {
+        if (block_ != nullptr) {
+            block_->IncreaseWeak();
+        }
+    }
+
+    PolicyWeakPtr(PolicyWeakPtr&& other)
+        : ptr_(std::exchange(other.ptr_, nullptr)), block_(std::exchange(other.block_, nullptr)) {
+    }
+
+    PolicyWeakPtr(const PolicySharedPtr<T, Policy>& other)
+        : ptr_(other.Get()), block_(other.block_) {
+        if (block_ != nullptr) {
+            block_->IncreaseWeak();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // `operator=`-s
+
+    PolicyWeakPtr& operator=(const PolicyWeakPtr& other) {
+        PolicyWeakPtr(other).Swap(*this);
+        return *this;
+    }
+
+    PolicyWeakPtr& operator=(PolicyWeakPtr&& other) {
+        PolicyWeakPtr(std::move(other)).Swap(*this);
+        return *this;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Destructor
+
+    ~PolicyWeakPtr() {
+        Reset();
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Modifiers
+
+    void Reset() {
+        if (block_ != nullptr && block_->DecreaseWeak()) {
+            shared_policy::Run<T, Policy>(block_, Header::Operation::kDeallocate);
+        }
+        ptr_ = nullptr;
+        block_ = nullptr;
+    }
+
+    void Swap(PolicyWeakPtr& other) {
+        std::swap(ptr_, other.ptr_);
+        std::swap(block_, other.block_);
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////////////////////
+    // Observers
+
+    size_t UseCount() const {
+        return block_ == nullptr ? 0 : block_->GetShared();
+    }
+
+    bool Expired() const {
+        return UseCount() == 0;
+    }
+
+    PolicySharedPtr<T, Policy> Lock() const {
+        if (block_ == nullptr || !block_->TryIncreaseShared()) {
+            return {};
+        }
+        return PolicySharedPtr<T, Policy>(ptr_, block_);
+    }
+
+private:
+    T* ptr_ = nullptr;
+    Header* block_ = nullptr;
+
+    friend PolicySharedPtr<T, Policy>;
+};
+
+namespace shared_policy {
+
+template <typename T, typename Policy>
+struct Select {
+    using Shared = PolicySharedPtr<T, Policy>;
+    using Weak = PolicyWeakPtr<T, Policy>;
+};
+
+template <typename T>
+struct Select<T, DefaultSharedPolicy> {
+    using Shared = SharedPtr<T>;
+    using Weak = WeakPtr<T>;
+};
+
+}  // namespace shared_policy
+
+// `BasicSharedPtr<T, DefaultSharedPolicy>` is `SharedPtr<T>` itself, other policies get a
+// `PolicySharedPtr`.
+template <typename T, typename Policy = DefaultSharedPolicy>
+using BasicSharedPtr = typename shared_policy::Select<T, Policy>::Shared;
+
+template <typename T, typename Policy = DefaultSharedPolicy>
+using BasicWeakPtr = typename shared_policy::Select<T, Policy>::Weak;
+
+// Like `MakeShared`: one allocation for the block and the object, from `allocator`.
+template <typename T, typename Policy, typename... Args>
+PolicySharedPtr<T, Policy> AllocatePolicyShared(const typename Policy::AllocatorType& allocator,
+                                                Args&&... args) {
+    using Block = shared_policy::ObjectBlock<T, Policy>;
+    Block* block = shared_policy::Allocate<Block, Policy>(allocator, std::forward<Args>(args)...);
+    // As a header: the raw pointer constructor would take the block for a deleter.
+    typename Block::Header* header = block;
+    return PolicySharedPtr<T, Policy>(block->GetObject(), header);
+}
+
+template <typename T, typename Policy = DefaultSharedPolicy, typename... Args>
+BasicSharedPtr<T, Policy> MakeBasicShared(Args&&... args) {
+    if constexpr (std::is_same_v<Policy, DefaultSharedPolicy>) {
+        return MakeShared<T>(std::forward<Args>(args)...);
+    } else {
+        return AllocatePolicyShared<T, Policy>({}, std::forward<Args>(args)...);
+    }
+}
+
+// Bytes of the block `MakeBasicShared<T, Policy>` allocates.
+template <typename T, typename Policy>
+constexpr size_t BasicSharedBlockSize() {
+    if constexpr (std::is_same_v<Policy, DefaultSharedPolicy>) {
+        return sizeof(ControlBlockObject<T>);
+    } else {
+        return sizeof(shared_policy::ObjectBlock<T, Policy>);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Strong-only pointers
+
+// For objects that never have weak references: the block is one 4-byte counter followed by the
+// object, the pointer is the address of the block, and dropping a reference is one atomic
+// decrement whose result alone decides whether to destroy and free. As compact as `IntrusivePtr`
+// without touching the type, at the price of `MakeStrongOnlyShared` being the only way to
+// create objects and of no conversions between pointers to different types.
+using StrongOnlySharedPolicy =
+    SharedPolicy<true, false, std::allocator<std::byte>, DeleterStorage::kNone>;
+
+template <typename T>
+using StrongOnlySharedPtr = PolicySharedPtr<T, StrongOnlySharedPolicy>;
+
+template <typename T, typename... Args>
+StrongOnlySharedPtr<T> MakeStrongOnlyShared(Args&&... args) {
+    return MakeBasicShared<T, StrongOnlySharedPolicy>(std::forward<Args>(args)...);
+}
@@ -0,0 +1,125 @@
+#include "shared.h"
+#include "weak.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Tracked {
+    static std::atomic<int> alive;
+
+    explicit Tracked(int value) : value(value) {
+        alive.fetch_add(1);
+    }
+
+    ~Tracked() {
+        alive.fetch_sub(1);
+    }
+
+    int value;
+};
+
+std::atomic<int> Tracked::alive = 0;
+
+constexpr int kThreads = 4;
+
+}  // namespace
+
+TEST_CASE("Moves steal the reference") {
+    auto a = MakeShared<Tracked>(1);
+    ControlBlock* block = a.GetControl();
+    SharedPtr<Tracked> b(std::move(a));
+    REQUIRE(!a);
+    REQUIRE(a.GetControl() == nullptr);
+    REQUIRE(b.GetControl() == block);
+    REQUIRE(b.UseCount() == 1);
+
+    SharedPtr<Tracked> c;
+    c = std::move(b);
+    REQUIRE(!b);
+    REQUIRE(c.UseCount() == 1);
+
+    WeakPtr<Tracked> weak = c;
+    WeakPtr<Tracked> moved(std::move(weak));
+    REQUIRE(block->GetWeakCounter() == 2);
+    REQUIRE(moved.Lock() == c);
+}
+
+TEST_CASE("Strong references share one weak reference") {
+    WeakPtr<Tracked> weak;
+    ControlBlock* block;
+    {
+        auto a = MakeShared<Tracked>(2);
+        auto b = a;
+        block = a.GetControl();
+        REQUIRE(block->GetSharedCounter() == 2);
+        REQUIRE(block->GetWeakCounter() == 1);
+
+        weak = a;
+        REQUIRE(block->GetWeakCounter() == 2);
+    }
+    REQUIRE(Tracked::alive == 0);
+    // The block outlives the object while a weak reference is left.
+    REQUIRE(block->GetSharedCounter() == 0);
+    REQUIRE(block->GetWeakCounter() == 1);
+    REQUIRE(weak.Expired());
+    REQUIRE(!weak.Lock());
+}
+
+TEST_CASE("Copies from many threads") {
+    constexpr int kCopies = 100'000;
+    auto shared = MakeShared<Tracked>(3);
+    WeakPtr<Tracked> weak = shared;
+    std::atomic<int> wrong = 0;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back([&shared, &weak, &wrong] {
+            for (int j = 0; j < kCopies; ++j) {
+                SharedPtr<Tracked> copy = shared;
+                WeakPtr<Tracked> weak_copy = copy;
+                SharedPtr<Tracked> locked = weak.Lock();
+                wrong.fetch_add(locked->value != 3, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(shared.UseCount() == 1);
+    REQUIRE(shared.GetControl()->GetWeakCounter() == 2);
+    shared.Reset();
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Lock races the last release") {
+    constexpr int kRounds = 10'000;
+    int locked = 0;
+    for (int i = 0; i < kRounds; ++i) {
+        auto shared = MakeShared<Tracked>(i);
+        WeakPtr<Tracked> weak = shared;
+        std::atomic<bool> go = false;
+        std::thread releaser([&] {
+            while (!go.load()) {
+            }
+            shared.Reset();
+        });
+        go.store(true);
+        if (auto ptr = weak.Lock()) {
+            // Either the object is still alive while it is held, or `Lock` fails.
+            REQUIRE(ptr->value == i);
+            ++locked;
+        }
+        releaser.join();
+        REQUIRE(weak.Expired());
+        REQUIRE(Tracked::alive == 0);
+    }
+    REQUIRE(locked <= kRounds);
+}
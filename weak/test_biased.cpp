@@ -0,0 +1,193 @@
+#include "shared.h"
+#include "weak.h"
+
+#include "catch2/catch_test_macros.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+struct Tracked {
+    static std::atomic<int> alive;
+
+    explicit Tracked(int value) : value(value) {
+        alive.fetch_add(1);
+    }
+
+    ~Tracked() {
+        alive.fetch_sub(1);
+    }
+
+    int value;
+};
+
+std::atomic<int> Tracked::alive = 0;
+
+}  // namespace
+
+TEST_CASE("Biased single thread") {
+    {
+        auto p = MakeBiasedShared<Tracked>(42);
+        REQUIRE(p->value == 42);
+        REQUIRE(p.UseCount() == 1);
+        {
+            auto q = p;
+            REQUIRE(p.UseCount() == 2);
+            WeakPtr<Tracked> weak(q);
+            REQUIRE(weak.Lock()->value == 42);
+        }
+        REQUIRE(p.UseCount() == 1);
+        REQUIRE(Tracked::alive == 1);
+    }
+    REQUIRE(Tracked::alive == 0);
+}
+
+TEST_CASE("Biased handoff") {
+    SECTION("Last reference dropped by another thread") {
+        auto p = MakeBiasedShared<Tracked>(1);
+        WeakPtr<Tracked> weak = p;
+        std::thread([q = std::move(p)]() mutable { q.Reset(); }).join();
+        REQUIRE(Tracked::alive == 0);
+        REQUIRE(weak.Expired());
+        REQUIRE(!weak.Lock());
+    }
+
+    SECTION("Owner copies after another thread took the count over") {
+        auto p = MakeBiasedShared<Tracked>(1);
+        WeakPtr<Tracked> weak = p;
+        auto q = p;
+        std::thread([q = std::move(q)]() mutable { q.Reset(); }).join();
+        REQUIRE(p.UseCount() == 1);
+        auto copy = p;
+        REQUIRE(weak.Lock() == p);
+        REQUIRE(p.UseCount() == 2);
+        copy.Reset();
+        p.Reset();
+        REQUIRE(Tracked::alive == 0);
+        REQUIRE(!weak.Lock());
+    }
+
+    SECTION("Owner drops last") {
+        auto p = MakeBiasedShared<Tracked>(1);
+        std::thread([copy = p]() mutable { copy.Reset(); }).join();
+        REQUIRE(Tracked::alive == 1);
+        p.Reset();
+        REQUIRE(Tracked::alive == 0);
+    }
+
+    SECTION("Owner exits") {
+        SharedPtr<Tracked> p;
+        WeakPtr<Tracked> weak;
+        std::thread([&] {
+            p = MakeBiasedShared<Tracked>(1);
+            weak = p;
+        }).join();
+        REQUIRE(weak.Lock()->value == 1);
+        p.Reset();
+        REQUIRE(Tracked::alive == 0);
+        REQUIRE(weak.Expired());
+    }
+}
+
+// Run under TSan: cmake -DCMAKE_BUILD_TYPE=TSAN
+TEST_CASE("Biased stress") {
+    constexpr int kObjects = 2000;
+    constexpr int kThreads = 4;
+
+    std::mutex mutex;
+    std::vector<SharedPtr<Tracked>> handed;
+    std::vector<WeakPtr<Tracked>> weak;
+    std::atomic<bool> done = false;
+    std::atomic<int> bad_values = 0;
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < kThreads; ++t) {
+        readers.emplace_back([&] {
+            while (true) {
+                SharedPtr<Tracked> p;
+                WeakPtr<Tracked> w;
+                {
+                    std::lock_guard lock(mutex);
+                    if (handed.empty()) {
+                        if (done) {
+                            return;
+                        }
+                    } else {
+                        p = std::move(handed.back());
+                        handed.pop_back();
+                        w = weak[p->value % weak.size()];
+                    }
+                }
+                if (auto locked = w.Lock()) {
+                    auto copy = locked;
+                    if (copy->value < 0 || copy->value >= kObjects) {
+                        bad_values.fetch_add(1);
+                    }
+                }
+                for (int i = 0; i < 10; ++i) {
+                    auto copy = p;
+                }
+            }
+        });
+    }
+
+    std::thread owner([&] {
+        std::vector<SharedPtr<Tracked>> kept;
+        for (int i = 0; i < kObjects; ++i) {
+            auto p = MakeBiasedShared<Tracked>(i);
+            {
+                std::lock_guard lock(mutex);
+                handed.push_back(p);
+                weak.push_back(p);
+            }
+            if (i % 3 == 0) {
+                kept.push_back(p);
+            }
+            for (int j = 0; j < 10; ++j) {
+                auto copy = p;
+            }
+        }
+        kept.clear();
+    });
+    owner.join();
+
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    weak.clear();
+    REQUIRE(bad_values == 0);
+    REQUIRE(Tracked::alive == 0);
+}
+
+// Other threads take the count over while the owner keeps changing it with plain stores.
+TEST_CASE("Biased revocation races the owner") {
+    constexpr int kRounds = 2000;
+    int wrong = 0;
+    for (int i = 0; i < kRounds; ++i) {
+        auto p = MakeBiasedShared<Tracked>(i);
+        WeakPtr<Tracked> weak = p;
+        std::atomic<bool> go = false;
+        std::thread other([&go, &weak, q = p]() mutable {
+            while (!go.load()) {
+            }
+            auto locked = weak.Lock();
+            q.Reset();
+        });
+        go.store(true);
+        for (int j = 0; j < 100; ++j) {
+            auto copy = p;
+            auto locked = weak.Lock();
+        }
+        other.join();
+        wrong += p.UseCount() != 1 || Tracked::alive != 1;
+        p.Reset();
+        wrong += Tracked::alive != 0 || !weak.Expired();
+    }
+    REQUIRE(wrong == 0);
+}
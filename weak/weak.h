@@ -14,6 +14,7 @@ public:
 
     WeakPtr(const WeakPtr& other) : ptr_(other.ptr_), ctrl_(other.ctrl_) {
         if (ctrl_ != nullptr) {
+            SMART_PTRS_TRACE_EVENT(kCopy, kWeak, ctrl_);
             ctrl_->IncreaseWeakCounter();
         }
     }
@@ -21,11 +22,13 @@ public:
     template <class Y>
     WeakPtr(const WeakPtr<Y>& other) : ptr_(other.Get()), ctrl_(other.GetControl()) {
         if (ctrl_ != nullptr) {
+            SMART_PTRS_TRACE_EVENT(kCopy, kWeak, ctrl_);
             ctrl_->IncreaseWeakCounter();
         }
     }
 
     WeakPtr(WeakPtr&& other) : ptr_(other.ptr_), ctrl_(other.ctrl_) {
+        SMART_PTRS_TRACE_EVENT(kMove, kWeak, ctrl_);
         other.ptr_ = nullptr;
         other.ctrl_ = nullptr;
     }
@@ -34,6 +37,7 @@ public:
     // #2 from https://en.cppreference.com/w/cpp/memory/weak_ptr/weak_ptr
     WeakPtr(const SharedPtr<T>& other) : ptr_(other.ptr_), ctrl_(other.ctrl_) {
         if (ctrl_ != nullptr) {
+            SMART_PTRS_TRACE_EVENT(kCopy, kWeak, ctrl_);
             ctrl_->IncreaseWeakCounter();
         }
     }
@@ -42,62 +46,23 @@ public:
     // `operator=`-s
 
     WeakPtr& operator=(const SharedPtr<T>& other) {
-        ControlBlock* old_ctrl = ctrl_;
-        ptr_ = other.ptr_;
-        ctrl_ = other.ctrl_;
-        if (ctrl_ != nullptr) {
-            ctrl_->IncreaseWeakCounter();
-        }
-        if (old_ctrl != nullptr) {
-            old_ctrl->DecreaseWeakCounter();
-        }
+        WeakPtr(other).Swap(*this);
         return *this;
     }
 
     WeakPtr& operator=(const WeakPtr& other) {
-        if (this != &other) {
-            ControlBlock* old_ctrl = ctrl_;
-            ptr_ = other.ptr_;
-            ctrl_ = other.ctrl_;
-            if (ctrl_ != nullptr) {
-                ctrl_->IncreaseWeakCounter();
-            }
-            if (old_ctrl != nullptr) {
-                old_ctrl->DecreaseWeakCounter();
-            }
-        }
+        WeakPtr(other).Swap(*this);
         return *this;
     }
 
     template <class Y>
     WeakPtr& operator=(const WeakPtr<Y>& other) {
-        ControlBlock* old_ctrl = ctrl_;
-        ptr_ = dynamic_cast<T*>(other.Get());
-        ctrl_ = other.GetControl();
-        if (ctrl_ != nullptr) {
-            ctrl_->IncreaseWeakCounter();
-        }
-        if (old_ctrl != nullptr) {
-            old_ctrl->DecreaseWeakCounter();
-        }
+        WeakPtr(other).Swap(*this);
         return *this;
     }
 
     WeakPtr& operator=(WeakPtr&& other) {
-        if (this != &other) {
-            ControlBlock* old_ctrl = ctrl_;
-            if (ctrl_ != nullptr) {
-                ctrl_->DecreaseWeakCounter();
-            }
-            ptr_ = other.ptr_;
-            ctrl_ = other.ctrl_;
-            if (old_ctrl != nullptr && old_ctrl->GetSharedCounter() == 0 &&
-                old_ctrl->GetWeakCounter() == 0) {
-                delete old_ctrl;
-            }
-            other.ptr_ = nullptr;
-            other.ctrl_ = nullptr;
-        }
+        WeakPtr(std::move(other)).Swap(*this);
         return *this;
     }
 
@@ -106,11 +71,8 @@ public:
 
     ~WeakPtr() {
         if (ctrl_ != nullptr) {
+            SMART_PTRS_TRACE_EVENT(kDestroy, kWeak, ctrl_);
             ctrl_->DecreaseWeakCounter();
-            if (ctrl_->GetSharedCounter() == 0 && ctrl_->GetWeakCounter() == 0) {
-                delete ctrl_;
-                ctrl_ = nullptr;
-            }
         }
     }
 
@@ -119,10 +81,8 @@ public:
 
     void Reset() {
         if (ctrl_ != nullptr) {
+            SMART_PTRS_TRACE_EVENT(kDestroy, kWeak, ctrl_);
             ctrl_->DecreaseWeakCounter();
-            if (ctrl_->GetSharedCounter() == 0 && ctrl_->GetWeakCounter() == 0) {
-                delete ctrl_;
-            }
         }
         ptr_ = nullptr;
         ctrl_ = nullptr;
@@ -149,11 +109,12 @@ public:
     }
 
     SharedPtr<T> Lock() const {
-        if (Expired()) {
+        if (ctrl_ == nullptr || !ctrl_->TryIncreaseSharedCounter()) {
+            SMART_PTRS_TRACE_EVENT(kLockFail, kWeak, ctrl_);
             return SharedPtr<T>();
-        } else {
-            return SharedPtr<T>(*this);
         }
+        SMART_PTRS_TRACE_EVENT(kCopy, kShared, ctrl_);
+        return SharedPtr<T>(ptr_, ctrl_);
     }
 
     T* Get() const {